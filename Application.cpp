@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <memory>
+#include <stdlib.h>
 #include <string.h>
 #include <tracy/Tracy.hpp>
 
@@ -16,11 +17,15 @@
 #include "BlockData.hpp"
 #include "DataProvider.hpp"
 #include "Debug.hpp"
-#include "Error.hpp"
+#include "Metrics.hpp"
+#include "MipMap.hpp"
+#include "ModeStats.hpp"
+#include "Supercompress.hpp"
 #include "System.hpp"
 #include "TaskDispatch.hpp"
 #include "Timing.hpp"
 #include "TextureHeader.hpp"
+#include "Trace.hpp"
 
 struct DebugCallback_t : public DebugLog::Callback
 {
@@ -32,20 +37,50 @@ struct DebugCallback_t : public DebugLog::Callback
 
 void Usage()
 {
-    fprintf( stderr, "Usage: etcpak [options] input.png {output.pvr}\n" );
+    fprintf( stderr, "Usage: etcpak [options] input.png [input2.png...] {output.pvr}\n" );
     fprintf( stderr, "  Options:\n" );
     fprintf( stderr, "  -v                     view mode (loads pvr/ktx file, decodes it and saves to png)\n" );
-    fprintf( stderr, "  -s                     display image quality measurements\n" );
+    fprintf( stderr, "  -s                     display image quality measurements (benchmark mode: also time decoding)\n" );
     fprintf( stderr, "  -b                     benchmark mode\n" );
     fprintf( stderr, "  -M                     switch benchmark to multi-threaded mode\n" );
     fprintf( stderr, "  -m                     generate mipmaps\n" );
     fprintf( stderr, "  -d                     enable dithering\n" );
     fprintf( stderr, "  -c codec               use specified codec (defaults to etc2_rgb)\n" );
-    fprintf( stderr, "                         [etc1, etc2_r, etc2_rg, etc2_rgb, etc2_rgba, bc1, bc3, bc4, bc5, bc7]\n" );
+    fprintf( stderr, "                         [etc1, etc2_r, etc2_rg, etc2_r_signed, etc2_rg_signed, etc2_rgb, etc2_rgba,\n" );
+    fprintf( stderr, "                          etc2_rgb8a1, bc1, bc3, bc4, bc5, bc7]\n" );
     fprintf( stderr, "  -h header              use specified header for output file (defaults to pvr)\n" );
-    fprintf( stderr, "                         [pvr, dds]\n" );
+    fprintf( stderr, "                         [pvr, dds, ktx, ktx2]\n" );
     fprintf( stderr, "  --disable-heuristics   disable heuristic selector of compression mode\n" );
-    fprintf( stderr, "  --linear               input data is in linear space (disable sRGB conversion for mips)\n\n" );
+    fprintf( stderr, "  --high-quality         use slower, least-squares refined bc1/bc3 color encoder\n" );
+    fprintf( stderr, "                         (bc1 also uses 3-color mode)\n" );
+    fprintf( stderr, "                         and a wider multiplier search for etc2_r/etc2_rg\n" );
+    fprintf( stderr, "  --punchthrough         with bc1 --high-quality, encode alpha < 128 as transparent black\n" );
+    fprintf( stderr, "  --linear               input data is in linear space (disable sRGB conversion for mips)\n" );
+    fprintf( stderr, "  --rdo lambda           rate-distortion optimize bc1-5 and bc7 output for smaller LZ compressed size\n" );
+#ifdef ETCPAK_ZSTD
+    fprintf( stderr, "  --zstd level           supercompress each ktx2 mip level with zstd at given level\n" );
+#endif
+    fprintf( stderr, "  --supercompress type   compress the output file in independent per-strip frames\n" );
+#ifdef ETCPAK_ZSTD
+    fprintf( stderr, "                         [deflate, zstd]\n" );
+#else
+    fprintf( stderr, "                         [deflate]\n" );
+#endif
+    fprintf( stderr, "  --target-psnr dB       compress with the fastest codec settings, and with slower ones only the blocks\n" );
+    fprintf( stderr, "                         below the target PSNR (overrides --disable-heuristics, --high-quality)\n" );
+    fprintf( stderr, "  --mode-stats file.json write the counts of encoder mode decisions (-s prints them)\n" );
+    fprintf( stderr, "                         (needs a build with the ETCPAK_MODE_STATS cmake option)\n" );
+#ifndef _WIN32
+    fprintf( stderr, "  --writer type          how uncompressed output reaches the file (defaults to mmap)\n" );
+    fprintf( stderr, "                         [mmap, pwrite (each strip once encoded), direct (pwrite with O_DIRECT)]\n" );
+#endif
+    fprintf( stderr, "  --trace file.json      write a timeline of the loader threads and compression tasks (chrome://tracing)\n" );
+    fprintf( stderr, "  --heatmap file.png     write the error of each block as an image (RMSE 0: black, 16 and more: red)\n" );
+    fprintf( stderr, "  --texture type         store all input images as slices of one texture (defaults to 2d)\n" );
+    fprintf( stderr, "                         [2d, cube (faces +X, -X, +Y, -Y, +Z, -Z), array, 3d]\n" );
+    fprintf( stderr, "  --level n              view mode: decode mip level n\n" );
+    fprintf( stderr, "  --verify               check headers of all given files (etcpak --verify file...)\n" );
+    fprintf( stderr, "  --verify-blocks n      verify mode: also decode n sampled blocks of each file\n\n" );
     fprintf( stderr, "Output file name may be unneeded for some modes.\n" );
 }
 
@@ -63,6 +98,22 @@ int main( int argc, char** argv )
     bool dither = false;
     bool linearize = true;
     bool useHeuristics = true;
+    bool highQuality = false;
+    bool punchThrough = false;
+    float rdoLambda = 0;
+    int zstdLevel = 0;
+    int viewLevel = 0;
+    auto stream = Supercompression::None;
+    bool verify = false;
+    int verifySamples = 0;
+    const char* heatmap = nullptr;
+    float targetPsnr = 0;
+#ifdef ETCPAK_MODE_STATS
+    const char* modeStats = nullptr;
+#endif
+    const char* trace = nullptr;
+    auto writer = BlockData::Mmap;
+    auto layout = Texture2D;
     auto codec = CodecType::Etc2_RGB;
     auto header = BlockData::Format::Pvr;
     unsigned int cpus = System::CPUCores();
@@ -76,12 +127,44 @@ int main( int argc, char** argv )
     enum Options
     {
         OptLinear,
-        OptNoHeuristics
+        OptNoHeuristics,
+        OptHighQuality,
+        OptPunchThrough,
+        OptRdo,
+        OptZstd,
+        OptLevel,
+        OptSupercompress,
+        OptVerify,
+        OptVerifyBlocks,
+        OptTexture,
+        OptHeatmap,
+        OptTargetPsnr,
+        OptModeStats,
+        OptTrace,
+        OptWriter
     };
 
     struct option longopts[] = {
         { "linear", no_argument, nullptr, OptLinear },
         { "disable-heuristics", no_argument, nullptr, OptNoHeuristics },
+        { "high-quality", no_argument, nullptr, OptHighQuality },
+        { "punchthrough", no_argument, nullptr, OptPunchThrough },
+        { "rdo", required_argument, nullptr, OptRdo },
+#ifdef ETCPAK_ZSTD
+        { "zstd", required_argument, nullptr, OptZstd },
+#endif
+        { "level", required_argument, nullptr, OptLevel },
+        { "supercompress", required_argument, nullptr, OptSupercompress },
+        { "verify", no_argument, nullptr, OptVerify },
+        { "verify-blocks", required_argument, nullptr, OptVerifyBlocks },
+        { "texture", required_argument, nullptr, OptTexture },
+        { "heatmap", required_argument, nullptr, OptHeatmap },
+        { "target-psnr", required_argument, nullptr, OptTargetPsnr },
+        { "trace", required_argument, nullptr, OptTrace },
+#ifndef _WIN32
+        { "writer", required_argument, nullptr, OptWriter },
+#endif
+        { "mode-stats", required_argument, nullptr, OptModeStats },
         {}
     };
 
@@ -115,8 +198,11 @@ int main( int argc, char** argv )
             if( strcmp( optarg, "etc1" ) == 0 ) codec = CodecType::Etc1;
             else if( strcmp( optarg, "etc2_r" ) == 0 ) codec = CodecType::Etc2_R11;
             else if( strcmp( optarg, "etc2_rg" ) == 0 ) codec = CodecType::Etc2_RG11;
+            else if( strcmp( optarg, "etc2_r_signed" ) == 0 ) codec = CodecType::Etc2_R11_Signed;
+            else if( strcmp( optarg, "etc2_rg_signed" ) == 0 ) codec = CodecType::Etc2_RG11_Signed;
             else if( strcmp( optarg, "etc2_rgb" ) == 0 ) codec = CodecType::Etc2_RGB;
             else if( strcmp( optarg, "etc2_rgba" ) == 0 ) codec = CodecType::Etc2_RGBA;
+            else if( strcmp( optarg, "etc2_rgb8a1" ) == 0 ) codec = CodecType::Etc2_RGB8A1;
             else if( strcmp( optarg, "bc1" ) == 0 ) codec = CodecType::Bc1;
             else if( strcmp( optarg, "bc3" ) == 0 ) codec = CodecType::Bc3;
             else if( strcmp( optarg, "bc4" ) == 0 ) codec = CodecType::Bc4;
@@ -131,6 +217,8 @@ int main( int argc, char** argv )
         case 'h':
             if( strcmp( optarg, "pvr" ) == 0 ) header = BlockData::Pvr;
             else if( strcmp( optarg, "dds" ) == 0 ) header = BlockData::Dds;
+            else if( strcmp( optarg, "ktx" ) == 0 ) header = BlockData::Ktx;
+            else if( strcmp( optarg, "ktx2" ) == 0 ) header = BlockData::Ktx2;
             else
             {
                 fprintf( stderr, "Unknown header: %s\n", optarg );
@@ -143,13 +231,122 @@ int main( int argc, char** argv )
         case OptNoHeuristics:
             useHeuristics = false;
             break;
+        case OptHighQuality:
+            highQuality = true;
+            break;
+        case OptPunchThrough:
+            punchThrough = true;
+            break;
+        case OptRdo:
+            rdoLambda = atof( optarg );
+            break;
+        case OptZstd:
+            zstdLevel = atoi( optarg );
+            break;
+        case OptLevel:
+            viewLevel = atoi( optarg );
+            break;
+        case OptSupercompress:
+            if( strcmp( optarg, "deflate" ) == 0 ) stream = Supercompression::Deflate;
+#ifdef ETCPAK_ZSTD
+            else if( strcmp( optarg, "zstd" ) == 0 ) stream = Supercompression::Zstd;
+#endif
+            else
+            {
+                fprintf( stderr, "Unknown supercompression: %s\n", optarg );
+                return 1;
+            }
+            break;
+        case OptVerify:
+            verify = true;
+            break;
+        case OptVerifyBlocks:
+            verifySamples = atoi( optarg );
+            break;
+        case OptTexture:
+            if( strcmp( optarg, "2d" ) == 0 ) layout = Texture2D;
+            else if( strcmp( optarg, "cube" ) == 0 ) layout = TextureCube;
+            else if( strcmp( optarg, "array" ) == 0 ) layout = TextureArray;
+            else if( strcmp( optarg, "3d" ) == 0 ) layout = Texture3D;
+            else
+            {
+                fprintf( stderr, "Unknown texture type: %s\n", optarg );
+                return 1;
+            }
+            break;
+        case OptHeatmap:
+            heatmap = optarg;
+            break;
+        case OptTargetPsnr:
+            targetPsnr = atof( optarg );
+            break;
+        case OptModeStats:
+#ifdef ETCPAK_MODE_STATS
+            modeStats = optarg;
+            break;
+#else
+            fprintf( stderr, "Mode statistics are not compiled in, configure with -DETCPAK_MODE_STATS=ON\n" );
+            return 1;
+#endif
+        case OptTrace:
+            trace = optarg;
+            break;
+        case OptWriter:
+            if( strcmp( optarg, "mmap" ) == 0 ) writer = BlockData::Mmap;
+            else if( strcmp( optarg, "pwrite" ) == 0 ) writer = BlockData::Pwrite;
+            else if( strcmp( optarg, "direct" ) == 0 ) writer = BlockData::Direct;
+            else
+            {
+                fprintf( stderr, "Unknown writer: %s\n", optarg );
+                return 1;
+            }
+            break;
         default:
             break;
         }
     }
 
+    if( verify )
+    {
+        const int files = argc - optind;
+        if( files < 1 )
+        {
+            Usage();
+            return 1;
+        }
+
+        std::vector<TextureError> result( files );
+        const auto start = GetTime();
+        {
+            TaskDispatch taskDispatch( cpus );
+            for( int i=0; i<files; i++ )
+            {
+                TaskDispatch::Queue( [&result, argv, i, verifySamples]()
+                {
+                    result[i] = BlockData::Verify( argv[optind+i], verifySamples );
+                } );
+            }
+            TaskDispatch::Sync();
+        }
+        const auto end = GetTime();
+
+        int failed = 0;
+        for( int i=0; i<files; i++ )
+        {
+            if( result[i] != TextureError::Ok )
+            {
+                printf( "%s: %s\n", argv[optind+i], TextureErrorString( result[i] ) );
+                failed++;
+            }
+        }
+        const auto time = ( end - start ) / 1000.f;
+        printf( "%i files verified, %i failed (%0.3f ms, %0.0f files/s)\n", files, failed, time, files * 1000 / time );
+        return failed == 0 ? 0 : 1;
+    }
+
     const char* input = nullptr;
     const char* output = nullptr;
+    int slices = 1;
     if( benchmark )
     {
         if( argc - optind < 1 )
@@ -168,25 +365,96 @@ int main( int argc, char** argv )
             return 1;
         }
 
+        // all but the last argument are input images
+        slices = argc - optind - 1;
         input = argv[optind];
-        output = argv[optind+1];
+        output = argv[argc-1];
+    }
+
+    if( !benchmark && !viewMode )
+    {
+        if( layout == TextureCube && slices != 6 )
+        {
+            fprintf( stderr, "Cube maps need 6 input images, got %i\n", slices );
+            return 1;
+        }
+        if( layout == Texture2D && slices != 1 )
+        {
+            fprintf( stderr, "Multiple input images need --texture array, cube or 3d\n" );
+            return 1;
+        }
+        if( layout == Texture3D && mipmap )
+        {
+            fprintf( stderr, "Mipmaps of 3d textures are not supported\n" );
+            return 1;
+        }
+    }
+
+    if( heatmap && ( benchmark || viewMode ) )
+    {
+        fprintf( stderr, "Error heatmap can only be written when compressing\n" );
+        return 1;
+    }
+    if( targetPsnr > 0 && ( benchmark || viewMode ) )
+    {
+        fprintf( stderr, "Target PSNR can only be set when compressing\n" );
+        return 1;
+    }
+    // the fast bc1 encoder, also the first --target-psnr tier, ignores alpha
+    if( punchThrough && ( codec != CodecType::Bc1 || !highQuality || targetPsnr > 0 ) )
+    {
+        fprintf( stderr, "Punch-through alpha needs -c bc1 --high-quality, without --target-psnr\n" );
+        return 1;
+    }
+    if( trace && ( benchmark || viewMode ) )
+    {
+        fprintf( stderr, "Trace can only be written when compressing\n" );
+        return 1;
+    }
+
+    if( stream != Supercompression::None && header == BlockData::Ktx2 && zstdLevel != 0 )
+    {
+        fprintf( stderr, "Per-level ktx2 zstd and whole file supercompression are exclusive\n" );
+        return 1;
     }
 
     const bool bgr = !( codec == CodecType::Bc1 || codec == CodecType::Bc3 || codec == CodecType::Bc4 || codec == CodecType::Bc5 || codec == CodecType::Bc7 );
+    const bool wide = codec == CodecType::Etc2_R11 || codec == CodecType::Etc2_RG11 || codec == CodecType::Etc2_R11_Signed || codec == CodecType::Etc2_RG11_Signed;
+    const bool snorm = codec == CodecType::Etc2_R11_Signed || codec == CodecType::Etc2_RG11_Signed;
     const bool rgba = ( codec == CodecType::Etc2_RGBA || codec == CodecType::Bc3 || codec == CodecType::Bc7 );
+    const bool alpha = HasAlpha( codec );
+    const int channels = ColorChannels( codec );
 
     bc7enc_compress_block_params bc7params;
+    bc7enc_reduce_entropy_params rdoParams;
+    const bc7enc_reduce_entropy_params* rdo = nullptr;
     if( codec == CodecType::Bc7 )
     {
         bc7enc_compress_block_init();
         bc7enc_compress_block_params_init( &bc7params );
     }
+    if( rdoLambda > 0 && bgr )
+    {
+        fprintf( stderr, "Rate-distortion optimization is only available for the bc1, bc3, bc4, bc5 and bc7 codecs\n" );
+        return 1;
+    }
+    if( rdoLambda > 0 )
+    {
+        bc7enc_reduce_entropy_params_init( &rdoParams );
+        rdoParams.m_lambda = rdoLambda;
+        rdo = &rdoParams;
+    }
 
     if( benchmark )
     {
         if( viewMode )
         {
             auto bd = std::make_shared<BlockData>( input );
+            if( bd->Error() != TextureError::Ok )
+            {
+                fprintf( stderr, "%s: %s\n", input, TextureErrorString( bd->Error() ) );
+                return 1;
+            }
 
             constexpr int NumTasks = 9;
             uint64_t timeData[NumTasks];
@@ -204,36 +472,38 @@ int main( int argc, char** argv )
         else
         {
             auto start = GetTime();
-            auto bmp = std::make_shared<Bitmap>( input, std::numeric_limits<unsigned int>::max(), bgr );
+            auto bmp = std::make_shared<Bitmap>( input, std::numeric_limits<unsigned int>::max(), bgr, wide, snorm );
             bmp->Data();
             auto end = GetTime();
             printf( "Image load time: %0.3f ms\n", ( end - start ) / 1000.f );
 
             constexpr int NumTasks = 9;
             uint64_t timeData[NumTasks];
+            BlockDataPtr result;
             if( benchMt )
             {
                 TaskDispatch taskDispatch( cpus );
-                const unsigned int parts = ( ( bmp->Size().y / 4 ) + 32 - 1 ) / 32;
+                const unsigned int parts = ( ( bmp->PaddedHeight() / 4 ) + 32 - 1 ) / 32;
 
                 for( int i=0; i<NumTasks; i++ )
                 {
                     auto bd = std::make_shared<BlockData>( bmp->Size(), false, codec );
+                    if( punchThrough ) bd->SetPunchThrough();
                     auto ptr = bmp->Data();
-                    const auto width = bmp->Size().x;
+                    const auto width = bmp->Stride();
                     const auto localStart = GetTime();
-                    auto linesLeft = bmp->Size().y / 4;
+                    auto linesLeft = bmp->PaddedHeight() / 4;
                     size_t offset = 0;
                     if( rgba )
                     {
                         for( int j=0; j<parts; j++ )
                         {
                             const auto lines = std::min( 32, linesLeft );
-                            taskDispatch.Queue( [bd, ptr, width, lines, offset, useHeuristics, &bc7params] {
-                                bd->ProcessRGBA( ptr, width * lines / 4, offset, width, useHeuristics, &bc7params );
+                            taskDispatch.Queue( [bd, ptr, width, lines, offset, useHeuristics, highQuality, &bc7params, rdo] {
+                                bd->ProcessRGBA( ptr, width * lines / 4, offset, width, useHeuristics, highQuality, &bc7params, rdo );
                             } );
                             linesLeft -= lines;
-                            ptr += width * lines;
+                            ptr += width * lines * 4 * ( wide ? 2 : 1 );
                             offset += width * lines / 4;
                         }
                     }
@@ -242,17 +512,18 @@ int main( int argc, char** argv )
                         for( int j=0; j<parts; j++ )
                         {
                             const auto lines = std::min( 32, linesLeft );
-                            taskDispatch.Queue( [bd, ptr, width, lines, offset, dither, useHeuristics] {
-                                bd->Process( ptr, width * lines / 4, offset, width, dither, useHeuristics );
+                            taskDispatch.Queue( [bd, ptr, width, lines, offset, dither, useHeuristics, highQuality, rdo] {
+                                bd->Process( ptr, width * lines / 4, offset, width, dither, useHeuristics, highQuality, rdo );
                             } );
                             linesLeft -= lines;
-                            ptr += width * lines;
+                            ptr += width * lines * 4 * ( wide ? 2 : 1 );
                             offset += width * lines / 4;
                         }
                     }
                     taskDispatch.Sync();
                     const auto localEnd = GetTime();
                     timeData[i] = localEnd - localStart;
+                    result = bd;
                 }
             }
             else
@@ -260,17 +531,19 @@ int main( int argc, char** argv )
                 for( int i=0; i<NumTasks; i++ )
                 {
                     auto bd = std::make_shared<BlockData>( bmp->Size(), false, codec );
+                    if( punchThrough ) bd->SetPunchThrough();
                     const auto localStart = GetTime();
                     if( rgba )
                     {
-                        bd->ProcessRGBA( bmp->Data(), bmp->Size().x * bmp->Size().y / 16, 0, bmp->Size().x, useHeuristics, &bc7params );
+                        bd->ProcessRGBA( bmp->Data(), bmp->Stride() * bmp->PaddedHeight() / 16, 0, bmp->Stride(), useHeuristics, highQuality, &bc7params, rdo );
                     }
                     else
                     {
-                        bd->Process( bmp->Data(), bmp->Size().x * bmp->Size().y / 16, 0, bmp->Size().x, dither, useHeuristics );
+                        bd->Process( bmp->Data(), bmp->Stride() * bmp->PaddedHeight() / 16, 0, bmp->Stride(), dither, useHeuristics, highQuality, rdo );
                     }
                     const auto localEnd = GetTime();
                     timeData[i] = localEnd - localStart;
+                    result = bd;
                 }
             }
             std::sort( timeData, timeData+NumTasks );
@@ -284,51 +557,215 @@ int main( int argc, char** argv )
             {
                 printf( " single threaded\n" );
             }
+
+            if( stats )
+            {
+                // round trip: decode the data compressed in the last run
+                for( int i=0; i<NumTasks; i++ )
+                {
+                    const auto start = GetTime();
+                    auto res = result->Decode();
+                    const auto end = GetTime();
+                    timeData[i] = end - start;
+                }
+                std::sort( timeData, timeData+NumTasks );
+                const auto decodeMedian = timeData[NumTasks/2] / 1000.f;
+                printf( "Median decode time for %i runs: %0.3f ms (%0.3f Mpx/s)\n", NumTasks, decodeMedian, bmp->Size().x * bmp->Size().y / ( decodeMedian * 1000 ) );
+            }
         }
     }
     else if( viewMode )
     {
-        auto bd = std::make_shared<BlockData>( input );
+        TextureInfo info;
+        const auto error = BlockData::Verify( input, 0, &info );
+        if( error != TextureError::Ok )
+        {
+            fprintf( stderr, "%s: %s\n", input, TextureErrorString( error ) );
+            return 1;
+        }
+        if( viewLevel < 0 || viewLevel >= info.levels )
+        {
+            fprintf( stderr, "%s: no mip level %i\n", input, viewLevel );
+            return 1;
+        }
+        auto bd = std::make_shared<BlockData>( input, viewLevel );
+        if( bd->Error() != TextureError::Ok )
+        {
+            fprintf( stderr, "%s: %s\n", input, TextureErrorString( bd->Error() ) );
+            return 1;
+        }
         auto out = bd->Decode();
         out->Write( output );
     }
     else
     {
-        DataProvider dp( input, mipmap, bgr, linearize );
-        auto num = dp.NumberOfParts();
+        if( trace ) TraceStart();
+
+        // all images start loading at once, slices are queued one after another
+        std::vector<std::unique_ptr<DataProvider>> providers;
+        for( int i=0; i<slices; i++ )
+        {
+            providers.emplace_back( std::make_unique<DataProvider>( argv[optind+i], mipmap, bgr, linearize, wide, snorm ) );
+            if( providers[i]->Size() != providers[0]->Size() )
+            {
+                fprintf( stderr, "%s: size differs from %s\n", argv[optind+i], input );
+                return 1;
+            }
+        }
+        auto& dp = *providers[0];
 
         TaskDispatch taskDispatch( cpus );
 
-        auto bd = std::make_shared<BlockData>( output, dp.Size(), mipmap, codec, header );
-        for( int i=0; i<num; i++ )
+        auto bd = std::make_shared<BlockData>( output, dp.Size(), mipmap, codec, header, zstdLevel, stream, layout, slices, writer );
+        if( punchThrough ) bd->SetPunchThrough();
+        if( targetPsnr > 0 ) bd->SetTargetPsnr( targetPsnr, bgr, wide );
+        else if( stats || heatmap ) bd->MeasureErrors( bgr, wide );
+        for( int s=0; s<slices; s++ )
         {
-            auto part = dp.NextPart();
-
-            if( rgba )
+            auto& provider = *providers[s];
+            const auto sliceOffset = s * bd->SliceBlocks();
+            auto num = provider.NumberOfParts();
+            for( int i=0; i<num; i++ )
             {
-                TaskDispatch::Queue( [part, &bd, useHeuristics, &bc7params]()
+                auto part = provider.NextPart();
+                const size_t offset = sliceOffset + part.offset;
+
+                if( rgba )
                 {
-                    bd->ProcessRGBA( part.src, part.width / 4 * part.lines, part.offset, part.width, useHeuristics, &bc7params );
-                } );
-            }
-            else
-            {
-                TaskDispatch::Queue( [part, &bd, &dither, useHeuristics]()
+                    TaskDispatch::Queue( [part, offset, &bd, useHeuristics, highQuality, &bc7params, rdo]()
+                    {
+                        ZoneScopedN( "Part" );
+                        ZoneValue( part.level );
+                        TraceScope trace( "Part", part.level );
+                        bd->ProcessRGBA( part.src, part.width / 4 * part.lines, offset, part.width, useHeuristics, highQuality, &bc7params, rdo );
+                    } );
+                }
+                else
                 {
-                    bd->Process( part.src, part.width / 4 * part.lines, part.offset, part.width, dither, useHeuristics );
-                } );
+                    TaskDispatch::Queue( [part, offset, &bd, &dither, useHeuristics, highQuality, rdo]()
+                    {
+                        ZoneScopedN( "Part" );
+                        ZoneValue( part.level );
+                        TraceScope trace( "Part", part.level );
+                        bd->Process( part.src, part.width / 4 * part.lines, offset, part.width, dither, useHeuristics, highQuality, rdo );
+                    } );
+                }
             }
         }
 
         TaskDispatch::Sync();
+        bd->Finish();
+
+        // -s reports the compressed sizes with the other measurements
+        if( rdo && !stats )
+        {
+            const auto size = CalcDeflateSize( bd->Blocks(), bd->BlocksSize() );
+            printf( "Deflate compressed size: %zu bytes (%0.3f bpp)\n", size, size * 8.f / ( dp.Size().x * dp.Size().y ) );
+        }
+
+        if( targetPsnr > 0 )
+        {
+            printf( "Target PSNR %0.2f (time summed over threads)\n", targetPsnr );
+            for( auto& tier : bd->Tiers() )
+            {
+                printf( "  %s: %zu blocks, %0.3f ms\n", tier.name, tier.blocks, tier.time / 1000.f );
+            }
+            printf( "  %zu blocks below target\n", bd->MissedBlocks() );
+        }
+
+        if( heatmap )
+        {
+            const uint32_t mask = ( ( 1 << channels ) - 1 ) | ( alpha ? 8 : 0 );
+            BlockErrorHeatmap( bd->LevelErrors( 0 ), dp.Size(), mask )->Write( heatmap );
+        }
 
         if( stats )
         {
+            const auto pixels = float( dp.Size().x * dp.Size().y );
+            const auto deflate = CalcDeflateSize( bd->Blocks(), bd->BlocksSize() );
+            printf( "Compressed size\n" );
+            printf( "  Deflate: %zu bytes (%0.3f bpp)\n", deflate, deflate * 8 / pixels );
+#ifdef ETCPAK_ZSTD
+            const auto zstd = CalcZstdSize( bd->Blocks(), bd->BlocksSize() );
+            printf( "  Zstd: %zu bytes (%0.3f bpp)\n", zstd, zstd * 8 / pixels );
+#endif
+
+            // the error comes from the blocks as they were encoded, SSIM needs the decoded image
+            double blockMse[4];
+            CalcBlockMse( bd->LevelErrors( 0 ), dp.Size(), blockMse );
             auto out = bd->Decode();
-            float mse = CalcMSE3( dp.ImageData(), *out );
-            printf( "RGB data\n" );
+            const auto metrics = CalcMetrics( dp.ImageData(), *out, bgr, codec == CodecType::Etc2_RGB8A1 || punchThrough );
+
+            double mse = 0;
+            for( int i=0; i<channels; i++ ) mse += blockMse[i];
+            mse /= channels;
+            printf( "%.*s data\n", channels, "RGB" );
             printf( "  RMSE: %f\n", sqrt( mse ) );
-            printf( "  PSNR: %f\n", 20 * log10( 255 ) - 10 * log10( mse ) );
+            printf( "  PSNR: %f\n", Psnr( mse ) );
+            if( metrics.scales > 0 )
+            {
+                double ssim = 0;
+                for( int i=0; i<channels; i++ ) ssim += metrics.ssim[i];
+                printf( "  SSIM: %f\n", ssim / channels );
+                if( channels == 3 ) printf( "  MS-SSIM: %f (%i scales)\n", metrics.msssim, metrics.scales );
+            }
+            if( channels > 1 )
+            {
+                for( int i=0; i<channels; i++ )
+                {
+                    printf( "  %c: RMSE %f, PSNR %f", "RGB"[i], sqrt( blockMse[i] ), Psnr( blockMse[i] ) );
+                    if( metrics.scales > 0 ) printf( ", SSIM %f", metrics.ssim[i] );
+                    printf( "\n" );
+                }
+            }
+            if( alpha )
+            {
+                printf( "Alpha data\n" );
+                printf( "  RMSE: %f\n", sqrt( blockMse[3] ) );
+                printf( "  PSNR: %f\n", Psnr( blockMse[3] ) );
+                if( metrics.scales > 0 ) printf( "  SSIM: %f\n", metrics.ssim[3] );
+            }
+            if( mipmap )
+            {
+                printf( "Mip levels (%.*s%s PSNR)\n", channels, "RGB", alpha ? ", alpha" : "" );
+                const int levels = NumberOfMipLevels( dp.Size() );
+                for( int i=0; i<levels; i++ )
+                {
+                    const v2i size = { std::max( 1, dp.Size().x >> i ), std::max( 1, dp.Size().y >> i ) };
+                    double levelMse[4];
+                    CalcBlockMse( bd->LevelErrors( i ), size, levelMse );
+                    double color = 0;
+                    for( int j=0; j<channels; j++ ) color += levelMse[j];
+                    printf( "  %i: %ix%i  %f", i, size.x, size.y, Psnr( color / channels ) );
+                    if( alpha ) printf( ", %f", Psnr( levelMse[3] ) );
+                    printf( "\n" );
+                }
+            }
+        }
+
+#ifdef ETCPAK_MODE_STATS
+        if( stats || modeStats )
+        {
+            const auto counts = CollectModeStats();
+            if( stats ) PrintModeStats( counts );
+            if( modeStats )
+            {
+                FILE* f = fopen( modeStats, "w" );
+                if( !f )
+                {
+                    fprintf( stderr, "Cannot write %s\n", modeStats );
+                    return 1;
+                }
+                WriteModeStats( f, counts );
+                fclose( f );
+            }
+        }
+#endif
+
+        if( trace && !TraceWrite( trace ) )
+        {
+            fprintf( stderr, "Cannot write %s\n", trace );
+            return 1;
         }
     }
 
@@ -0,0 +1,754 @@
+#include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#  include "getopt/getopt.h"
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <getopt.h>
+#endif
+
+#if defined __x86_64__ || defined _M_X64 || defined __i386__ || defined _M_IX86
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <x86intrin.h>
+#  endif
+#endif
+
+#include "bc7enc.h"
+#include "Bitmap.hpp"
+#include "BlockData.hpp"
+#include "Metrics.hpp"
+#include "ModeStats.hpp"
+#include "ProcessDxtc.hpp"
+#include "ProcessRGB.hpp"
+#include "System.hpp"
+#include "TaskDispatch.hpp"
+#include "Timing.hpp"
+#include "TextureHeader.hpp"
+
+#ifndef ETCPAK_EXAMPLES
+#  define ETCPAK_EXAMPLES "examples"
+#endif
+
+// Source pixels in the layouts the codecs take: rgba, bgr, and bgr with 16 bits per channel
+enum { SrcRgba, SrcBgr, SrcWide, SrcLayouts };
+
+struct Image
+{
+    std::string name;
+    v2i size;
+    std::vector<uint32_t> data[SrcLayouts];     // whole 4x4 blocks, edge pixels replicated
+};
+
+struct Result
+{
+    std::string image;
+    v2i size;
+    CodecType codec;
+    int threads;
+    double min, median, p95;    // ms
+    double mpxs;
+    double rmse, psnr;
+};
+
+static int SrcLayout( CodecType codec )
+{
+    switch( codec )
+    {
+    case Bc1:
+    case Bc3:
+    case Bc4:
+    case Bc5:
+    case Bc7:
+        return SrcRgba;
+    case Etc2_R11:
+    case Etc2_RG11:
+    case Etc2_R11_Signed:
+    case Etc2_RG11_Signed:
+        return SrcWide;
+    default:
+        return SrcBgr;
+    }
+}
+
+static bool IsRgba( CodecType codec )
+{
+    return codec == Etc2_RGBA || codec == Bc3 || codec == Bc7;
+}
+
+// Fills the other layouts from the rgba one
+static void MakeLayouts( Image& img )
+{
+    const auto& rgba = img.data[SrcRgba];
+    auto& bgr = img.data[SrcBgr];
+    auto& wide = img.data[SrcWide];
+    bgr.resize( rgba.size() );
+    wide.resize( rgba.size() * 2 );
+    for( size_t i=0; i<rgba.size(); i++ )
+    {
+        const auto c = rgba[i];
+        bgr[i] = ( c & 0xFF00FF00 ) | ( ( c & 0xFF ) << 16 ) | ( ( c >> 16 ) & 0xFF );
+        const auto b = bgr[i];
+        wide[i*2]   = ( b & 0xFF ) * 257 | ( ( ( b >> 8 ) & 0xFF ) * 257 ) << 16;
+        wide[i*2+1] = ( ( b >> 16 ) & 0xFF ) * 257 | ( ( b >> 24 ) * 257 ) << 16;
+    }
+}
+
+static uint32_t Hash( uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t Rgba( int r, int g, int b, int a )
+{
+    return uint32_t( r ) | ( uint32_t( g ) << 8 ) | ( uint32_t( b ) << 16 ) | ( uint32_t( a ) << 24 );
+}
+
+static uint32_t Gradient( int x, int y, const v2i& size )
+{
+    return Rgba( x * 255 / ( size.x - 1 ), y * 255 / ( size.y - 1 ), ( x + y ) * 255 / ( size.x + size.y - 2 ), 128 + y * 127 / ( size.y - 1 ) );
+}
+
+static uint32_t Solid( int, int, const v2i& )
+{
+    return Rgba( 96, 160, 208, 255 );
+}
+
+static uint32_t Noise( int x, int y, const v2i& size )
+{
+    return Hash( y * size.x + x );
+}
+
+// Flat 16x16 cells of random color, with alpha cut out of every other one
+static uint32_t Edges( int x, int y, const v2i& )
+{
+    const auto cell = Hash( ( y / 16 ) * 4096 + x / 16 );
+    return ( cell & 0xFFFFFF ) | ( ( ( x / 16 + y / 16 ) & 1 ) ? 0xFF000000 : 0 );
+}
+
+// Gradient with some grain, at a size that is not a multiple of the block size
+static uint32_t Grain( int x, int y, const v2i& size )
+{
+    const auto g = Gradient( x, y, size );
+    const int n = int( Hash( y * size.x + x ) & 15 ) - 8;
+    int c[3];
+    for( int i=0; i<3; i++ ) c[i] = std::clamp( int( ( g >> ( i * 8 ) ) & 0xFF ) + n, 0, 255 );
+    return Rgba( c[0], c[1], c[2], 255 );
+}
+
+static Image Synthetic( const char* name, const v2i& size, uint32_t(*pixel)( int, int, const v2i& ) )
+{
+    Image img { name, size, {} };
+    const int stride = ( size.x + 3 ) & ~3;
+    const int height = ( size.y + 3 ) & ~3;
+    auto& rgba = img.data[SrcRgba];
+    rgba.resize( size_t( stride ) * height );
+    for( int y=0; y<height; y++ )
+    {
+        for( int x=0; x<stride; x++ )
+        {
+            rgba[y * stride + x] = pixel( std::min( x, size.x - 1 ), std::min( y, size.y - 1 ), size );
+        }
+    }
+    MakeLayouts( img );
+    return img;
+}
+
+static Image Load( const std::filesystem::path& path )
+{
+    Bitmap bmp( path.string().c_str(), std::numeric_limits<unsigned int>::max(), false );
+    Image img { path.filename().string(), bmp.Size(), {} };
+    const auto data = bmp.Data();
+    img.data[SrcRgba].assign( data, data + size_t( bmp.Stride() ) * bmp.PaddedHeight() );
+    MakeLayouts( img );
+    return img;
+}
+
+// Without a dispatch the whole image is compressed on the calling thread, otherwise in parts of
+// 32 block rows, as the benchmark mode of etcpak does
+static void Compress( BlockData& bd, const Image& img, CodecType codec, bool threaded, const bc7enc_compress_block_params* params )
+{
+    const auto layout = SrcLayout( codec );
+    const auto width = size_t( ( img.size.x + 3 ) & ~3 );
+    const int scale = layout == SrcWide ? 2 : 1;
+    auto ptr = img.data[layout].data();
+    int linesLeft = ( ( img.size.y + 3 ) & ~3 ) / 4;
+    const int partLines = threaded ? 32 : linesLeft;
+    size_t offset = 0;
+    while( linesLeft > 0 )
+    {
+        const auto lines = std::min( partLines, linesLeft );
+        const auto blocks = uint32_t( width * lines / 4 );
+        auto job = [&bd, ptr, blocks, offset, width, codec, params] {
+            if( IsRgba( codec ) )
+            {
+                bd.ProcessRGBA( ptr, blocks, offset, width, true, false, params, nullptr );
+            }
+            else
+            {
+                bd.Process( ptr, blocks, offset, width, false, true, false, nullptr );
+            }
+        };
+        if( threaded )
+        {
+            TaskDispatch::Queue( std::move( job ) );
+        }
+        else
+        {
+            job();
+        }
+        linesLeft -= lines;
+        ptr += width * lines * 4 * scale;
+        offset += blocks;
+    }
+    if( threaded ) TaskDispatch::Sync();
+}
+
+static void Quality( const Image& img, CodecType codec, const bc7enc_compress_block_params* params, Result& result )
+{
+    BlockData bd( img.size, false, codec );
+    bd.MeasureErrors( SrcLayout( codec ) != SrcRgba, SrcLayout( codec ) == SrcWide );
+    Compress( bd, img, codec, false, params );
+    double mse[4];
+    CalcBlockMse( bd.LevelErrors( 0 ), img.size, mse );
+    const int channels = ColorChannels( codec );
+    double color = 0;
+    for( int i=0; i<channels; i++ ) color += mse[i];
+    color /= channels;
+    result.rmse = sqrt( color );
+    result.psnr = Psnr( color );
+}
+
+// Every codec keeps a solid color nearly exact, so a low PSNR points at a broken decoder rather
+// than at the encoder
+static bool CheckDecoders( const std::vector<CodecType>& codecs, const bc7enc_compress_block_params* params )
+{
+    const auto img = Synthetic( "solid", v2i( 16, 16 ), Solid );
+    bool ok = true;
+    for( auto codec : codecs )
+    {
+        Result result {};
+        Quality( img, codec, params, result );
+        if( result.psnr < 30 )
+        {
+            fprintf( stderr, "%s: solid color decodes at PSNR %0.3f, the decoder is broken\n", CodecName( codec ), result.psnr );
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static void Time( const Image& img, CodecType codec, bool threaded, int runs, const bc7enc_compress_block_params* params, Result& result )
+{
+    std::vector<uint64_t> times( runs );
+    for( int i=0; i<runs; i++ )
+    {
+        BlockData bd( img.size, false, codec );
+        const auto start = GetTime();
+        Compress( bd, img, codec, threaded, params );
+        const auto end = GetTime();
+        times[i] = end - start;
+    }
+    std::sort( times.begin(), times.end() );
+    const int p95 = std::min( runs - 1, int( ceil( runs * 0.95 ) ) - 1 );
+    result.min = times[0] / 1000.;
+    result.median = times[runs/2] / 1000.;
+    result.p95 = times[p95] / 1000.;
+    result.mpxs = img.size.x * img.size.y / ( result.median * 1000 );
+}
+
+#ifndef _WIN32
+// Compresses on all cores straight into an output file with each writer. Every run ends with an
+// fsync, so writers that leave the data in the page cache do not look faster than O_DIRECT.
+static void BenchWriters( const std::vector<Image>& images, const std::vector<CodecType>& codecs, int runs, const char* path, const bc7enc_compress_block_params* params )
+{
+    static const char* names[] = { "mmap", "pwrite", "direct" };
+    printf( "Writing %s, %i runs, %i cores\n", path, runs, System::CPUCores() );
+    for( auto& img : images )
+    {
+        for( auto codec : codecs )
+        {
+            double base = 0;
+            for( int w=BlockData::Mmap; w<=BlockData::Direct; w++ )
+            {
+                std::vector<uint64_t> times( runs );
+                for( int i=0; i<runs; i++ )
+                {
+                    const auto start = GetTime();
+                    {
+                        BlockData bd( path, img.size, false, codec, BlockData::Pvr, 0, Supercompression::None, Texture2D, 1, BlockData::Writer( w ) );
+                        Compress( bd, img, codec, true, params );
+                        bd.Finish();
+                    }
+                    const int fd = open( path, O_RDONLY );
+                    fsync( fd );
+                    close( fd );
+                    times[i] = GetTime() - start;
+                }
+                std::sort( times.begin(), times.end() );
+                const double median = times[runs/2] / 1000.;
+                if( w == BlockData::Mmap ) base = median;
+                printf( "%-16s %-14s %-7s median %9.3f ms  %+6.1f%%\n", img.name.c_str(), CodecName( codec ), names[w], median, ( median / base - 1 ) * 100 );
+            }
+        }
+    }
+    unlink( path );
+}
+#endif
+
+static void WriteCsv( const char* fn, const std::vector<Result>& results )
+{
+    FILE* f = fopen( fn, "w" );
+    if( !f )
+    {
+        fprintf( stderr, "Cannot write %s\n", fn );
+        return;
+    }
+    fprintf( f, "image,width,height,codec,threads,min_ms,median_ms,p95_ms,mpx_s,rmse,psnr\n" );
+    for( auto& r : results )
+    {
+        fprintf( f, "%s,%i,%i,%s,%i,%.4f,%.4f,%.4f,%.3f,%.6f,%.6f\n", r.image.c_str(), r.size.x, r.size.y, CodecName( r.codec ), r.threads, r.min, r.median, r.p95, r.mpxs, r.rmse, r.psnr );
+    }
+    fclose( f );
+}
+
+// A lossless result has infinite PSNR, which json cannot represent
+static void WriteJsonNumber( FILE* f, double v )
+{
+    if( isfinite( v ) )
+    {
+        fprintf( f, "%.6f", v );
+    }
+    else
+    {
+        fprintf( f, "null" );
+    }
+}
+
+static void WriteJson( const char* fn, const std::vector<Result>& results, int runs, int cpus )
+{
+    FILE* f = fopen( fn, "w" );
+    if( !f )
+    {
+        fprintf( stderr, "Cannot write %s\n", fn );
+        return;
+    }
+    fprintf( f, "{\n  \"runs\": %i,\n  \"cpus\": %i,\n  \"results\": [\n", runs, cpus );
+    for( size_t i=0; i<results.size(); i++ )
+    {
+        auto& r = results[i];
+        fprintf( f, "    { \"image\": \"%s\", \"width\": %i, \"height\": %i, \"codec\": \"%s\", \"threads\": %i, ", r.image.c_str(), r.size.x, r.size.y, CodecName( r.codec ), r.threads );
+        fprintf( f, "\"min_ms\": %.4f, \"median_ms\": %.4f, \"p95_ms\": %.4f, \"mpx_s\": %.3f, \"rmse\": ", r.min, r.median, r.p95, r.mpxs );
+        WriteJsonNumber( f, r.rmse );
+        fprintf( f, ", \"psnr\": " );
+        WriteJsonNumber( f, r.psnr );
+        fprintf( f, " }%s\n", i + 1 < results.size() ? "," : "" );
+    }
+    fprintf( f, "  ]\n}\n" );
+    fclose( f );
+}
+
+// Compares with a file written by --csv. Entries are matched by image, codec and thread count, and
+// count as regressions if they are slower by more than threshold percent, or lose quality.
+static int Compare( const char* fn, const std::vector<Result>& results, double threshold )
+{
+    FILE* f = fopen( fn, "r" );
+    if( !f )
+    {
+        fprintf( stderr, "Cannot open baseline %s\n", fn );
+        return -1;
+    }
+
+    printf( "\nBaseline %s (threshold %.1f%%)\n", fn, threshold );
+    int regressions = 0;
+    int matched = 0;
+    char line[1024];
+    fgets( line, sizeof( line ), f );
+    while( fgets( line, sizeof( line ), f ) )
+    {
+        char image[512], codec[32];
+        int w, h, threads;
+        double tmin, median, p95, mpxs, rmse, psnr;
+        if( sscanf( line, "%511[^,],%i,%i,%31[^,],%i,%lf,%lf,%lf,%lf,%lf,%lf", image, &w, &h, codec, &threads, &tmin, &median, &p95, &mpxs, &rmse, &psnr ) != 11 ) continue;
+
+        auto it = std::find_if( results.begin(), results.end(), [&]( const Result& r ) { return r.image == image && strcmp( CodecName( r.codec ), codec ) == 0 && r.threads == threads; } );
+        if( it == results.end() ) continue;
+        matched++;
+
+        const auto change = ( it->mpxs / mpxs - 1 ) * 100;
+        const bool slower = change < -threshold;
+        const bool worse = it->psnr < psnr - 0.01;
+        if( slower || worse )
+        {
+            printf( "  %-16s %-14s %2i threads: %8.2f -> %8.2f Mpx/s (%+.1f%%), PSNR %.3f -> %.3f%s%s\n", image, codec, threads, mpxs, it->mpxs, change, psnr, it->psnr, slower ? "  SLOWER" : "", worse ? "  WORSE" : "" );
+            regressions++;
+        }
+    }
+    fclose( f );
+
+    printf( "  %i of %i entries matched, %i regressions\n", matched, (int)results.size(), regressions );
+    return regressions;
+}
+
+constexpr int KernelBlocks = 16;    // 1 KB of pixels per set, well within L1
+
+// Representative blocks, pixels in row order
+struct BlockSet
+{
+    const char* name;
+    uint32_t px[KernelBlocks][16];
+};
+
+static uint32_t Mix( uint32_t c0, uint32_t c1, int t, int range )
+{
+    uint32_t ret = 0;
+    for( int i=0; i<32; i+=8 )
+    {
+        const int a = ( c0 >> i ) & 0xFF;
+        const int b = ( c1 >> i ) & 0xFF;
+        ret |= uint32_t( a + ( b - a ) * t / range ) << i;
+    }
+    return ret;
+}
+
+static std::vector<BlockSet> MakeBlockSets()
+{
+    std::vector<BlockSet> sets( 4 );
+    sets[0].name = "solid";
+    sets[1].name = "gradient";
+    sets[2].name = "contrast";
+    sets[3].name = "alpha";
+    for( uint32_t b=0; b<KernelBlocks; b++ )
+    {
+        const auto c0 = Hash( b * 2 + 1 );
+        const auto c1 = Hash( b * 2 + 2 );
+        const auto bits = Hash( b + 1000 );
+        const int dx = b % 3 != 1;
+        const int dy = b % 3 != 0;
+        for( int i=0; i<16; i++ )
+        {
+            const int x = i % 4;
+            const int y = i / 4;
+            const int t = x * dx + y * dy;
+            const int range = 3 * ( dx + dy );
+            sets[0].px[b][i] = c0 | 0xFF000000;
+            sets[1].px[b][i] = Mix( c0, c1, t, range ) | 0xFF000000;
+            sets[2].px[b][i] = ( ( bits >> i ) & 1 ? c0 : c1 ) | 0xFF000000;
+            sets[3].px[b][i] = Mix( c0, c1, t, range );
+        }
+    }
+    return sets;
+}
+
+static bc7enc_compress_block_params s_bc7params;
+
+static void PrepareRows( const uint32_t* px, uint32_t* in ) { memcpy( in, px, 16 * sizeof( uint32_t ) ); }
+static void PrepareColumns( const uint32_t* px, uint32_t* in ) { for( int i=0; i<16; i++ ) in[i % 4 * 4 + i / 4] = px[i]; }
+static void PrepareAlpha( const uint32_t* px, uint32_t* in ) { for( int i=0; i<16; i++ ) ( (uint8_t*)in )[i % 4 * 4 + i / 4] = px[i] >> 24; }
+
+static void RunEtc1( const uint32_t* in, uint64_t* out ) { *out = CompressEtc1RgbBlock( in ); }
+static void RunEtc2( const uint32_t* in, uint64_t* out ) { *out = CompressEtc2RgbBlock( in, true ); }
+static void RunEtc2Exhaustive( const uint32_t* in, uint64_t* out ) { *out = CompressEtc2RgbBlock( in, false ); }
+static void RunEtc2Alpha( const uint32_t* in, uint64_t* out ) { *out = CompressEtc2AlphaBlock( (const uint8_t*)in ); }
+static void RunBc1( const uint32_t* in, uint64_t* out ) { *out = CompressBc1Block( in ); }
+static void RunBc7( const uint32_t* in, uint64_t* out ) { bc7enc_compress_block( out, in, &s_bc7params ); }
+
+static const char* EtcMode( const uint64_t* block )
+{
+    return EtcModeNames[EtcBlockMode( *block )];
+}
+
+static const char* AlphaMode( const uint64_t* block )
+{
+    static const char* const tables[16] = { "table 0", "table 1", "table 2", "table 3", "table 4", "table 5", "table 6", "table 7", "table 8", "table 9", "table 10", "table 11", "table 12", "table 13", "table 14", "table 15" };
+    if( ( *block >> 12 ) & 0xF ) return tables[( *block >> 8 ) & 0xF];
+    return "solid";
+}
+
+static const char* Bc1Mode( const uint64_t* block )
+{
+    return ( *block & 0xFFFF ) > ( ( *block >> 16 ) & 0xFFFF ) ? "4 color" : "3 color";
+}
+
+static const char* Bc7Mode( const uint64_t* block )
+{
+    static const char* const modes[9] = { "mode 0", "mode 1", "mode 2", "mode 3", "mode 4", "mode 5", "mode 6", "mode 7", "reserved" };
+    const auto b = uint8_t( *block );
+    int mode = 0;
+    while( mode < 8 && !( b & ( 1 << mode ) ) ) mode++;
+    return modes[mode];
+}
+
+struct Kernel
+{
+    const char* name;
+    void(*prepare)( const uint32_t* px, uint32_t* in );
+    void(*run)( const uint32_t* in, uint64_t* out );
+    const char*(*mode)( const uint64_t* block );
+};
+
+static const Kernel Kernels[] = {
+    { "etc1", PrepareColumns, RunEtc1, EtcMode },
+    { "etc2_rgb", PrepareColumns, RunEtc2, EtcMode },
+    { "etc2_rgb exhaustive", PrepareColumns, RunEtc2Exhaustive, EtcMode },
+    { "etc2 alpha", PrepareAlpha, RunEtc2Alpha, AlphaMode },
+    { "bc1", PrepareRows, RunBc1, Bc1Mode },
+    { "bc7", PrepareRows, RunBc7, Bc7Mode }
+};
+
+#if defined __x86_64__ || defined _M_X64 || defined __i386__ || defined _M_IX86
+static uint64_t Ticks() { return __rdtsc(); }
+#else
+static uint64_t Ticks() { return 0; }
+#endif
+
+// Each kernel runs over a set of blocks often enough to take about 20 ms, so the time is spent in the
+// kernel on data already in cache
+static void BenchKernels()
+{
+    const auto sets = MakeBlockSets();
+    printf( "%-20s %-9s %10s %14s  modes\n", "kernel", "blocks", "ns/block", "cycles/block" );
+    for( auto& kernel : Kernels )
+    {
+        for( auto& set : sets )
+        {
+            uint32_t in[KernelBlocks][16];
+            uint64_t out[KernelBlocks][2];
+            for( int i=0; i<KernelBlocks; i++ ) kernel.prepare( set.px[i], in[i] );
+
+            int passes = 1;
+            uint64_t time, ticks;
+            for(;;)
+            {
+                const auto start = GetTime();
+                const auto startTicks = Ticks();
+                for( int p=0; p<passes; p++ )
+                {
+                    for( int i=0; i<KernelBlocks; i++ ) kernel.run( in[i], out[i] );
+                }
+                ticks = Ticks() - startTicks;
+                time = GetTime() - start;
+                if( time >= 20000 || passes >= ( 1 << 24 ) ) break;
+                passes *= 2;
+            }
+
+            std::vector<std::pair<const char*, int>> modes;
+            for( int i=0; i<KernelBlocks; i++ )
+            {
+                const auto mode = kernel.mode( out[i] );
+                auto it = std::find_if( modes.begin(), modes.end(), [mode]( const auto& v ) { return v.first == mode; } );
+                if( it == modes.end() ) modes.emplace_back( mode, 1 );
+                else it->second++;
+            }
+
+            const double blocks = double( passes ) * KernelBlocks;
+            printf( "%-20s %-9s %10.1f ", kernel.name, set.name, time * 1000. / blocks );
+            if( ticks != 0 ) printf( "%14.0f  ", ticks / blocks );
+            else printf( "%14s  ", "-" );
+            for( size_t i=0; i<modes.size(); i++ ) printf( "%s%s %i", i == 0 ? "" : ", ", modes[i].first, modes[i].second );
+            printf( "\n" );
+        }
+    }
+}
+
+void Usage()
+{
+    fprintf( stderr, "Usage: etcpak-bench [options] [image.png...]\n" );
+    fprintf( stderr, "  Compresses a synthetic corpus, the example images and any given images with every codec,\n" );
+    fprintf( stderr, "  single threaded and on all cores.\n" );
+    fprintf( stderr, "  Options:\n" );
+    fprintf( stderr, "  -r runs                timed runs of each codec and image (defaults to 9)\n" );
+    fprintf( stderr, "  -c codec               only benchmark the given codec, may be repeated\n" );
+    fprintf( stderr, "  --examples dir         directory with example images (defaults to %s)\n", ETCPAK_EXAMPLES );
+    fprintf( stderr, "  --no-synthetic         skip the synthetic images\n" );
+    fprintf( stderr, "  --json file            write results as json\n" );
+    fprintf( stderr, "  --csv file             write results as csv\n" );
+    fprintf( stderr, "  --baseline file.csv    compare with results saved by --csv, exits with 1 on regressions\n" );
+    fprintf( stderr, "  --threshold percent    allowed slowdown against the baseline (defaults to 5)\n" );
+    fprintf( stderr, "  --kernels              only time the single block kernels on small sets of blocks in cache\n" );
+#ifndef _WIN32
+    fprintf( stderr, "  --writers file         only time the output writers (mmap, pwrite, direct), compressing to file\n" );
+#endif
+}
+
+int main( int argc, char** argv )
+{
+    int runs = 9;
+    const char* examples = ETCPAK_EXAMPLES;
+    bool synthetic = true;
+    const char* json = nullptr;
+    const char* csv = nullptr;
+    const char* baseline = nullptr;
+    double threshold = 5;
+    bool kernels = false;
+    const char* writers = nullptr;
+    std::vector<CodecType> codecs;
+    const int cpus = System::CPUCores();
+
+    enum Options
+    {
+        OptExamples,
+        OptNoSynthetic,
+        OptJson,
+        OptCsv,
+        OptBaseline,
+        OptThreshold,
+        OptKernels,
+        OptWriters,
+        OptHelp
+    };
+
+    struct option longopts[] = {
+        { "examples", required_argument, nullptr, OptExamples },
+        { "no-synthetic", no_argument, nullptr, OptNoSynthetic },
+        { "json", required_argument, nullptr, OptJson },
+        { "csv", required_argument, nullptr, OptCsv },
+        { "baseline", required_argument, nullptr, OptBaseline },
+        { "threshold", required_argument, nullptr, OptThreshold },
+        { "kernels", no_argument, nullptr, OptKernels },
+#ifndef _WIN32
+        { "writers", required_argument, nullptr, OptWriters },
+#endif
+        { "help", no_argument, nullptr, OptHelp },
+        {}
+    };
+
+    int c;
+    while( ( c = getopt_long( argc, argv, "r:c:", longopts, nullptr ) ) != -1 )
+    {
+        switch( c )
+        {
+        case 'r':
+            runs = std::max( 1, atoi( optarg ) );
+            break;
+        case 'c':
+        {
+            int i = Etc1;
+            while( i <= Bc7 && strcmp( optarg, CodecName( CodecType( i ) ) ) != 0 ) i++;
+            if( i > Bc7 )
+            {
+                fprintf( stderr, "Unknown codec: %s\n", optarg );
+                return 1;
+            }
+            codecs.emplace_back( CodecType( i ) );
+            break;
+        }
+        case OptExamples:
+            examples = optarg;
+            break;
+        case OptNoSynthetic:
+            synthetic = false;
+            break;
+        case OptJson:
+            json = optarg;
+            break;
+        case OptCsv:
+            csv = optarg;
+            break;
+        case OptBaseline:
+            baseline = optarg;
+            break;
+        case OptThreshold:
+            threshold = atof( optarg );
+            break;
+        case OptKernels:
+            kernels = true;
+            break;
+        case OptWriters:
+            writers = optarg;
+            break;
+        default:
+            Usage();
+            return 1;
+        }
+    }
+    if( codecs.empty() )
+    {
+        for( int i=Etc1; i<=Bc7; i++ ) codecs.emplace_back( CodecType( i ) );
+    }
+
+    bc7enc_compress_block_params bc7params;
+    bc7enc_compress_block_init();
+    bc7enc_compress_block_params_init( &bc7params );
+    if( kernels )
+    {
+        s_bc7params = bc7params;
+        BenchKernels();
+        return 0;
+    }
+
+    std::vector<Image> images;
+    if( synthetic )
+    {
+        images.emplace_back( Synthetic( "gradient", v2i( 1024, 1024 ), Gradient ) );
+        images.emplace_back( Synthetic( "noise", v2i( 1024, 1024 ), Noise ) );
+        images.emplace_back( Synthetic( "edges", v2i( 1024, 1024 ), Edges ) );
+        images.emplace_back( Synthetic( "grain", v2i( 1001, 603 ), Grain ) );
+    }
+    std::error_code ec;
+    std::vector<std::filesystem::path> files;
+    for( auto& entry : std::filesystem::directory_iterator( examples, ec ) )
+    {
+        if( entry.path().extension() == ".png" ) files.emplace_back( entry.path() );
+    }
+    if( ec ) fprintf( stderr, "No example images in %s\n", examples );
+    std::sort( files.begin(), files.end() );
+    for( int i=optind; i<argc; i++ ) files.emplace_back( argv[i] );
+    for( auto& file : files ) images.emplace_back( Load( file ) );
+
+    TaskDispatch taskDispatch( cpus );
+
+#ifndef _WIN32
+    if( writers )
+    {
+        BenchWriters( images, codecs, runs, writers, &bc7params );
+        return 0;
+    }
+#endif
+
+    if( !CheckDecoders( codecs, &bc7params ) ) return 1;
+
+    printf( "%i runs, %i cores\n", runs, cpus );
+    std::vector<Result> results;
+    for( auto& img : images )
+    {
+        for( auto codec : codecs )
+        {
+            Result result { img.name, img.size, codec, 1, 0, 0, 0, 0, 0, 0 };
+            Quality( img, codec, &bc7params, result );
+            for( int threads : { 1, cpus } )
+            {
+                result.threads = threads;
+                Time( img, codec, threads > 1, runs, &bc7params, result );
+                printf( "%-16s %-14s %2i threads  min %9.3f  median %9.3f  p95 %9.3f ms  %9.2f Mpx/s  RMSE %7.3f  PSNR %7.3f\n", img.name.c_str(), CodecName( codec ), threads, result.min, result.median, result.p95, result.mpxs, result.rmse, result.psnr );
+                results.emplace_back( result );
+                if( cpus == 1 ) break;
+            }
+        }
+    }
+
+    if( json ) WriteJson( json, results, runs, cpus );
+    if( csv ) WriteCsv( csv, results );
+    if( baseline )
+    {
+        const auto regressions = Compare( baseline, results, threshold );
+        if( regressions != 0 ) return 1;
+    }
+    return 0;
+}
@@ -7,11 +7,31 @@
 
 #include "Bitmap.hpp"
 #include "Debug.hpp"
+#include "Memory.hpp"
+#include "Trace.hpp"
 
-Bitmap::Bitmap( const char* fn, unsigned int lines, bool bgr )
+#ifdef TRACY_ENABLE
+#  include <atomic>
+
+// Rows of all images and levels, plotted against the rows compressed in BlockData
+static std::atomic<int64_t> s_linesDecoded( 0 );
+#endif
+
+// libpng widens 8-bit values as v*257, which puts 128 above the signed zero at 0x8000
+static void WidenSnorm( uint16_t* ptr, int num )
+{
+    for( int i=0; i<num; i++ )
+    {
+        const int v = ptr[i] >> 8;
+        ptr[i] = v < 128 ? v << 8 : 0x8000 + ( ( v - 128 ) * 0x7FFF + 63 ) / 127;
+    }
+}
+
+Bitmap::Bitmap( const char* fn, unsigned int lines, bool bgr, bool wide, bool snorm )
     : m_block( nullptr )
     , m_lines( lines )
     , m_alpha( true )
+    , m_wide( wide )
     , m_sema( 0 )
 {
     FILE* f = fopen( fn, "rb" );
@@ -33,8 +53,19 @@ Bitmap::Bitmap( const char* fn, unsigned int lines, bool bgr )
     png_get_IHDR( png_ptr, info_ptr, &w, &h, &bit_depth, &color_type, &interlace_type, NULL, NULL );
 
     m_size = v2i( w, h );
+    const bool widenSnorm = wide && snorm && bit_depth < 16;
 
-    png_set_strip_16( png_ptr );
+    if( wide )
+    {
+        png_set_expand_16( png_ptr );
+#if defined _WIN32 || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        png_set_swap( png_ptr );
+#endif
+    }
+    else
+    {
+        png_set_strip_16( png_ptr );
+    }
     if( color_type == PNG_COLOR_TYPE_PALETTE )
     {
         png_set_palette_to_rgb( png_ptr );
@@ -61,7 +92,7 @@ Bitmap::Bitmap( const char* fn, unsigned int lines, bool bgr )
     case PNG_COLOR_TYPE_PALETTE:
         if( !png_get_valid( png_ptr, info_ptr, PNG_INFO_tRNS ) )
         {
-            png_set_filler( png_ptr, 0xff, PNG_FILLER_AFTER );
+            png_set_filler( png_ptr, wide ? 0xffff : 0xff, PNG_FILLER_AFTER );
             m_alpha = false;
         }
         break;
@@ -69,7 +100,7 @@ Bitmap::Bitmap( const char* fn, unsigned int lines, bool bgr )
         png_set_gray_to_rgb( png_ptr );
         break;
     case PNG_COLOR_TYPE_RGB:
-        png_set_filler( png_ptr, 0xff, PNG_FILLER_AFTER );
+        png_set_filler( png_ptr, wide ? 0xffff : 0xff, PNG_FILLER_AFTER );
         m_alpha = false;
         break;
     default:
@@ -78,35 +109,27 @@ Bitmap::Bitmap( const char* fn, unsigned int lines, bool bgr )
 
     DBGPRINT( "Bitmap " << fn << "  " << w << "x" << h );
 
-    assert( w % 4 == 0 );
-    assert( h % 4 == 0 );
-
-    m_block = m_data = new uint32_t[w*h];
-    m_linesLeft = h / 4;
+    // one thread loads, all workers read
+    m_block = m_data = (uint32_t*)LargeAlloc( DataSize(), true );
+    m_linesLeft = PaddedHeight() / 4;
 
-    m_load = std::async( std::launch::async, [this, f, png_ptr, info_ptr]() mutable
+    m_load = std::async( std::launch::async, [this, f, png_ptr, info_ptr, widenSnorm]() mutable
     {
+        ZoneScopedN( "Load PNG" );
+        TraceThreadName( "PNG loader" );
+        TraceScope trace( "Load PNG" );
+        LoadStarted();
         auto ptr = m_data;
+        const auto stride = Stride() * ( m_wide ? 2 : 1 );
         unsigned int lines = 0;
-        for( int i=0; i<m_size.y / 4; i++ )
-        {
-            for( int j=0; j<4; j++ )
-            {
-                png_read_rows( png_ptr, (png_bytepp)&ptr, NULL, 1 );
-                ptr += m_size.x;
-            }
-            lines++;
-            if( lines >= m_lines )
-            {
-                lines = 0;
-                m_sema.unlock();
-            }
-        }
-
-        if( lines != 0 )
+        for( int i=0; i<m_size.y; i++ )
         {
-            m_sema.unlock();
+            png_read_rows( png_ptr, (png_bytepp)&ptr, NULL, 1 );
+            if( widenSnorm ) WidenSnorm( (uint16_t*)ptr, m_size.x * 4 );
+            RowLoaded( ptr, i, lines );
+            ptr += stride;
         }
+        LoadFinished( lines );
 
         png_read_end( png_ptr, info_ptr );
         png_destroy_read_struct( &png_ptr, &info_ptr, NULL );
@@ -115,11 +138,12 @@ Bitmap::Bitmap( const char* fn, unsigned int lines, bool bgr )
 }
 
 Bitmap::Bitmap( const v2i& size )
-    : m_data( new uint32_t[size.x*size.y] )
+    : m_data( (uint32_t*)LargeAlloc( size_t( ( size.x + 3 ) & ~3 ) * ( ( size.y + 3 ) & ~3 ) * 4 ) )
     , m_block( nullptr )
     , m_lines( 1 )
-    , m_linesLeft( size.y / 4 )
+    , m_linesLeft( ( size.y + 3 ) / 4 )
     , m_size( size )
+    , m_wide( false )
     , m_sema( 0 )
 {
 }
@@ -127,17 +151,22 @@ Bitmap::Bitmap( const v2i& size )
 Bitmap::Bitmap( const Bitmap& src, unsigned int lines )
     : m_lines( lines )
     , m_alpha( src.Alpha() )
+    , m_wide( src.Wide() )
     , m_sema( 0 )
 {
 }
 
 Bitmap::~Bitmap()
 {
-    delete[] m_data;
+    // the image may still be loading
+    if( m_load.valid() ) m_load.wait();
+    LargeFree( m_data, DataSize() );
 }
 
 void Bitmap::Write( const char* fn )
 {
+    assert( !m_wide );
+
     FILE* f = fopen( fn, "wb" );
     assert( f );
 
@@ -154,7 +183,7 @@ void Bitmap::Write( const char* fn )
     for( int i=0; i<m_size.y; i++ )
     {
         png_write_rows( png_ptr, (png_bytepp)(&ptr), 1 );
-        ptr += m_size.x;
+        ptr += Stride();
     }
 
     png_write_end( png_ptr, info_ptr );
@@ -165,12 +194,63 @@ void Bitmap::Write( const char* fn )
 
 const uint32_t* Bitmap::NextBlock( unsigned int& lines, bool& done )
 {
-    std::lock_guard<std::mutex> lock( m_lock );
+    std::lock_guard<LockableBase( std::mutex )> lock( m_lock );
     lines = std::min( m_lines, m_linesLeft );
     auto ret = m_block;
-    m_sema.lock();
-    m_block += m_size.x * 4 * lines;
+    {
+        ZoneScopedN( "Wait for rows" );
+        m_sema.lock();
+    }
+    m_block += Stride() * 4 * lines * ( m_wide ? 2 : 1 );
     m_linesLeft -= lines;
     done = m_linesLeft == 0;
     return ret;
 }
+
+void Bitmap::LoadStarted()
+{
+    if( TraceEnabled() ) m_batchStart = TraceTime();
+}
+
+void Bitmap::RowLoaded( uint32_t* row, int y, unsigned int& lines )
+{
+    const int scale = m_wide ? 2 : 1;
+    const auto last = row + ( m_size.x - 1 ) * scale;
+    for( int x=m_size.x; x<Stride(); x++ )
+    {
+        memcpy( row + x * scale, last, scale * sizeof( uint32_t ) );
+    }
+#ifdef TRACY_ENABLE
+    TracyPlot( "Lines decoded", ++s_linesDecoded );
+#endif
+
+    if( ( y & 3 ) == 3 && ++lines >= m_lines )
+    {
+        lines = 0;
+        if( TraceEnabled() )
+        {
+            const auto now = TraceTime();
+            TraceEvent( "Rows", m_batchStart, now, y / 4 );
+            m_batchStart = now;
+        }
+        m_sema.unlock();
+    }
+}
+
+void Bitmap::LoadFinished( unsigned int lines )
+{
+    // the last row fills the incomplete block row
+    const size_t stride = Stride() * ( m_wide ? 2 : 1 );
+    const auto last = m_data + ( m_size.y - 1 ) * stride;
+    for( int y=m_size.y; y<PaddedHeight(); y++ )
+    {
+        memcpy( m_data + y * stride, last, stride * sizeof( uint32_t ) );
+    }
+    if( m_size.y % 4 != 0 ) lines++;
+
+    if( lines != 0 )
+    {
+        if( TraceEnabled() ) TraceEvent( "Rows", m_batchStart, TraceTime(), PaddedHeight() / 4 - 1 );
+        m_sema.unlock();
+    }
+}
@@ -6,13 +6,18 @@
 #include <mutex>
 #include <stdint.h>
 
+#include <tracy/Tracy.hpp>
+
 #include "Semaphore.hpp"
 #include "Vector.hpp"
 
 class Bitmap
 {
 public:
-    Bitmap( const char* fn, unsigned int lines, bool bgr );
+    // A wide bitmap keeps 16 bits per channel, one uint64_t per pixel. Data() then points at
+    // twice as many uint32_t words as there are pixels. 8-bit images are widened as v*257, or with
+    // snorm so that 128 becomes 0x8000 (zero of the signed codecs) and 255 stays 0xFFFF.
+    Bitmap( const char* fn, unsigned int lines, bool bgr, bool wide = false, bool snorm = false );
     Bitmap( const v2i& size );
     virtual ~Bitmap();
 
@@ -21,22 +26,34 @@ public:
     uint32_t* Data() { if( m_load.valid() ) m_load.wait(); return m_data; }
     const uint32_t* Data() const { if( m_load.valid() ) m_load.wait(); return m_data; }
     const v2i& Size() const { return m_size; }
+    // Pixels are stored in whole 4x4 blocks, with the edge pixels replicated into the padding
+    int Stride() const { return ( m_size.x + 3 ) & ~3; }
+    int PaddedHeight() const { return ( m_size.y + 3 ) & ~3; }
     bool Alpha() const { return m_alpha; }
+    bool Wide() const { return m_wide; }
 
     const uint32_t* NextBlock( unsigned int& lines, bool& done );
 
 protected:
     Bitmap( const Bitmap& src, unsigned int lines );
 
+    // Loaders call these to pad the rows they produce and to hand out finished blocks to NextBlock()
+    void LoadStarted();
+    void RowLoaded( uint32_t* row, int y, unsigned int& lines );
+    void LoadFinished( unsigned int lines );
+    size_t DataSize() const { return size_t( Stride() ) * PaddedHeight() * ( m_wide ? 8 : 4 ); }
+
     uint32_t* m_data;
     uint32_t* m_block;
     unsigned int m_lines;
     unsigned int m_linesLeft;
     v2i m_size;
     bool m_alpha;
+    bool m_wide;
     Semaphore m_sema;
-    std::mutex m_lock;
+    TracyLockable( std::mutex, m_lock );
     std::future<void> m_load;
+    uint64_t m_batchStart;      // of the rows not yet handed out, for the trace
 };
 
 typedef std::shared_ptr<Bitmap> BitmapPtr;
@@ -1,8 +1,12 @@
 #include <string.h>
 #include <utility>
 
+#include <tracy/Tracy.hpp>
+
 #include "BitmapDownsampled.hpp"
 #include "Debug.hpp"
+#include "Memory.hpp"
+#include "Trace.hpp"
 
 #if defined __SSE4_1__ || defined __AVX2__ || defined _MSC_VER
 #  ifdef _MSC_VER
@@ -54,309 +58,292 @@ BitmapDownsampled::BitmapDownsampled( const Bitmap& bmp, unsigned int lines, boo
     m_size.x = std::max( 1, bmp.Size().x / 2 );
     m_size.y = std::max( 1, bmp.Size().y / 2 );
 
-    int w = std::max( m_size.x, 4 );
-    int h = std::max( m_size.y, 4 );
-
     DBGPRINT( "Subbitmap " << m_size.x << "x" << m_size.y );
 
-    m_block = m_data = new uint32_t[w*h];
+    m_block = m_data = (uint32_t*)LargeAlloc( DataSize(), true );
+    m_linesLeft = PaddedHeight() / 4;
 
-    if( m_size.x < w || m_size.y < h )
+    if( m_wide )
     {
-        memset( m_data, 0, w*h*sizeof( uint32_t ) );
-        m_linesLeft = h / 4;
-        unsigned int lines = 0;
-        for( int i=0; i<h/4; i++ )
+        m_load = std::async( std::launch::async, [this, &bmp]() mutable
         {
-            for( int j=0; j<4; j++ )
+            ZoneScopedN( "Downsample" );
+            ZoneValue( m_size.x );
+            TraceThreadName( "Downsampler" );
+            TraceScope trace( "Downsample", m_size.x );
+            LoadStarted();
+            unsigned int lines = 0;
+            for( int i=0; i<m_size.y; i++ )
             {
-                lines++;
-                if( lines > m_lines )
+                auto ptr = (uint16_t*)( m_data + i * Stride() * 2 );
+                auto src1 = (const uint16_t*)( bmp.Data() + i * bmp.Stride() * 4 );
+                auto src2 = src1 + bmp.Stride() * 4;
+                for( int k=0; k<m_size.x; k++ )
                 {
-                    lines = 0;
-                    m_sema.unlock();
+                    for( int c=0; c<4; c++ )
+                    {
+                        *ptr++ = uint16_t( ( src1[c] + src1[c+4] + src2[c] + src2[c+4] + 2 ) / 4 );
+                    }
+                    src1 += 8;
+                    src2 += 8;
                 }
+                RowLoaded( m_data + i * Stride() * 2, i, lines );
             }
-        }
-        if( lines != 0 )
-        {
-            m_sema.unlock();
-        }
+            LoadFinished( lines );
+        } );
     }
-    else
+    else if( linearize )
     {
-        m_linesLeft = h / 4;
-        if( linearize )
+        m_load = std::async( std::launch::async, [this, &bmp]() mutable
         {
-            m_load = std::async( std::launch::async, [this, &bmp, w, h]() mutable
+            ZoneScopedN( "Downsample" );
+            ZoneValue( m_size.x );
+            TraceThreadName( "Downsampler" );
+            TraceScope trace( "Downsample", m_size.x );
+            LoadStarted();
+            unsigned int lines = 0;
+            for( int i=0; i<m_size.y; i++ )
             {
-                auto ptr = m_data;
-                auto src1 = bmp.Data();
-                auto src2 = src1 + bmp.Size().x;
-                unsigned int lines = 0;
-                for( int i=0; i<h/4; i++ )
-                {
-                    for( int j=0; j<4; j++ )
-                    {
-                        int k = m_size.x;
+                auto ptr = m_data + i * Stride();
+                auto src1 = bmp.Data() + i * bmp.Stride() * 2;
+                auto src2 = src1 + bmp.Stride();
+                int k = m_size.x;
 #ifdef __AVX2__
-                        while( k > 2 )
-                        {
-                            k -= 2;
-
-                            __m128i p0 = _mm_loadu_si128( (__m128i*)src1 );
-                            __m128i p1 = _mm_loadu_si128( (__m128i*)src2 );
-                            src1 += 4;
-                            src2 += 4;
-
-                            __m256i pxa = _mm256_cvtepu8_epi16( p0 );
-                            __m256i pxb = _mm256_cvtepu8_epi16( p1 );
-                            __m256i px0 = _mm256_unpacklo_epi16( pxa, _mm256_setzero_si256() );
-                            __m256i px1 = _mm256_unpackhi_epi16( pxa, _mm256_setzero_si256() );
-                            __m256i px2 = _mm256_unpacklo_epi16( pxb, _mm256_setzero_si256() );
-                            __m256i px3 = _mm256_unpackhi_epi16( pxb, _mm256_setzero_si256() );
-
-                            __m256 f0 = _mm256_cvtepi32_ps( px0 );
-                            __m256 f1 = _mm256_cvtepi32_ps( px1 );
-                            __m256 f2 = _mm256_cvtepi32_ps( px2 );
-                            __m256 f3 = _mm256_cvtepi32_ps( px3 );
-
-                            __m256 m0 = _mm256_mul_ps( f0, _mm256_set1_ps( 0.003921568f ) );
-                            __m256 m1 = _mm256_mul_ps( f1, _mm256_set1_ps( 0.003921568f ) );
-                            __m256 m2 = _mm256_mul_ps( f2, _mm256_set1_ps( 0.003921568f ) );
-                            __m256 m3 = _mm256_mul_ps( f3, _mm256_set1_ps( 0.003921568f ) );
-
-                            __m256 l00 = _mm256_fmadd_ps( m0, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
-                            __m256 l01 = _mm256_fmadd_ps( m1, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
-                            __m256 l02 = _mm256_fmadd_ps( m2, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
-                            __m256 l03 = _mm256_fmadd_ps( m3, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
-
-                            __m256 l10 = _mm256_fmadd_ps( m0, l00, _mm256_set1_ps( 0.012522878f ) );
-                            __m256 l11 = _mm256_fmadd_ps( m1, l01, _mm256_set1_ps( 0.012522878f ) );
-                            __m256 l12 = _mm256_fmadd_ps( m2, l02, _mm256_set1_ps( 0.012522878f ) );
-                            __m256 l13 = _mm256_fmadd_ps( m3, l03, _mm256_set1_ps( 0.012522878f ) );
-
-                            __m256 l20 = _mm256_mul_ps( m0, l10 );
-                            __m256 l21 = _mm256_mul_ps( m1, l11 );
-                            __m256 l22 = _mm256_mul_ps( m2, l12 );
-                            __m256 l23 = _mm256_mul_ps( m3, l13 );
-
-                            __m256 s0 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l20 ), _mm256_castps_si256( m0 ), 0x88 ) );
-                            __m256 s1 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l21 ), _mm256_castps_si256( m1 ), 0x88 ) );
-                            __m256 s2 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l22 ), _mm256_castps_si256( m2 ), 0x88 ) );
-                            __m256 s3 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l23 ), _mm256_castps_si256( m3 ), 0x88 ) );
-
-                            __m256 a0 = _mm256_add_ps( s0, s1 );
-                            __m256 a1 = _mm256_add_ps( s2, s3 );
-                            __m256 a2 = _mm256_add_ps( a0, a1 );
-
-                            __m256 v = _mm256_mul_ps( a2, _mm256_set1_ps( 0.25f ) );
-                            __m256 r0 = _mm256_add_ps( v, _mm256_set1_ps( 0.00279491f ) );
-                            __m256 r1 = _mm256_rsqrt_ps( r0 );
-                            __m256 r2 = _mm256_fmadd_ps( r1, _mm256_set1_ps( 1.15907984f ), _mm256_set1_ps( -0.15746343f ) );
-                            __m256 r3 = _mm256_mul_ps( r2, v );
-
-                            __m256 b0 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( r3 ), _mm256_castps_si256( v ), 0x88 ) );
-                            __m256 b1 = _mm256_mul_ps( b0, _mm256_set1_ps( 255 ) );
-                            __m256i b2 = _mm256_cvtps_epi32( b1 );
-                            __m256i b3 = _mm256_packus_epi32( b2, b2 );
-                            __m256i b4 = _mm256_packus_epi16( b3, b3 );
-
-                            *ptr++ = _mm_cvtsi128_si32( _mm256_castsi256_si128( b4 ) );
-                            *ptr++ = _mm_cvtsi128_si32( _mm256_extracti128_si256( b4, 1 ) );
-                        }
+                while( k > 2 )
+                {
+                    k -= 2;
+
+                    __m128i p0 = _mm_loadu_si128( (__m128i*)src1 );
+                    __m128i p1 = _mm_loadu_si128( (__m128i*)src2 );
+                    src1 += 4;
+                    src2 += 4;
+
+                    __m256i pxa = _mm256_cvtepu8_epi16( p0 );
+                    __m256i pxb = _mm256_cvtepu8_epi16( p1 );
+                    __m256i px0 = _mm256_unpacklo_epi16( pxa, _mm256_setzero_si256() );
+                    __m256i px1 = _mm256_unpackhi_epi16( pxa, _mm256_setzero_si256() );
+                    __m256i px2 = _mm256_unpacklo_epi16( pxb, _mm256_setzero_si256() );
+                    __m256i px3 = _mm256_unpackhi_epi16( pxb, _mm256_setzero_si256() );
+
+                    __m256 f0 = _mm256_cvtepi32_ps( px0 );
+                    __m256 f1 = _mm256_cvtepi32_ps( px1 );
+                    __m256 f2 = _mm256_cvtepi32_ps( px2 );
+                    __m256 f3 = _mm256_cvtepi32_ps( px3 );
+
+                    __m256 m0 = _mm256_mul_ps( f0, _mm256_set1_ps( 0.003921568f ) );
+                    __m256 m1 = _mm256_mul_ps( f1, _mm256_set1_ps( 0.003921568f ) );
+                    __m256 m2 = _mm256_mul_ps( f2, _mm256_set1_ps( 0.003921568f ) );
+                    __m256 m3 = _mm256_mul_ps( f3, _mm256_set1_ps( 0.003921568f ) );
+
+                    __m256 l00 = _mm256_fmadd_ps( m0, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
+                    __m256 l01 = _mm256_fmadd_ps( m1, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
+                    __m256 l02 = _mm256_fmadd_ps( m2, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
+                    __m256 l03 = _mm256_fmadd_ps( m3, _mm256_set1_ps( 0.305306011f ), _mm256_set1_ps( 0.682171111f ) );
+
+                    __m256 l10 = _mm256_fmadd_ps( m0, l00, _mm256_set1_ps( 0.012522878f ) );
+                    __m256 l11 = _mm256_fmadd_ps( m1, l01, _mm256_set1_ps( 0.012522878f ) );
+                    __m256 l12 = _mm256_fmadd_ps( m2, l02, _mm256_set1_ps( 0.012522878f ) );
+                    __m256 l13 = _mm256_fmadd_ps( m3, l03, _mm256_set1_ps( 0.012522878f ) );
+
+                    __m256 l20 = _mm256_mul_ps( m0, l10 );
+                    __m256 l21 = _mm256_mul_ps( m1, l11 );
+                    __m256 l22 = _mm256_mul_ps( m2, l12 );
+                    __m256 l23 = _mm256_mul_ps( m3, l13 );
+
+                    __m256 s0 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l20 ), _mm256_castps_si256( m0 ), 0x88 ) );
+                    __m256 s1 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l21 ), _mm256_castps_si256( m1 ), 0x88 ) );
+                    __m256 s2 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l22 ), _mm256_castps_si256( m2 ), 0x88 ) );
+                    __m256 s3 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( l23 ), _mm256_castps_si256( m3 ), 0x88 ) );
+
+                    __m256 a0 = _mm256_add_ps( s0, s1 );
+                    __m256 a1 = _mm256_add_ps( s2, s3 );
+                    __m256 a2 = _mm256_add_ps( a0, a1 );
+
+                    __m256 v = _mm256_mul_ps( a2, _mm256_set1_ps( 0.25f ) );
+                    __m256 r0 = _mm256_add_ps( v, _mm256_set1_ps( 0.00279491f ) );
+                    __m256 r1 = _mm256_rsqrt_ps( r0 );
+                    __m256 r2 = _mm256_fmadd_ps( r1, _mm256_set1_ps( 1.15907984f ), _mm256_set1_ps( -0.15746343f ) );
+                    __m256 r3 = _mm256_mul_ps( r2, v );
+
+                    __m256 b0 = _mm256_castsi256_ps( _mm256_blend_epi32( _mm256_castps_si256( r3 ), _mm256_castps_si256( v ), 0x88 ) );
+                    __m256 b1 = _mm256_mul_ps( b0, _mm256_set1_ps( 255 ) );
+                    __m256i b2 = _mm256_cvtps_epi32( b1 );
+                    __m256i b3 = _mm256_packus_epi32( b2, b2 );
+                    __m256i b4 = _mm256_packus_epi16( b3, b3 );
+
+                    *ptr++ = _mm_cvtsi128_si32( _mm256_castsi256_si128( b4 ) );
+                    *ptr++ = _mm_cvtsi128_si32( _mm256_extracti128_si256( b4, 1 ) );
+                }
 #endif
-                        while( k-- )
-                        {
+                while( k-- )
+                {
 #ifdef __SSE4_1__
-                            uint32_t px0 = *src1;
-                            uint32_t px1 = *(src1+1);
-                            uint32_t px2 = *src2;
-                            uint32_t px3 = *(src2+1);
-
-                            float p0[4];
-                            float p1[4];
-                            float p2[4];
-                            float p3[4];
-
-                            p0[0] = SrgbToLinear[px0 & 0x000000FF];
-                            p0[1] = SrgbToLinear[( px0 & 0x0000FF00 ) >> 8];
-                            p0[2] = SrgbToLinear[( px0 & 0x00FF0000 ) >> 16];
-                            p0[3] = px0 >> 24;
-
-                            p1[0] = SrgbToLinear[px1 & 0x000000FF];
-                            p1[1] = SrgbToLinear[( px1 & 0x0000FF00 ) >> 8];
-                            p1[2] = SrgbToLinear[( px1 & 0x00FF0000 ) >> 16];
-                            p1[3] = px1 >> 24;
-
-                            p2[0] = SrgbToLinear[px2 & 0x000000FF];
-                            p2[1] = SrgbToLinear[( px2 & 0x0000FF00 ) >> 8];
-                            p2[2] = SrgbToLinear[( px2 & 0x00FF0000 ) >> 16];
-                            p2[3] = px2 >> 24;
-
-                            p3[0] = SrgbToLinear[px3 & 0x000000FF];
-                            p3[1] = SrgbToLinear[( px3 & 0x0000FF00 ) >> 8];
-                            p3[2] = SrgbToLinear[( px3 & 0x00FF0000 ) >> 16];
-                            p3[3] = px3 >> 24;
-
-                            __m128 s0 = _mm_loadu_ps( p0 );
-                            __m128 s1 = _mm_loadu_ps( p1 );
-                            __m128 s2 = _mm_loadu_ps( p2 );
-                            __m128 s3 = _mm_loadu_ps( p3 );
-
-                            __m128 a0 = _mm_add_ps( s0, s1 );
-                            __m128 a1 = _mm_add_ps( s2, s3 );
-                            __m128 a2 = _mm_add_ps( a0, a1 );
-
-                            __m128 v = _mm_mul_ps( a2, _mm_set_ps1( 0.25f ) );
-                            __m128 r0 = _mm_add_ps( v, _mm_set_ps1( 0.00279491f ) );
-                            __m128 r1 = _mm_rsqrt_ps( r0 );
-                            __m128 r2 = _mm_mul_ps( r1, _mm_set_ps1( 1.15907984f ) );
-                            __m128 r3 = _mm_sub_ps( r2, _mm_set_ps1( 0.15746343f ) );
-                            __m128 r4 = _mm_mul_ps( r3, v );
-
-                            __m128 b0 = _mm_blend_ps( r4, v, 8 );
-                            __m128 b1 = _mm_mul_ps( b0, _mm_set_ps1( 255 ) );
-                            __m128i b2 = _mm_cvtps_epi32( b1 );
-                            __m128i b3 = _mm_packus_epi32( b2, b2 );
-                            __m128i b4 = _mm_packus_epi16( b3, b3 );
-
-                            *ptr++ = _mm_cvtsi128_si32( b4 );
-                            src1 += 2;
-                            src2 += 2;
+                    uint32_t px0 = *src1;
+                    uint32_t px1 = *(src1+1);
+                    uint32_t px2 = *src2;
+                    uint32_t px3 = *(src2+1);
+
+                    float p0[4];
+                    float p1[4];
+                    float p2[4];
+                    float p3[4];
+
+                    p0[0] = SrgbToLinear[px0 & 0x000000FF];
+                    p0[1] = SrgbToLinear[( px0 & 0x0000FF00 ) >> 8];
+                    p0[2] = SrgbToLinear[( px0 & 0x00FF0000 ) >> 16];
+                    p0[3] = px0 >> 24;
+
+                    p1[0] = SrgbToLinear[px1 & 0x000000FF];
+                    p1[1] = SrgbToLinear[( px1 & 0x0000FF00 ) >> 8];
+                    p1[2] = SrgbToLinear[( px1 & 0x00FF0000 ) >> 16];
+                    p1[3] = px1 >> 24;
+
+                    p2[0] = SrgbToLinear[px2 & 0x000000FF];
+                    p2[1] = SrgbToLinear[( px2 & 0x0000FF00 ) >> 8];
+                    p2[2] = SrgbToLinear[( px2 & 0x00FF0000 ) >> 16];
+                    p2[3] = px2 >> 24;
+
+                    p3[0] = SrgbToLinear[px3 & 0x000000FF];
+                    p3[1] = SrgbToLinear[( px3 & 0x0000FF00 ) >> 8];
+                    p3[2] = SrgbToLinear[( px3 & 0x00FF0000 ) >> 16];
+                    p3[3] = px3 >> 24;
+
+                    __m128 s0 = _mm_loadu_ps( p0 );
+                    __m128 s1 = _mm_loadu_ps( p1 );
+                    __m128 s2 = _mm_loadu_ps( p2 );
+                    __m128 s3 = _mm_loadu_ps( p3 );
+
+                    __m128 a0 = _mm_add_ps( s0, s1 );
+                    __m128 a1 = _mm_add_ps( s2, s3 );
+                    __m128 a2 = _mm_add_ps( a0, a1 );
+
+                    __m128 v = _mm_mul_ps( a2, _mm_set_ps1( 0.25f ) );
+                    __m128 r0 = _mm_add_ps( v, _mm_set_ps1( 0.00279491f ) );
+                    __m128 r1 = _mm_rsqrt_ps( r0 );
+                    __m128 r2 = _mm_mul_ps( r1, _mm_set_ps1( 1.15907984f ) );
+                    __m128 r3 = _mm_sub_ps( r2, _mm_set_ps1( 0.15746343f ) );
+                    __m128 r4 = _mm_mul_ps( r3, v );
+
+                    __m128 b0 = _mm_blend_ps( r4, v, 8 );
+                    __m128 b1 = _mm_mul_ps( b0, _mm_set_ps1( 255 ) );
+                    __m128i b2 = _mm_cvtps_epi32( b1 );
+                    __m128i b3 = _mm_packus_epi32( b2, b2 );
+                    __m128i b4 = _mm_packus_epi16( b3, b3 );
+
+                    *ptr++ = _mm_cvtsi128_si32( b4 );
+                    src1 += 2;
+                    src2 += 2;
 #else
-                            uint32_t px0 = *src1;
-                            uint32_t px1 = *(src1+1);
-                            uint32_t px2 = *src2;
-                            uint32_t px3 = *(src2+1);
-
-                            float r0 = SrgbToLinear[px0 & 0x000000FF];
-                            float r1 = SrgbToLinear[px1 & 0x000000FF];
-                            float r2 = SrgbToLinear[px2 & 0x000000FF];
-                            float r3 = SrgbToLinear[px3 & 0x000000FF];
-
-                            float g0 = SrgbToLinear[( px0 & 0x0000FF00 ) >> 8];
-                            float g1 = SrgbToLinear[( px1 & 0x0000FF00 ) >> 8];
-                            float g2 = SrgbToLinear[( px2 & 0x0000FF00 ) >> 8];
-                            float g3 = SrgbToLinear[( px3 & 0x0000FF00 ) >> 8];
-
-                            float b0 = SrgbToLinear[( px0 & 0x00FF0000 ) >> 16];
-                            float b1 = SrgbToLinear[( px1 & 0x00FF0000 ) >> 16];
-                            float b2 = SrgbToLinear[( px2 & 0x00FF0000 ) >> 16];
-                            float b3 = SrgbToLinear[( px3 & 0x00FF0000 ) >> 16];
-
-                            uint32_t r = LinearToSrgb( ( r0+r1+r2+r3 ) / 4 );
-                            uint32_t g = LinearToSrgb( ( g0+g1+g2+g3 ) / 4 ) << 8;
-                            uint32_t b = LinearToSrgb( ( b0+b1+b2+b3 ) / 4 ) << 16;
-                            uint32_t a = ( ( ( ( ( *src1 & 0xFF000000 ) >> 8 ) + ( ( *(src1+1) & 0xFF000000 ) >> 8 ) + ( ( *src2 & 0xFF000000 ) >> 8 ) + ( ( *(src2+1) & 0xFF000000 ) >> 8 ) ) / 4 ) & 0x00FF0000 ) << 8;
-
-                            *ptr++ = r | g | b | a;
-                            src1 += 2;
-                            src2 += 2;
+                    uint32_t px0 = *src1;
+                    uint32_t px1 = *(src1+1);
+                    uint32_t px2 = *src2;
+                    uint32_t px3 = *(src2+1);
+
+                    float r0 = SrgbToLinear[px0 & 0x000000FF];
+                    float r1 = SrgbToLinear[px1 & 0x000000FF];
+                    float r2 = SrgbToLinear[px2 & 0x000000FF];
+                    float r3 = SrgbToLinear[px3 & 0x000000FF];
+
+                    float g0 = SrgbToLinear[( px0 & 0x0000FF00 ) >> 8];
+                    float g1 = SrgbToLinear[( px1 & 0x0000FF00 ) >> 8];
+                    float g2 = SrgbToLinear[( px2 & 0x0000FF00 ) >> 8];
+                    float g3 = SrgbToLinear[( px3 & 0x0000FF00 ) >> 8];
+
+                    float b0 = SrgbToLinear[( px0 & 0x00FF0000 ) >> 16];
+                    float b1 = SrgbToLinear[( px1 & 0x00FF0000 ) >> 16];
+                    float b2 = SrgbToLinear[( px2 & 0x00FF0000 ) >> 16];
+                    float b3 = SrgbToLinear[( px3 & 0x00FF0000 ) >> 16];
+
+                    uint32_t r = LinearToSrgb( ( r0+r1+r2+r3 ) / 4 );
+                    uint32_t g = LinearToSrgb( ( g0+g1+g2+g3 ) / 4 ) << 8;
+                    uint32_t b = LinearToSrgb( ( b0+b1+b2+b3 ) / 4 ) << 16;
+                    uint32_t a = ( ( ( ( ( *src1 & 0xFF000000 ) >> 8 ) + ( ( *(src1+1) & 0xFF000000 ) >> 8 ) + ( ( *src2 & 0xFF000000 ) >> 8 ) + ( ( *(src2+1) & 0xFF000000 ) >> 8 ) ) / 4 ) & 0x00FF0000 ) << 8;
+
+                    *ptr++ = r | g | b | a;
+                    src1 += 2;
+                    src2 += 2;
 #endif
-                        }
-                        src1 += m_size.x * 2;
-                        src2 += m_size.x * 2;
-                    }
-                    lines++;
-                    if( lines >= m_lines )
-                    {
-                        lines = 0;
-                        m_sema.unlock();
-                    }
-                }
-
-                if( lines != 0 )
-                {
-                    m_sema.unlock();
                 }
-            } );
-        }
-        else
+                RowLoaded( m_data + i * Stride(), i, lines );
+            }
+            LoadFinished( lines );
+        } );
+    }
+    else
+    {
+        m_load = std::async( std::launch::async, [this, &bmp]() mutable
         {
-            m_load = std::async( std::launch::async, [this, &bmp, w, h]() mutable
+            ZoneScopedN( "Downsample" );
+            ZoneValue( m_size.x );
+            TraceThreadName( "Downsampler" );
+            TraceScope trace( "Downsample", m_size.x );
+            LoadStarted();
+            unsigned int lines = 0;
+            for( int i=0; i<m_size.y; i++ )
             {
-                auto ptr = m_data;
-                auto src1 = bmp.Data();
-                auto src2 = src1 + bmp.Size().x;
-                unsigned int lines = 0;
-                for( int i=0; i<h/4; i++ )
-                {
-                    for( int j=0; j<4; j++ )
-                    {
-                        int k = m_size.x;
+                auto ptr = m_data + i * Stride();
+                auto src1 = bmp.Data() + i * bmp.Stride() * 2;
+                auto src2 = src1 + bmp.Stride();
+                int k = m_size.x;
 #ifdef __AVX2__
-                        while( k > 2 )
-                        {
-                            k -= 2;
+                while( k > 2 )
+                {
+                    k -= 2;
 
-                            __m128i p0 = _mm_loadu_si128( (__m128i*)src1 );
-                            __m128i p1 = _mm_loadu_si128( (__m128i*)src2 );
-                            src1 += 4;
-                            src2 += 4;
+                    __m128i p0 = _mm_loadu_si128( (__m128i*)src1 );
+                    __m128i p1 = _mm_loadu_si128( (__m128i*)src2 );
+                    src1 += 4;
+                    src2 += 4;
 
-                            __m256i px0 = _mm256_cvtepu8_epi16( p0 );
-                            __m256i px1 = _mm256_cvtepu8_epi16( p1 );
+                    __m256i px0 = _mm256_cvtepu8_epi16( p0 );
+                    __m256i px1 = _mm256_cvtepu8_epi16( p1 );
 
-                            __m256i s0 = _mm256_add_epi16( px0, px1 );
-                            __m256i s1 = _mm256_shuffle_epi32( s0, _MM_SHUFFLE( 1, 0, 3, 2 ) );
-                            __m256i s2 = _mm256_add_epi16( s0, s1 );
+                    __m256i s0 = _mm256_add_epi16( px0, px1 );
+                    __m256i s1 = _mm256_shuffle_epi32( s0, _MM_SHUFFLE( 1, 0, 3, 2 ) );
+                    __m256i s2 = _mm256_add_epi16( s0, s1 );
 
-                            __m256i r0 = _mm256_srli_epi16( s2, 2 );
-                            __m256i r1 = _mm256_packus_epi16( r0, r0 );
+                    __m256i r0 = _mm256_srli_epi16( s2, 2 );
+                    __m256i r1 = _mm256_packus_epi16( r0, r0 );
 
-                            *ptr++ = _mm_cvtsi128_si32( _mm256_castsi256_si128( r1 ) );
-                            *ptr++ = _mm_cvtsi128_si32( _mm256_extracti128_si256( r1, 1 ) );
-                        }
+                    *ptr++ = _mm_cvtsi128_si32( _mm256_castsi256_si128( r1 ) );
+                    *ptr++ = _mm_cvtsi128_si32( _mm256_extracti128_si256( r1, 1 ) );
+                }
 #endif
-                        while( k-- )
-                        {
+                while( k-- )
+                {
 #ifdef __SSE4_1__
-                            uint64_t p0, p1;
-                            memcpy( &p0, src1, 8 );
-                            memcpy( &p1, src2, 8 );
-                            src1 += 2;
-                            src2 += 2;
+                    uint64_t p0, p1;
+                    memcpy( &p0, src1, 8 );
+                    memcpy( &p1, src2, 8 );
+                    src1 += 2;
+                    src2 += 2;
 
-                            __m128i px = _mm_set_epi64x( p0, p1 );
-                            __m128i px0 = _mm_unpacklo_epi8( px, _mm_setzero_si128() );
-                            __m128i px1 = _mm_unpackhi_epi8( px, _mm_setzero_si128() );
+                    __m128i px = _mm_set_epi64x( p0, p1 );
+                    __m128i px0 = _mm_unpacklo_epi8( px, _mm_setzero_si128() );
+                    __m128i px1 = _mm_unpackhi_epi8( px, _mm_setzero_si128() );
 
-                            __m128i s0 = _mm_add_epi16( px0, px1 );
-                            __m128i s1 = _mm_shuffle_epi32( s0, _MM_SHUFFLE( 1, 0, 3, 2 ) );
-                            __m128i s2 = _mm_add_epi16( s0, s1 );
+                    __m128i s0 = _mm_add_epi16( px0, px1 );
+                    __m128i s1 = _mm_shuffle_epi32( s0, _MM_SHUFFLE( 1, 0, 3, 2 ) );
+                    __m128i s2 = _mm_add_epi16( s0, s1 );
 
-                            __m128i r0 = _mm_srli_epi16( s2, 2 );
-                            __m128i r1 = _mm_packus_epi16( r0, r0 );
+                    __m128i r0 = _mm_srli_epi16( s2, 2 );
+                    __m128i r1 = _mm_packus_epi16( r0, r0 );
 
-                            *ptr++ = _mm_cvtsi128_si32( r1 );
+                    *ptr++ = _mm_cvtsi128_si32( r1 );
 #else
-                            int r = ( ( *src1 & 0x000000FF ) + ( *(src1+1) & 0x000000FF ) + ( *src2 & 0x000000FF ) + ( *(src2+1) & 0x000000FF ) ) / 4;
-                            int g = ( ( ( *src1 & 0x0000FF00 ) + ( *(src1+1) & 0x0000FF00 ) + ( *src2 & 0x0000FF00 ) + ( *(src2+1) & 0x0000FF00 ) ) / 4 ) & 0x0000FF00;
-                            int b = ( ( ( *src1 & 0x00FF0000 ) + ( *(src1+1) & 0x00FF0000 ) + ( *src2 & 0x00FF0000 ) + ( *(src2+1) & 0x00FF0000 ) ) / 4 ) & 0x00FF0000;
-                            int a = ( ( ( ( ( *src1 & 0xFF000000 ) >> 8 ) + ( ( *(src1+1) & 0xFF000000 ) >> 8 ) + ( ( *src2 & 0xFF000000 ) >> 8 ) + ( ( *(src2+1) & 0xFF000000 ) >> 8 ) ) / 4 ) & 0x00FF0000 ) << 8;
-                            *ptr++ = r | g | b | a;
-                            src1 += 2;
-                            src2 += 2;
+                    int r = ( ( *src1 & 0x000000FF ) + ( *(src1+1) & 0x000000FF ) + ( *src2 & 0x000000FF ) + ( *(src2+1) & 0x000000FF ) ) / 4;
+                    int g = ( ( ( *src1 & 0x0000FF00 ) + ( *(src1+1) & 0x0000FF00 ) + ( *src2 & 0x0000FF00 ) + ( *(src2+1) & 0x0000FF00 ) ) / 4 ) & 0x0000FF00;
+                    int b = ( ( ( *src1 & 0x00FF0000 ) + ( *(src1+1) & 0x00FF0000 ) + ( *src2 & 0x00FF0000 ) + ( *(src2+1) & 0x00FF0000 ) ) / 4 ) & 0x00FF0000;
+                    int a = ( ( ( ( ( *src1 & 0xFF000000 ) >> 8 ) + ( ( *(src1+1) & 0xFF000000 ) >> 8 ) + ( ( *src2 & 0xFF000000 ) >> 8 ) + ( ( *(src2+1) & 0xFF000000 ) >> 8 ) ) / 4 ) & 0x00FF0000 ) << 8;
+                    *ptr++ = r | g | b | a;
+                    src1 += 2;
+                    src2 += 2;
 #endif
-                        }
-                        src1 += m_size.x * 2;
-                        src2 += m_size.x * 2;
-                    }
-                    lines++;
-                    if( lines >= m_lines )
-                    {
-                        lines = 0;
-                        m_sema.unlock();
-                    }
                 }
-
-                if( lines != 0 )
-                {
-                    m_sema.unlock();
-                }
-            } );
-        }
+                RowLoaded( m_data + i * Stride(), i, lines );
+            }
+            LoadFinished( lines );
+        } );
     }
 }
 
@@ -1,18 +1,42 @@
+#include <algorithm>
 #include <assert.h>
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <tracy/Tracy.hpp>
+
+#include "bc7enc.h"
 #include "bcdec.h"
 #include "BlockData.hpp"
 #include "ColorSpace.hpp"
 #include "Debug.hpp"
+#include "Math.hpp"
+#include "Memory.hpp"
 #include "MipMap.hpp"
+#include "ModeStats.hpp"
 #include "mmap.hpp"
 #include "ProcessRGB.hpp"
 #include "ProcessDxtc.hpp"
+#include "Supercompress.hpp"
 #include "Tables.hpp"
 #include "TaskDispatch.hpp"
+#include "Timing.hpp"
+#include "Trace.hpp"
 #include "Decode.hpp"
 
+#ifdef TRACY_ENABLE
+#  include <atomic>
+
+static std::atomic<int64_t> s_linesCompressed( 0 );
+#endif
+
 #ifdef __ARM_NEON
 #  include <arm_neon.h>
 #endif
@@ -35,18 +59,55 @@
 
 static uint8_t table59T58H[8] = { 3,6,11,16,23,32,41,64 };
 
-BlockData::BlockData( const char* fn )
+BlockData::BlockData( const char* fn, int level )
     : m_file( fopen( fn, "rb" ) )
+    , m_zstd( 0 )
+    , m_stream( Supercompression::None )
+    , m_fd( -1 )
+    , m_directFd( -1 )
+    , m_error( TextureError::Ok )
+    , m_punchThrough( false )
+    , m_tiers( 0 )
 {
     assert( m_file );
     fseek( m_file, 0, SEEK_END );
     m_maplen = ftell( m_file );
     fseek( m_file, 0, SEEK_SET );
     m_data = (uint8_t*)mmap( nullptr, m_maplen, PROT_READ, MAP_SHARED, fileno( m_file ), 0 );
-    ProcessHeader(m_data, m_type, m_size.x, m_size.y, m_dataOffset);
+
+    size_t dataSize;
+    Supercompression supercompression;
+    ProcessHeader( m_data, m_type, m_size.x, m_size.y, m_dataOffset, level, &dataSize, &supercompression );
+
+    if( supercompression == Supercompression::Zstd )
+    {
+        // the level, with all its slices, is decompressed to memory and the file is no longer needed
+        const auto data32 = (const uint32_t*)m_data;
+        const size_t slices = std::max( 1u, data32[7] ) * std::max( 1u, data32[8] ) * std::max( 1u, data32[9] );
+        const auto size = LevelDataSize( m_type, m_size.x, m_size.y ) * slices;
+        auto data = (uint8_t*)LargeAlloc( size );
+#ifdef ETCPAK_ZSTD
+        if( !DecompressZstd( data, size, m_data + m_dataOffset, dataSize ) ) m_error = TextureError::BadSupercompression;
+#else
+        m_error = TextureError::Unsupported;
+#endif
+        munmap( m_data, m_maplen );
+        fclose( m_file );
+        m_file = nullptr;
+        m_data = data;
+        m_dataOffset = 0;
+        m_maplen = size;
+        dataSize = size;
+    }
+
+    m_levels.push_back( { m_dataOffset, dataSize } );
+    m_images.push_back( { 0, m_dataOffset } );
+    m_layout = Texture2D;
+    m_slices = 1;
+    m_sliceBlocks = dataSize / BytesPerBlock( m_type );
 }
 
-static void WritePvrHeader( uint32_t* dst, CodecType type, const v2i& size, int levels )
+static void WritePvrHeader( uint32_t* dst, CodecType type, const v2i& size, int levels, TextureLayout layout, int slices )
 {
     *dst++ = 0x03525650;  // version
     *dst++ = 0;           // flags
@@ -61,12 +122,21 @@ static void WritePvrHeader( uint32_t* dst, CodecType type, const v2i& size, int
     case CodecType::Etc2_RGBA:
         *dst++ = 23;
         break;
+    case CodecType::Etc2_RGB8A1:
+        *dst++ = 24;
+        break;
     case CodecType::Etc2_R11:
         *dst++ = 25;
         break;
     case CodecType::Etc2_RG11:
         *dst++ = 26;
         break;
+    case CodecType::Etc2_R11_Signed:
+        *dst++ = 25;
+        break;
+    case CodecType::Etc2_RG11_Signed:
+        *dst++ = 26;
+        break;
     case CodecType::Bc1:
         *dst++ = 7;
         break;
@@ -88,22 +158,29 @@ static void WritePvrHeader( uint32_t* dst, CodecType type, const v2i& size, int
     }
     *dst++ = 0;           // pixelformat[1]
     *dst++ = 0;           // colourspace
-    *dst++ = 0;           // channel type
+    *dst++ = ( type == CodecType::Etc2_R11_Signed || type == CodecType::Etc2_RG11_Signed ) ? 1 : 0;  // channel type
     *dst++ = size.y;      // height
     *dst++ = size.x;      // width
-    *dst++ = 1;           // depth
-    *dst++ = 1;           // num surfs
-    *dst++ = 1;           // num faces
+    *dst++ = layout == Texture3D ? slices : 1;        // depth
+    *dst++ = layout == TextureArray ? slices : 1;     // num surfs
+    *dst++ = layout == TextureCube ? 6 : 1;           // num faces
     *dst++ = levels;      // mipmap count
     *dst++ = 0;           // metadata size
 }
 
-static void WriteDdsHeader( uint32_t* dst, CodecType type, const v2i& size, int levels )
+// Texture arrays need the dx10 header, which the legacy DXT1 and DXT5 formats do not use otherwise
+static bool DdsDx10( CodecType type, TextureLayout layout )
 {
-    const uint32_t flags = levels == 1 ? 0x1007 : 0x21007;
-    uint32_t pitch = size.x * size.y / 2;
-    if( type == CodecType::Etc2_RGBA || type == CodecType::Bc3 || type == CodecType::Bc5 || type == CodecType::Bc7 || type == CodecType::Etc2_RG11 ) pitch *= 2;
-    const uint32_t caps = levels == 1 ? 0x1000 : 0x401008;
+    return type == CodecType::Bc4 || type == CodecType::Bc5 || type == CodecType::Bc7 || layout == TextureArray;
+}
+
+static void WriteDdsHeader( uint32_t* dst, CodecType type, const v2i& size, int levels, TextureLayout layout, int slices )
+{
+    const uint32_t flags = ( levels == 1 ? 0x1007 : 0x21007 ) | ( layout == Texture3D ? 0x800000 : 0 );
+    const uint32_t pitch = size.x * size.y / 16 * BytesPerBlock( type );
+    const uint32_t caps = ( levels == 1 ? 0x1000 : 0x401008 ) | ( layout == TextureCube || layout == Texture3D ? 0x8 : 0 );
+    const uint32_t caps2 = layout == TextureCube ? 0xFE00 : ( layout == Texture3D ? 0x200000 : 0 );
+    const bool dx10 = DdsDx10( type, layout );
 
     *dst++ = 0x20534444;  // magic
     *dst++ = 124;         // size
@@ -111,7 +188,7 @@ static void WriteDdsHeader( uint32_t* dst, CodecType type, const v2i& size, int
     *dst++ = size.y;      // height
     *dst++ = size.x;      // width
     *dst++ = pitch;       // pitch
-    *dst++ = 0;           // depth
+    *dst++ = layout == Texture3D ? slices : 0;    // depth
     *dst++ = levels;      // mipmap count
     memset( dst, 0, 44 );
     dst += 11;
@@ -120,10 +197,10 @@ static void WriteDdsHeader( uint32_t* dst, CodecType type, const v2i& size, int
     switch( type )
     {
     case CodecType::Bc1:
-        memcpy( dst++, "DXT1", 4 );
+        memcpy( dst++, dx10 ? "DX10" : "DXT1", 4 );
         break;
     case CodecType::Bc3:
-        memcpy( dst++, "DXT5", 4 );
+        memcpy( dst++, dx10 ? "DX10" : "DXT5", 4 );
         break;
     case CodecType::Bc4:
         memcpy( dst++, "DX10", 4 );
@@ -141,13 +218,20 @@ static void WriteDdsHeader( uint32_t* dst, CodecType type, const v2i& size, int
     memset( dst, 0, 20 );
     dst += 5;
     *dst++ = caps;
-    memset( dst, 0, 16 );
-    dst+= 4;
+    *dst++ = caps2;
+    memset( dst, 0, 12 );
+    dst+= 3;
 
-    if( type == CodecType::Bc1 || type == CodecType::Bc3 ) return;
+    if( !dx10 ) return;
 
     switch( type )
     {
+    case CodecType::Bc1:
+        *dst++ = 71; // DXGI_FORMAT_BC1_UNORM
+        break;
+    case CodecType::Bc3:
+        *dst++ = 77; // DXGI_FORMAT_BC3_UNORM
+        break;
     case CodecType::Bc4:
         *dst++ = 80; // DXGI_FORMAT_BC4_UNORM
         break;
@@ -161,62 +245,373 @@ static void WriteDdsHeader( uint32_t* dst, CodecType type, const v2i& size, int
         assert( false );
         break;
     }
-    *dst++ = 3; // DXGI_FORMAT_DIMENSION_TEXTURE2D
-    *dst++ = 0; // miscFlag
-    *dst++ = 1; // arraySize
+    *dst++ = layout == Texture3D ? 4 : 3;           // DXGI_FORMAT_DIMENSION_TEXTURE3D, TEXTURE2D
+    *dst++ = layout == TextureCube ? 0x4 : 0;       // miscFlag, DDS_RESOURCE_MISC_TEXTURECUBE
+    *dst++ = layout == TextureArray ? slices : 1;   // arraySize, cube maps count whole cubes
     *dst++ = 0; // miscFlags2
 }
 
-static uint8_t* OpenForWriting( const char* fn, size_t len, const v2i& size, FILE** f, int levels, CodecType type, BlockData::Format format )
+static void WriteKtxHeader( uint32_t* dst, CodecType type, const v2i& size, int levels, TextureLayout layout, int slices )
 {
-    *f = fopen( fn, "wb+" );
-    assert( *f );
-    fseek( *f, len - 1, SEEK_SET );
-    const char zero = 0;
-    fwrite( &zero, 1, 1, *f );
-    fseek( *f, 0, SEEK_SET );
+    *dst++ = 0x58544BAB;  // identifier
+    *dst++ = 0xBB313120;
+    *dst++ = 0x0A1A0A0D;
+    *dst++ = 0x04030201;  // endianness
+    *dst++ = 0;           // glType
+    *dst++ = 1;           // glTypeSize
+    *dst++ = 0;           // glFormat
+    switch( type )        // glInternalFormat, glBaseInternalFormat
+    {
+    case CodecType::Etc1:
+        *dst++ = 0x8D64;  // GL_ETC1_RGB8_OES
+        *dst++ = 0x1907;
+        break;
+    case CodecType::Etc2_RGB:
+        *dst++ = 0x9274;  // GL_COMPRESSED_RGB8_ETC2
+        *dst++ = 0x1907;
+        break;
+    case CodecType::Etc2_RGBA:
+        *dst++ = 0x9278;  // GL_COMPRESSED_RGBA8_ETC2_EAC
+        *dst++ = 0x1908;
+        break;
+    case CodecType::Etc2_RGB8A1:
+        *dst++ = 0x9276;  // GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2
+        *dst++ = 0x1908;
+        break;
+    case CodecType::Etc2_R11:
+        *dst++ = 0x9270;  // GL_COMPRESSED_R11_EAC
+        *dst++ = 0x1903;
+        break;
+    case CodecType::Etc2_RG11:
+        *dst++ = 0x9272;  // GL_COMPRESSED_RG11_EAC
+        *dst++ = 0x8227;
+        break;
+    case CodecType::Etc2_R11_Signed:
+        *dst++ = 0x9271;  // GL_COMPRESSED_SIGNED_R11_EAC
+        *dst++ = 0x1903;
+        break;
+    case CodecType::Etc2_RG11_Signed:
+        *dst++ = 0x9273;  // GL_COMPRESSED_SIGNED_RG11_EAC
+        *dst++ = 0x8227;
+        break;
+    case CodecType::Bc1:
+        *dst++ = 0x83F1;  // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        *dst++ = 0x1908;
+        break;
+    case CodecType::Bc3:
+        *dst++ = 0x83F3;  // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+        *dst++ = 0x1908;
+        break;
+    case CodecType::Bc4:
+        *dst++ = 0x8DBB;  // GL_COMPRESSED_RED_RGTC1
+        *dst++ = 0x1903;
+        break;
+    case CodecType::Bc5:
+        *dst++ = 0x8DBD;  // GL_COMPRESSED_RG_RGTC2
+        *dst++ = 0x8227;
+        break;
+    case CodecType::Bc7:
+        *dst++ = 0x8E8C;  // GL_COMPRESSED_RGBA_BPTC_UNORM
+        *dst++ = 0x1908;
+        break;
+    default:
+        assert( false );
+        break;
+    }
+    *dst++ = size.x;      // width
+    *dst++ = size.y;      // height
+    *dst++ = layout == Texture3D ? slices : 0;        // depth
+    *dst++ = layout == TextureArray ? slices : 0;     // array elements
+    *dst++ = layout == TextureCube ? 6 : 1;           // faces
+    *dst++ = levels;      // mipmap count
+    *dst++ = 0;           // key/value data size
+}
+
+static uint32_t Ktx2Format( CodecType type )
+{
+    switch( type )
+    {
+    case CodecType::Etc1:
+    case CodecType::Etc2_RGB:
+        return 147;     // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+    case CodecType::Etc2_RGB8A1:
+        return 149;     // VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK
+    case CodecType::Etc2_RGBA:
+        return 151;     // VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+    case CodecType::Etc2_R11:
+        return 153;     // VK_FORMAT_EAC_R11_UNORM_BLOCK
+    case CodecType::Etc2_R11_Signed:
+        return 154;     // VK_FORMAT_EAC_R11_SNORM_BLOCK
+    case CodecType::Etc2_RG11:
+        return 155;     // VK_FORMAT_EAC_R11G11_UNORM_BLOCK
+    case CodecType::Etc2_RG11_Signed:
+        return 156;     // VK_FORMAT_EAC_R11G11_SNORM_BLOCK
+    case CodecType::Bc1:
+        return 133;     // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+    case CodecType::Bc3:
+        return 137;     // VK_FORMAT_BC3_UNORM_BLOCK
+    case CodecType::Bc4:
+        return 139;     // VK_FORMAT_BC4_UNORM_BLOCK
+    case CodecType::Bc5:
+        return 141;     // VK_FORMAT_BC5_UNORM_BLOCK
+    case CodecType::Bc7:
+        return 145;     // VK_FORMAT_BC7_UNORM_BLOCK
+    default:
+        assert( false );
+        return 0;
+    }
+}
+
+// Basic data format descriptor of a codec. Each sample covers bits of the block, channel ids are in bit order.
+struct Ktx2Dfd
+{
+    uint32_t model;
+    int samples;
+    uint32_t bits;      // of each sample
+    uint32_t channel[2];
+};
 
-    auto ret = (uint8_t*)mmap( nullptr, len, PROT_WRITE, MAP_SHARED, fileno( *f ), 0 );
+static Ktx2Dfd Ktx2Descriptor( CodecType type )
+{
+    switch( type )
+    {
+    case CodecType::Etc2_RGBA:
+        return { 161, 2, 64, { 15, 2 } };   // KHR_DF_MODEL_ETC2: ALPHA, COLOR
+    case CodecType::Etc2_R11:
+    case CodecType::Etc2_R11_Signed:
+        return { 161, 1, 64, { 0 } };       // KHR_DF_MODEL_ETC2: RED
+    case CodecType::Etc2_RG11:
+    case CodecType::Etc2_RG11_Signed:
+        return { 161, 2, 64, { 0, 1 } };    // KHR_DF_MODEL_ETC2: RED, GREEN
+    case CodecType::Bc1:
+        return { 128, 1, 64, { 1 } };       // KHR_DF_MODEL_BC1A: ALPHAPRESENT
+    case CodecType::Bc3:
+        return { 130, 2, 64, { 15, 0 } };   // KHR_DF_MODEL_BC3: ALPHA, COLOR
+    case CodecType::Bc4:
+        return { 131, 1, 64, { 0 } };       // KHR_DF_MODEL_BC4: DATA
+    case CodecType::Bc5:
+        return { 132, 2, 64, { 0, 1 } };    // KHR_DF_MODEL_BC5: RED, GREEN
+    case CodecType::Bc7:
+        return { 134, 1, 128, { 0 } };      // KHR_DF_MODEL_BC7: COLOR, the whole block is one sample
+    default:
+        return { 161, 1, 64, { 2 } };       // KHR_DF_MODEL_ETC2: COLOR
+    }
+}
+
+static size_t Ktx2HeaderSize( CodecType type, int levels )
+{
+    // header, level index, data format descriptor; level data is aligned to the block size
+    const size_t size = 80 + levels * 24 + 4 + 24 + Ktx2Descriptor( type ).samples * 16;
+    const size_t align = BytesPerBlock( type );
+    return ( size + align - 1 ) / align * align;
+}
+
+// index holds byteOffset, byteLength and uncompressedByteLength of each level
+static void WriteKtx2Header( uint8_t* data, CodecType type, const v2i& size, int levels, TextureLayout layout, int slices, Supercompression supercompression, const uint64_t* index )
+{
+    const auto dfd = Ktx2Descriptor( type );
+    const int samples = dfd.samples;
+    const uint32_t dfdSize = 4 + 24 + samples * 16;
+    const uint32_t dfdOffset = 80 + levels * 24;
+
+    memset( data, 0, Ktx2HeaderSize( type, levels ) );
+    auto dst = (uint32_t*)data;
+    *dst++ = 0x58544BAB;  // identifier
+    *dst++ = 0xBB303220;
+    *dst++ = 0x0A1A0A0D;
+    *dst++ = Ktx2Format( type );
+    *dst++ = 1;           // type size
+    *dst++ = size.x;      // width
+    *dst++ = size.y;      // height
+    *dst++ = layout == Texture3D ? slices : 0;        // depth
+    *dst++ = layout == TextureArray ? slices : 0;     // layers
+    *dst++ = layout == TextureCube ? 6 : 1;           // faces
+    *dst++ = levels;      // mipmap count
+    *dst++ = uint32_t( supercompression );
+    *dst++ = dfdOffset;
+    *dst++ = dfdSize;
+    dst += 6;             // key/value data and supercompression global data are not used
+    memcpy( dst, index, levels * 24 );
+    dst += levels * 6;
+
+    const bool isSigned = type == CodecType::Etc2_R11_Signed || type == CodecType::Etc2_RG11_Signed;
+
+    *dst++ = dfdSize;
+    *dst++ = 0;                                   // vendor, descriptor type
+    *dst++ = 2 | ( ( 24 + samples * 16 ) << 16 ); // version, block size
+    *dst++ = dfd.model | ( 1 << 8 ) | ( 1 << 16 ); // BT709 primaries, linear transfer
+    *dst++ = 0x0303;                              // 4x4 texel block
+    *dst++ = BytesPerBlock( type );               // bytes in plane 0
+    *dst++ = 0;
+    for( int i=0; i<samples; i++ )
+    {
+        *dst++ = ( i * dfd.bits ) | ( ( dfd.bits - 1 ) << 16 ) | ( ( dfd.channel[i] | ( isSigned ? 0x40 : 0 ) ) << 24 );
+        *dst++ = 0;                               // sample position
+        *dst++ = isSigned ? 0x80000000 : 0;       // lower
+        *dst++ = isSigned ? 0x7FFFFFFF : 0xFFFFFFFF;  // upper
+    }
+}
+
+static void WriteHeader( uint8_t* ret, const v2i& size, const std::vector<BlockData::Level>& levels, CodecType type, BlockData::Format format, TextureLayout layout, int slices )
+{
     auto dst = (uint32_t*)ret;
 
     switch( format )
     {
     case BlockData::Pvr:
-        WritePvrHeader( dst, type, size, levels );
+        WritePvrHeader( dst, type, size, levels.size(), layout, slices );
         break;
     case BlockData::Dds:
-        WriteDdsHeader( dst, type, size, levels );
+        WriteDdsHeader( dst, type, size, levels.size(), layout, slices );
+        break;
+    case BlockData::Ktx:
+        WriteKtxHeader( dst, type, size, levels.size(), layout, slices );
+        for( auto& level : levels )
+        {
+            // size of a single face in cube maps
+            *(uint32_t*)( ret + level.dataOffset - 4 ) = layout == TextureCube ? level.dataSize / 6 : level.dataSize;
+        }
         break;
+    case BlockData::Ktx2:
+    {
+        std::vector<uint64_t> index;
+        for( auto& level : levels )
+        {
+            index.insert( index.end(), { level.dataOffset, level.dataSize, level.dataSize } );
+        }
+        WriteKtx2Header( ret, type, size, levels.size(), layout, slices, Supercompression::None, index.data() );
+        break;
+    }
     default:
         assert( false );
         break;
     }
+}
+
+static uint8_t* OpenForWriting( const char* fn, size_t len, const v2i& size, FILE** f, const std::vector<BlockData::Level>& levels, CodecType type, BlockData::Format format, TextureLayout layout, int slices )
+{
+    *f = fopen( fn, "wb+" );
+    assert( *f );
+    fseek( *f, len - 1, SEEK_SET );
+    const char zero = 0;
+    fwrite( &zero, 1, 1, *f );
+    fseek( *f, 0, SEEK_SET );
+
+    auto ret = (uint8_t*)mmap( nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fileno( *f ), 0 );
+    WriteHeader( ret, size, levels, type, format, layout, slices );
+    return ret;
+}
+
+#ifndef _WIN32
+// Covers the logical block size O_DIRECT requires on all common file systems
+enum { DirectAlign = 4096 };
+
+static bool WriteAt( int fd, const uint8_t* ptr, size_t size, size_t offset )
+{
+    while( size > 0 )
+    {
+        const auto written = pwrite( fd, ptr, size, offset );
+        if( written < 0 && errno == EINTR ) continue;
+        if( written <= 0 ) return false;
+        ptr += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+// The output file would be left incomplete
+static void WriteFailed( size_t size, size_t offset )
+{
+    fprintf( stderr, "Cannot write %zu bytes at offset %zu: %s\n", size, offset, strerror( errno ) );
+    abort();
+}
+#endif
 
+// A frame that cannot be compressed would leave a corrupt output stream
+static std::vector<uint8_t> CompressFrame( Supercompression method, const uint8_t* src, size_t size, int zstdLevel = 3 )
+{
+    std::vector<uint8_t> ret;
+#ifdef ETCPAK_ZSTD
+    if( method == Supercompression::Zstd ) ret = CompressZstd( src, size, zstdLevel );
+    else
+#else
+    (void)method;
+    (void)zstdLevel;
+#endif
+    {
+        assert( method == Supercompression::Deflate );
+        ret = CompressGzip( src, size );
+    }
+    if( ret.empty() )
+    {
+        fprintf( stderr, "Cannot compress %zu bytes of output\n", size );
+        abort();
+    }
     return ret;
 }
 
-static int AdjustSizeForMipmaps( const v2i& size, int levels )
+// Ktx stores the size of each level before its data, ktx2 stores the smallest level first
+static std::vector<BlockData::Level> LayoutLevels( CodecType type, const v2i& size, int levels, int slices, size_t dataOffset, size_t prefix, bool smallestFirst )
 {
-    int len = 0;
+    std::vector<BlockData::Level> ret( levels );
     v2i current = size;
-    for( int i=1; i<levels; i++ )
+    for( auto& level : ret )
     {
-        assert( current.x != 1 || current.y != 1 );
+        level.dataSize = LevelDataSize( type, current.x, current.y ) * slices;
         current.x = std::max( 1, current.x / 2 );
         current.y = std::max( 1, current.y / 2 );
-        len += ( ( current.x + 3 ) & ~3 ) * ( ( current.y + 3 ) & ~3 ) / 2;
     }
-    assert( current.x == 1 && current.y == 1 );
-    return len;
+    for( int i=0; i<levels; i++ )
+    {
+        auto& level = ret[smallestFirst ? levels - 1 - i : i];
+        dataOffset += prefix;
+        level.dataOffset = dataOffset;
+        dataOffset += level.dataSize;
+    }
+    return ret;
+}
+
+// Images are numbered slice by slice, each slice holding its mip chain. Dds stores the data in the same order,
+// the other formats keep all slices of a level together.
+static std::vector<BlockData::Image> LayoutImages( CodecType type, const std::vector<BlockData::Level>& levels, int slices, bool sliceMajor, size_t& sliceBlocks )
+{
+    std::vector<BlockData::Image> ret;
+    ret.reserve( levels.size() * slices );
+    size_t block = 0;
+    size_t offset = levels[0].dataOffset;
+    for( int i=0; i<slices; i++ )
+    {
+        for( auto& level : levels )
+        {
+            const auto size = level.dataSize / slices;
+            ret.push_back( { block, sliceMajor ? offset : level.dataOffset + i * size } );
+            block += size / BytesPerBlock( type );
+            offset += size;
+        }
+    }
+    sliceBlocks = block / slices;
+    return ret;
 }
 
-BlockData::BlockData( const char* fn, const v2i& size, bool mipmap, CodecType type, Format format )
+BlockData::BlockData( const char* fn, const v2i& size, bool mipmap, CodecType type, Format format, int zstdLevel, Supercompression stream, TextureLayout layout, int slices, Writer writer )
     : m_size( size )
     , m_dataOffset( 52 )
-    , m_maplen( m_size.x*m_size.y/2 )
+    , m_file( nullptr )
     , m_type( type )
+    , m_layout( layout )
+    , m_slices( slices )
+    , m_zstd( format == Ktx2 ? zstdLevel : 0 )
+    , m_stream( stream )
+    , m_fd( -1 )
+    , m_directFd( -1 )
+    , m_error( TextureError::Ok )
+    , m_punchThrough( false )
+    , m_tiers( 0 )
 {
-    assert( m_size.x%4 == 0 && m_size.y%4 == 0 );
+    assert( m_zstd == 0 || m_stream == Supercompression::None );
+    assert( layout != TextureCube || slices == 6 );
+    assert( layout != Texture3D || !mipmap );
 
     uint32_t cnt = m_size.x * m_size.y / 16;
     DBGPRINT( cnt << " blocks" );
@@ -227,66 +622,274 @@ BlockData::BlockData( const char* fn, const v2i& size, bool mipmap, CodecType ty
     {
         levels = NumberOfMipLevels( size );
         DBGPRINT( "Number of mipmaps: " << levels );
-        m_maplen += AdjustSizeForMipmaps( size, levels );
     }
 
-    if( type == Etc2_RGBA || type == Bc3 || type == Bc5 || type == Bc7 || type == Etc2_RG11 ) m_maplen *= 2;
+    if( m_zstd != 0 )
+    {
+        // levels are compressed and written out in Finish()
+        m_levels = LayoutLevels( type, size, levels, slices, 0, 0, false );
+        m_images = LayoutImages( type, m_levels, slices, false, m_sliceBlocks );
+        m_maplen = m_levels.back().dataOffset + m_levels.back().dataSize;
+        m_data = (uint8_t*)LargeAlloc( m_maplen );
+        m_file = fopen( fn, "wb" );
+        assert( m_file );
+        m_dataOffset = 0;
+        return;
+    }
 
     switch( format )
     {
     case Pvr:
-        m_dataOffset = 52;
+        m_levels = LayoutLevels( type, size, levels, slices, 52, 0, false );
         break;
     case Dds:
-        m_dataOffset = 128;
-        if( type == Bc4 || type == Bc5 || type == Bc7 ) m_dataOffset += 20;
+        m_levels = LayoutLevels( type, size, levels, slices, DdsDx10( type, layout ) ? 148 : 128, 0, false );
+        break;
+    case Ktx:
+        m_levels = LayoutLevels( type, size, levels, slices, 64, 4, false );
+        break;
+    case Ktx2:
+        m_levels = LayoutLevels( type, size, levels, slices, Ktx2HeaderSize( type, levels ), 0, true );
         break;
     default:
         assert( false );
         break;
     }
+    m_images = LayoutImages( type, m_levels, slices, format == Dds, m_sliceBlocks );
+
+    m_maplen = 0;
+    for( auto& level : m_levels ) m_maplen = std::max( m_maplen, level.dataOffset + level.dataSize );
+    m_dataOffset = m_images[0].dataOffset;
+
+    if( m_stream != Supercompression::None )
+    {
+        // strips are compressed by the worker that encoded them, frames are written out in Finish()
+        m_data = (uint8_t*)LargeAlloc( m_maplen );
+        WriteHeader( m_data, m_size, m_levels, type, format, layout, slices );
+        m_file = fopen( fn, "wb" );
+        assert( m_file );
+        return;
+    }
 
-    m_maplen += m_dataOffset;
-    m_data = OpenForWriting( fn, m_maplen, m_size, &m_file, levels, type, format );
+#ifndef _WIN32
+    if( writer != Mmap )
+    {
+        // the buffer and the file offsets share their page alignment, as O_DIRECT needs
+        m_data = (uint8_t*)LargeAlloc( m_maplen );
+        WriteHeader( m_data, m_size, m_levels, type, format, layout, slices );
+        m_fd = open( fn, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if( m_fd < 0 )
+        {
+            fprintf( stderr, "Cannot open %s: %s\n", fn, strerror( errno ) );
+            abort();
+        }
+#ifdef O_DIRECT
+        if( writer == Direct )
+        {
+            m_directFd = open( fn, O_WRONLY | O_DIRECT );
+            if( m_directFd < 0 ) DBGPRINT( "O_DIRECT not supported for " << fn << ", using pwrite" );
+        }
+#endif
+        return;
+    }
+#endif
+
+    m_data = OpenForWriting( fn, m_maplen, m_size, &m_file, m_levels, type, format, layout, slices );
 }
 
 BlockData::BlockData( const v2i& size, bool mipmap, CodecType type )
     : m_size( size )
     , m_dataOffset( 52 )
     , m_file( nullptr )
-    , m_maplen( m_size.x*m_size.y/2 )
     , m_type( type )
+    , m_layout( Texture2D )
+    , m_slices( 1 )
+    , m_zstd( 0 )
+    , m_stream( Supercompression::None )
+    , m_fd( -1 )
+    , m_directFd( -1 )
+    , m_error( TextureError::Ok )
+    , m_punchThrough( false )
+    , m_tiers( 0 )
 {
-    assert( m_size.x%4 == 0 && m_size.y%4 == 0 );
-    if( mipmap )
-    {
-        const int levels = NumberOfMipLevels( size );
-        m_maplen += AdjustSizeForMipmaps( size, levels );
-    }
-
-    if( type == Etc2_RGBA || type == Bc3 || type == Bc5 || type == Bc7 || type == Etc2_RG11 ) m_maplen *= 2;
-
-    m_maplen += m_dataOffset;
-    m_data = new uint8_t[m_maplen];
+    const int levels = mipmap ? NumberOfMipLevels( size ) : 1;
+    m_levels = LayoutLevels( type, size, levels, 1, m_dataOffset, 0, false );
+    m_images = LayoutImages( type, m_levels, 1, false, m_sliceBlocks );
+    m_maplen = m_levels.back().dataOffset + m_levels.back().dataSize;
+    m_data = (uint8_t*)LargeAlloc( m_maplen );
 }
 
 BlockData::~BlockData()
 {
-    if( m_file )
+    if( m_zstd != 0 || m_stream != Supercompression::None )
+    {
+        LargeFree( m_data, m_maplen );
+        fclose( m_file );
+    }
+#ifndef _WIN32
+    else if( m_fd >= 0 )
+    {
+        LargeFree( m_data, m_maplen );
+        if( m_directFd >= 0 ) close( m_directFd );
+        close( m_fd );
+    }
+#endif
+    else if( m_file )
     {
         munmap( m_data, m_maplen );
         fclose( m_file );
     }
     else
     {
-        delete[] m_data;
+        LargeFree( m_data, m_maplen );
+    }
+}
+
+void BlockData::Finish()
+{
+    ZoneScoped;
+    TraceScope trace( "Finish" );
+    if( m_stream != Supercompression::None )
+    {
+        WriteFrames();
+        return;
+    }
+    if( m_fd >= 0 )
+    {
+        WriteGaps();
+        return;
+    }
+    if( m_zstd == 0 ) return;
+#ifdef ETCPAK_ZSTD
+    const int levels = m_levels.size();
+    std::vector<std::vector<uint8_t>> packed( levels );
+    // the queue is consumed from the back, so the largest level is started first
+    for( int i=levels-1; i>=0; i-- )
+    {
+        TaskDispatch::Queue( [this, &packed, i] {
+            packed[i] = CompressFrame( Supercompression::Zstd, m_data + m_levels[i].dataOffset, m_levels[i].dataSize, m_zstd );
+        } );
+    }
+    TaskDispatch::Sync();
+
+    // supercompressed levels need no alignment
+    const auto headerSize = Ktx2HeaderSize( m_type, levels );
+    std::vector<uint64_t> index( levels * 3 );
+    size_t offset = headerSize;
+    for( int i=levels-1; i>=0; i-- )
+    {
+        index[i*3+0] = offset;
+        index[i*3+1] = packed[i].size();
+        index[i*3+2] = m_levels[i].dataSize;
+        offset += packed[i].size();
+    }
+
+    std::vector<uint8_t> header( headerSize );
+    WriteKtx2Header( header.data(), m_type, m_size, levels, m_layout, m_slices, Supercompression::Zstd, index.data() );
+    fwrite( header.data(), 1, headerSize, m_file );
+    for( int i=levels-1; i>=0; i-- )
+    {
+        fwrite( packed[i].data(), 1, packed[i].size(), m_file );
+    }
+#else
+    assert( false );
+#endif
+}
+
+// Frames are independent, so the output can be decompressed as a whole by the standard
+// tools, or seeked with the zstd seek table. Data not covered by any strip (headers,
+// level sizes, padding) is put in frames of its own.
+void BlockData::WriteFrames()
+{
+    std::vector<uint32_t> sizes;
+    auto write = [this, &sizes] ( const std::vector<uint8_t>& frame, size_t size ) {
+        fwrite( frame.data(), 1, frame.size(), m_file );
+        sizes.push_back( frame.size() );
+        sizes.push_back( size );
+    };
+
+    size_t pos = 0;
+    for( auto& it : m_frames )
+    {
+        assert( it.first >= pos );
+        if( it.first > pos ) write( CompressFrame( m_stream, m_data + pos, it.first - pos ), it.first - pos );
+        write( it.second.data, it.second.size );
+        pos = it.first + it.second.size;
+    }
+    if( pos < m_maplen ) write( CompressFrame( m_stream, m_data + pos, m_maplen - pos ), m_maplen - pos );
+    m_frames.clear();
+
+#ifdef ETCPAK_ZSTD
+    if( m_stream == Supercompression::Zstd )
+    {
+        const auto table = ZstdSeekTable( sizes );
+        fwrite( table.data(), 1, table.size(), m_file );
+    }
+#endif
+}
+
+void BlockData::CompressStrip( const uint64_t* dst, uint32_t blocks )
+{
+    ZoneScoped;
+    const auto ptr = (const uint8_t*)dst;
+    const size_t size = blocks * BytesPerBlock( m_type );
+    auto frame = CompressFrame( m_stream, ptr, size );
+    std::lock_guard<std::mutex> lock( m_framesLock );
+    m_frames.emplace( ptr - m_data, Frame { size, std::move( frame ) } );
+}
+
+// With O_DIRECT only the whole pages of a strip are written here, the pages it shares with the
+// neighbouring strips are left to WriteGaps()
+void BlockData::WriteStrip( const uint64_t* dst, uint32_t blocks )
+{
+#ifndef _WIN32
+    ZoneScoped;
+    TraceScope trace( "Write strip" );
+    size_t begin = (const uint8_t*)dst - m_data;
+    size_t end = begin + blocks * BytesPerBlock( m_type );
+    bool written = false;
+    if( m_directFd >= 0 )
+    {
+        begin = ( begin + DirectAlign - 1 ) & ~size_t( DirectAlign - 1 );
+        end &= ~size_t( DirectAlign - 1 );
+        if( end <= begin ) return;
+        written = WriteAt( m_directFd, m_data + begin, end - begin, begin );
     }
+    // also the fallback if the file system refuses the direct write
+    if( !written && !WriteAt( m_fd, m_data + begin, end - begin, begin ) ) WriteFailed( end - begin, begin );
+    std::lock_guard<std::mutex> lock( m_framesLock );
+    m_written.emplace( begin, end - begin );
+#endif
+}
+
+// Headers, level sizes, padding, and with O_DIRECT the unaligned ends of the strips
+void BlockData::WriteGaps()
+{
+#ifndef _WIN32
+    TraceScope trace( "Write gaps" );
+    size_t pos = 0;
+    for( auto& it : m_written )
+    {
+        assert( it.first >= pos );
+        if( it.first > pos && !WriteAt( m_fd, m_data + pos, it.first - pos, pos ) ) WriteFailed( it.first - pos, pos );
+        pos = it.first + it.second;
+    }
+    if( pos < m_maplen && !WriteAt( m_fd, m_data + pos, m_maplen - pos, pos ) ) WriteFailed( m_maplen - pos, pos );
+    m_written.clear();
+#endif
 }
 
-void BlockData::Process( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool dither, bool useHeuristics )
+uint64_t* BlockData::ImageBlocks( size_t offset ) const
 {
-    auto dst = ((uint64_t*)( m_data + m_dataOffset )) + offset;
+    auto it = std::upper_bound( m_images.begin(), m_images.end(), offset, []( size_t offset, const Image& image ) { return offset < image.firstBlock; } );
+    assert( it != m_images.begin() );
+    const auto& image = *--it;
+    return (uint64_t*)( m_data + image.dataOffset + ( offset - image.firstBlock ) * BytesPerBlock( m_type ) );
+}
 
+// With tier -1 the settings are used as given, otherwise the tier selects them
+void BlockData::CompressRgb( int tier, const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool dither, bool useHeuristics, bool highQuality, const bc7enc_reduce_entropy_params* rdo )
+{
     switch( m_type )
     {
     case Etc1:
@@ -300,31 +903,45 @@ void BlockData::Process( const uint32_t* src, uint32_t blocks, size_t offset, si
         }
         break;
     case Etc2_RGB:
-        CompressEtc2Rgb( src, dst, blocks, width, useHeuristics );
+        // etc1 blocks decode the same in etc2
+        if( tier == 0 )
+        {
+            CompressEtc1Rgb( src, dst, blocks, width );
+        }
+        else
+        {
+            CompressEtc2Rgb( src, dst, blocks, width, tier < 0 ? useHeuristics : tier == 1 );
+        }
+        break;
+    case Etc2_RGB8A1:
+        CompressEtc2Rgb8A1( src, dst, blocks, width, tier < 0 ? useHeuristics : tier == 0 );
         break;
     case Etc2_R11:
-        CompressEacR( src, dst, blocks, width );
+    case Etc2_R11_Signed:
+        if( tier >= 0 ) highQuality = tier == 1;
+        CompressEacR( (const uint64_t*)src, dst, blocks, width, m_type == Etc2_R11_Signed, highQuality );
         break;
     case Etc2_RG11:
-        dst = ((uint64_t*)( m_data + m_dataOffset )) + offset * 2;
-        CompressEacRg( src, dst, blocks, width );
+    case Etc2_RG11_Signed:
+        if( tier >= 0 ) highQuality = tier == 1;
+        CompressEacRg( (const uint64_t*)src, dst, blocks, width, m_type == Etc2_RG11_Signed, highQuality );
         break;
     case Bc1:
+        if( tier >= 0 ) highQuality = tier == 1;
         if( dither )
         {
-            CompressBc1Dither( src, dst, blocks, width );
+            CompressBc1Dither( src, dst, blocks, width, highQuality, m_punchThrough, rdo );
         }
         else
         {
-            CompressBc1( src, dst, blocks, width );
+            CompressBc1( src, dst, blocks, width, highQuality, m_punchThrough, rdo );
         }
         break;
     case Bc4:
-        CompressBc4( src, dst, blocks, width );
+        CompressBc4( src, dst, blocks, width, rdo );
         break;
     case Bc5:
-        dst = ((uint64_t*)( m_data + m_dataOffset )) + offset * 2;
-        CompressBc5( src, dst, blocks, width );
+        CompressBc5( src, dst, blocks, width, rdo );
         break;
     default:
         assert( false );
@@ -332,20 +949,36 @@ void BlockData::Process( const uint32_t* src, uint32_t blocks, size_t offset, si
     }
 }
 
-void BlockData::ProcessRGBA( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool useHeuristics, const bc7enc_compress_block_params* params )
+void BlockData::CompressRgba( int tier, const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool useHeuristics, bool highQuality, const bc7enc_compress_block_params* params, const bc7enc_reduce_entropy_params* rdo )
 {
-    auto dst = ((uint64_t*)( m_data + m_dataOffset )) + offset * 2;
-
     switch( m_type )
     {
     case Etc2_RGBA:
-        CompressEtc2Rgba( src, dst, blocks, width, useHeuristics );
+        CompressEtc2Rgba( src, dst, blocks, width, tier < 0 ? useHeuristics : tier == 0 );
         break;
     case Bc3:
-        CompressBc3( src, dst, blocks, width );
+        CompressBc3( src, dst, blocks, width, tier < 0 ? highQuality : tier == 1, rdo );
         break;
     case Bc7:
-        CompressBc7( src, dst, blocks, width, params );
+        if( tier <= 0 || tier == 2 )
+        {
+            // tier 1 uses the given parameters
+            auto tierParams = *params;
+            if( tier == 0 )
+            {
+                tierParams.m_max_partitions = 0;
+            }
+            else if( tier == 2 )
+            {
+                tierParams.m_uber_level = BC7ENC_MAX_UBER_LEVEL;
+                tierParams.m_mode17_partition_estimation_filterbank = false;
+            }
+            CompressBc7( src, dst, blocks, width, &tierParams, rdo );
+        }
+        else
+        {
+            CompressBc7( src, dst, blocks, width, params, rdo );
+        }
         break;
     default:
         assert( false );
@@ -353,44 +986,356 @@ void BlockData::ProcessRGBA( const uint32_t* src, uint32_t blocks, size_t offset
     }
 }
 
-BitmapPtr BlockData::Decode()
+void BlockData::Process( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool dither, bool useHeuristics, bool highQuality, const bc7enc_reduce_entropy_params* rdo )
 {
-    auto ret = std::make_shared<Bitmap>(m_size);
-    const uint64_t* src = (const uint64_t*)(m_data + m_dataOffset);
+    ZoneScoped;
+    auto dst = ImageBlocks( offset );
 
-    switch( m_type )
+    if( m_tiers == 0 )
+    {
+        CompressRgb( -1, src, dst, blocks, width, dither, useHeuristics, highQuality, rdo );
+        if( !m_errors.empty() ) MeasureStrip( src, dst, blocks, offset, width );
+    }
+    else
+    {
+        Escalate( src, dst, blocks, offset, width, [&]( int tier, const uint32_t* src, uint64_t* dst, uint32_t blocks ) {
+            CompressRgb( tier, src, dst, blocks, width, dither, useHeuristics, highQuality, rdo );
+        } );
+    }
+#ifdef ETCPAK_MODE_STATS
+    CountBlockModes( m_type, dst, blocks );
+#endif
+    if( m_stream != Supercompression::None ) CompressStrip( dst, blocks );
+    else if( m_fd >= 0 ) WriteStrip( dst, blocks );
+#ifdef TRACY_ENABLE
+    TracyPlot( "Lines compressed", s_linesCompressed += blocks * 16 / width );
+#endif
+}
+
+void BlockData::ProcessRGBA( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool useHeuristics, bool highQuality, const bc7enc_compress_block_params* params, const bc7enc_reduce_entropy_params* rdo )
+{
+    ZoneScoped;
+    auto dst = ImageBlocks( offset );
+
+    if( m_tiers == 0 )
+    {
+        CompressRgba( -1, src, dst, blocks, width, useHeuristics, highQuality, params, rdo );
+        if( !m_errors.empty() ) MeasureStrip( src, dst, blocks, offset, width );
+    }
+    else
+    {
+        Escalate( src, dst, blocks, offset, width, [&]( int tier, const uint32_t* src, uint64_t* dst, uint32_t blocks ) {
+            CompressRgba( tier, src, dst, blocks, width, useHeuristics, highQuality, params, rdo );
+        } );
+    }
+#ifdef ETCPAK_MODE_STATS
+    CountBlockModes( m_type, dst, blocks );
+#endif
+    if( m_stream != Supercompression::None ) CompressStrip( dst, blocks );
+    else if( m_fd >= 0 ) WriteStrip( dst, blocks );
+#ifdef TRACY_ENABLE
+    TracyPlot( "Lines compressed", s_linesCompressed += blocks * 16 / width );
+#endif
+}
+
+static void DecodeBlocks( CodecType type, const uint64_t* src, uint32_t* dst, int32_t width, int32_t height )
+{
+    switch( type )
     {
     case Etc1:
     case Etc2_RGB:
-        ::DecodeRGB(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeRGB( src, dst, width, height );
         break;
     case Etc2_RGBA:
-        ::DecodeRGBA(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeRGBA( src, dst, width, height );
+        break;
+    case Etc2_RGB8A1:
+        ::DecodeRGB8A1( src, dst, width, height );
         break;
     case Etc2_R11:
-        ::DecodeR(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeR( src, dst, width, height );
         break;
     case Etc2_RG11:
-        ::DecodeRG(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeRG( src, dst, width, height );
+        break;
+    case Etc2_R11_Signed:
+        ::DecodeR( src, dst, width, height, true );
+        break;
+    case Etc2_RG11_Signed:
+        ::DecodeRG( src, dst, width, height, true );
         break;
     case Bc1:
-        ::DecodeBc1(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeBc1( src, dst, width, height );
         break;
     case Bc3:
-        ::DecodeBc3(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeBc3( src, dst, width, height );
         break;
     case Bc4:
-        ::DecodeBc4(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeBc4( src, dst, width, height );
         break;
     case Bc5:
-        ::DecodeBc5(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeBc5( src, dst, width, height );
         break;
     case Bc7:
-        ::DecodeBc7(src, ret->Data(), m_size.x, m_size.y);
+        ::DecodeBc7( src, dst, width, height );
         break;
     default:
         assert( false );
-        return nullptr;
+        break;
+    }
+}
+
+void BlockData::MeasureErrors( bool bgr, bool wide )
+{
+    m_errors.resize( m_sliceBlocks * m_slices );
+    m_bgr = bgr;
+    m_wide = wide;
+}
+
+// Pixels in the padding of edge blocks are not counted
+void BlockData::MeasureStrip( const uint32_t* src, const uint64_t* dst, uint32_t blocks, size_t offset, size_t width )
+{
+    ZoneScoped;
+    auto it = std::upper_bound( m_images.begin(), m_images.end(), offset, []( size_t offset, const Image& image ) { return offset < image.firstBlock; } );
+    const auto image = --it - m_images.begin();
+    const int level = image % m_levels.size();
+    const int w = std::max( 1, m_size.x >> level );
+    const int h = std::max( 1, m_size.y >> level );
+
+    const size_t bw = width / 4;
+    const size_t first = offset - it->firstBlock;
+    const int scale = m_wide ? 2 : 1;
+    const auto step = BytesPerBlock( m_type ) / 8;
+    for( uint32_t i=0; i<blocks; i++ )
+    {
+        uint32_t px[16] = {};
+        DecodeBlocks( m_type, dst, px, 4, 4 );
+#ifndef NDEBUG
+        // a pixel the decoder skipped keeps the fill, and differs between the two decodes
+        uint32_t check[16];
+        memset( check, 0xFF, sizeof( check ) );
+        DecodeBlocks( m_type, dst, check, 4, 4 );
+        assert( memcmp( px, check, sizeof( px ) ) == 0 );
+#endif
+        dst += step;
+
+        const int bx = ( first + i ) % bw;
+        const int by = ( first + i ) / bw;
+        const int cw = std::min( 4, w - bx * 4 );
+        const int ch = std::min( 4, h - by * 4 );
+        auto ptr = src + ( i / bw * 4 * width + i % bw * 4 ) * scale;
+
+        uint32_t sse[4] = {};
+        for( int y=0; y<ch; y++ )
+        {
+            for( int x=0; x<cw; x++ )
+            {
+                int c[4];
+                if( m_wide )
+                {
+                    auto p = (const uint16_t*)( ptr + ( y * width + x ) * 2 );
+                    for( int k=0; k<4; k++ ) c[k] = p[k] >> 8;
+                }
+                else
+                {
+                    const auto p = ptr[y * width + x];
+                    for( int k=0; k<4; k++ ) c[k] = ( p >> ( k * 8 ) ) & 0xFF;
+                }
+                if( m_bgr ) std::swap( c[0], c[2] );
+
+                // punch-through alpha discards the color of transparent pixels
+                const int first = ( m_type == Etc2_RGB8A1 || m_punchThrough ) && c[3] < 128 ? 3 : 0;
+                const auto d = px[y * 4 + x];
+                for( int k=first; k<4; k++ ) sse[k] += sq( c[k] - int( ( d >> ( k * 8 ) ) & 0xFF ) );
+            }
+        }
+        memcpy( m_errors[offset + i].sse, sse, sizeof( sse ) );
+    }
+}
+
+static const char* const Etc2RgbTiers[] = { "etc1", "etc2", "etc2 without heuristics" };
+static const char* const Etc2Tiers[] = { "etc2", "etc2 without heuristics" };
+static const char* const DxtcTiers[] = { "fast", "high quality" };
+static const char* const EacTiers[] = { "fitted multiplier", "wide multiplier search" };
+static const char* const Bc7Tiers[] = { "mode 6", "modes 1 and 6", "max uber level" };
+static const char* const SingleTier[] = { "default" };
+
+static int CodecTiers( CodecType type, const char* const*& names )
+{
+    switch( type )
+    {
+    case Etc2_RGB:
+        names = Etc2RgbTiers;
+        return 3;
+    case Etc2_RGB8A1:
+    case Etc2_RGBA:
+        names = Etc2Tiers;
+        return 2;
+    case Bc1:
+    case Bc3:
+        names = DxtcTiers;
+        return 2;
+    case Etc2_R11:
+    case Etc2_RG11:
+    case Etc2_R11_Signed:
+    case Etc2_RG11_Signed:
+        names = EacTiers;
+        return 2;
+    case Bc7:
+        names = Bc7Tiers;
+        return 3;
+    default:
+        names = SingleTier;
+        return 1;
+    }
+}
+
+void BlockData::SetTargetPsnr( float psnr, bool bgr, bool wide )
+{
+    MeasureErrors( bgr, wide );
+    const char* const* names;
+    m_tiers = CodecTiers( m_type, names );
+    m_targetSse = uint32_t( 16 * 255. * 255. / pow( 10., psnr / 10. ) );
+}
+
+std::vector<BlockData::Tier> BlockData::Tiers() const
+{
+    const char* const* names;
+    const int num = CodecTiers( m_type, names );
+    std::vector<Tier> ret;
+    for( int i=0; i<std::min( num, m_tiers ); i++ )
+    {
+        ret.emplace_back( Tier { names[i], m_tierBlocks[i], m_tierTime[i] } );
+    }
+    return ret;
+}
+
+// The target is set for whole blocks, edge blocks with fewer pixels get more leeway. Alpha is
+// compressed the same at every tier, except in bc7.
+uint32_t BlockData::ColorError( const BlockError& error ) const
+{
+    const int channels = ColorChannels( m_type );
+    uint32_t color = 0;
+    for( int i=0; i<channels; i++ ) color += error.sse[i];
+    return color;
+}
+
+bool BlockData::MissesTarget( const BlockError& error ) const
+{
+    const int channels = ColorChannels( m_type );
+    return ColorError( error ) > m_targetSse * channels || ( m_type == Bc7 && error.sse[3] > m_targetSse );
+}
+
+// Blocks that miss the target are compressed again one by one with the next tier, and keep
+// whichever encoding has the lower error
+void BlockData::Escalate( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t offset, size_t width, const CompressFn& compress )
+{
+    ZoneScoped;
+    auto start = GetTime();
+    compress( 0, src, dst, blocks );
+    MeasureStrip( src, dst, blocks, offset, width );
+    auto end = GetTime();
+    m_tierBlocks[0] += blocks;
+    m_tierTime[0] += end - start;
+
+    const size_t bw = width / 4;
+    const int scale = m_wide ? 2 : 1;
+    const auto step = BytesPerBlock( m_type ) / 8;
+    for( int tier=1; tier<m_tiers; tier++ )
+    {
+        start = end;
+        size_t num = 0;
+        for( uint32_t i=0; i<blocks; i++ )
+        {
+            auto& error = m_errors[offset + i];
+            if( !MissesTarget( error ) ) continue;
+            num++;
+
+            const auto prev = error;
+            const auto ptr = src + ( i / bw * 4 * width + i % bw * 4 ) * scale;
+            uint64_t block[2];
+            compress( tier, ptr, block, 1 );
+            MeasureStrip( ptr, block, 1, offset + i, width );
+            // scored on the channels MissesTarget() checks, and never kept at the cost of color
+            const auto color = ColorError( error );
+            const auto prevColor = ColorError( prev );
+            const uint32_t alpha = m_type == Bc7 ? error.sse[3] : 0;
+            const uint32_t prevAlpha = m_type == Bc7 ? prev.sse[3] : 0;
+            if( color <= prevColor && color + alpha < prevColor + prevAlpha )
+            {
+                memcpy( dst + i * step, block, step * sizeof( uint64_t ) );
+            }
+            else
+            {
+                error = prev;
+            }
+        }
+        if( num == 0 ) break;
+        end = GetTime();
+        m_tierBlocks[tier] += num;
+        m_tierTime[tier] += end - start;
+    }
+
+    size_t missed = 0;
+    for( uint32_t i=0; i<blocks; i++ )
+    {
+        if( MissesTarget( m_errors[offset + i] ) ) missed++;
+    }
+    m_missed += missed;
+}
+
+BitmapPtr BlockData::Decode()
+{
+    auto ret = std::make_shared<Bitmap>( m_size );
+    DecodeBlocks( m_type, (const uint64_t*)( m_data + m_dataOffset ), ret->Data(), ret->Stride(), ret->PaddedHeight() );
+    return ret;
+}
+
+// Only bc7 has block encodings that are invalid (the reserved mode 8), other formats decode any bit pattern.
+// Decoding the samples still brings in data pages scattered over the file.
+static TextureError VerifyBlocks( const uint8_t* data, const TextureInfo& info, int samples )
+{
+    const auto bytes = BytesPerBlock( info.type );
+    const size_t blocks = LevelDataSize( info.type, info.width, info.height ) / bytes;
+    const size_t step = std::max<size_t>( 1, blocks / samples );
+    uint32_t px[16];
+    for( size_t i=0; i<blocks; i+=step )
+    {
+        const auto block = data + info.dataOffset + i * bytes;
+        if( info.type == Bc7 && block[0] == 0 ) return TextureError::CorruptBlock;
+        DecodeBlocks( info.type, (const uint64_t*)block, px, 4, 4 );
     }
+    return TextureError::Ok;
+}
+
+TextureError BlockData::Verify( const char* fn, int samples, TextureInfo* info )
+{
+    FILE* f = fopen( fn, "rb" );
+    if( !f ) return TextureError::CannotOpen;
+    fseek( f, 0, SEEK_END );
+    const size_t len = ftell( f );
+    fseek( f, 0, SEEK_SET );
+    if( len == 0 )
+    {
+        fclose( f );
+        return TextureError::TooSmall;
+    }
+    auto data = (uint8_t*)mmap( nullptr, len, PROT_READ, MAP_SHARED, fileno( f ), 0 );
+    if( data == MAP_FAILED )
+    {
+        fclose( f );
+        return TextureError::CannotOpen;
+    }
+
+    TextureInfo tmp;
+    if( !info ) info = &tmp;
+    auto ret = ParseHeader( data, len, *info );
+    if( ret == TextureError::Ok && samples > 0 && info->supercompression == Supercompression::None )
+    {
+        ret = VerifyBlocks( data, *info, samples );
+    }
+
+    munmap( data, len );
+    fclose( f );
     return ret;
 }
@@ -1,8 +1,11 @@
 #ifndef __BLOCKDATA_HPP__
 #define __BLOCKDATA_HPP__
 
+#include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <stdint.h>
@@ -11,10 +14,12 @@
 
 #include "Bitmap.hpp"
 #include "ForceInline.hpp"
+#include "Metrics.hpp"
 #include "Vector.hpp"
 #include "TextureHeader.hpp"
 
 struct bc7enc_compress_block_params;
+struct bc7enc_reduce_entropy_params;
 
 class BlockData
 {
@@ -23,28 +28,142 @@ public:
     enum Format
     {
         Pvr,
-        Dds
+        Dds,
+        Ktx,
+        Ktx2
     };
 
-    BlockData( const char* fn );
-    BlockData( const char* fn, const v2i& size, bool mipmap, CodecType type, Format format );
+    // How the blocks of an output file without supercompression reach the disk
+    enum Writer
+    {
+        Mmap,       // workers store the blocks into a shared mapping of the file
+        Pwrite,     // blocks are encoded into memory, each strip is written with pwrite() once done
+        Direct      // as Pwrite, but the page aligned part of each strip bypasses the page cache
+    };
+
+    // All slices of a mip level
+    struct Level
+    {
+        size_t dataOffset;
+        size_t dataSize;
+    };
+
+    // One slice of a mip level
+    struct Image
+    {
+        size_t firstBlock;  // as counted in the offset parameter of Process()
+        size_t dataOffset;
+    };
+
+    // Compression settings of a codec, from the fastest up
+    struct Tier
+    {
+        const char* name;
+        size_t blocks;      // compressed with these settings
+        uint64_t time;      // summed over all worker threads, in us
+    };
+
+    enum { MaxTiers = 3 };
+
+    BlockData( const char* fn, int level = 0 );
+    BlockData( const char* fn, const v2i& size, bool mipmap, CodecType type, Format format, int zstdLevel = 0, Supercompression stream = Supercompression::None, TextureLayout layout = Texture2D, int slices = 1, Writer writer = Mmap );
     BlockData( const v2i& size, bool mipmap, CodecType type );
     ~BlockData();
 
+    // Writes the supercompressed levels of a ktx2 file, the frames of a supercompressed output
+    // stream, or the data not covered by any strip with the pwrite writers, once all blocks are
+    // processed.
+    void Finish();
+
     BitmapPtr Decode();
 
-    void Process( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool dither, bool useHeuristics );
-    void ProcessRGBA( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool useHeuristics, const bc7enc_compress_block_params* params );
+    // Set if the level data of a file opened for reading cannot be recovered, Decode() must not be used then
+    TextureError Error() const { return m_error; }
+
+    // Checks the header and mip chain of a texture file without reading the block data. If samples is
+    // non-zero, that many evenly spaced blocks of the first level are decoded as well.
+    static TextureError Verify( const char* fn, int samples = 0, TextureInfo* info = nullptr );
+
+    // Makes Process() decode each strip right after encoding it, while it is still in cache, and store
+    // the squared error of every block. Must be called before any blocks are processed.
+    void MeasureErrors( bool bgr, bool wide );
+    // Errors of a mip level of the first slice, one per block in Process() order
+    const BlockError* LevelErrors( int level ) const { return m_errors.data() + m_images[level].firstBlock; }
+
+    // Makes Process() compress all blocks with the fastest settings of the codec, and again with the
+    // next slower settings only those that stay below the target PSNR. The settings given to Process()
+    // are not used for codecs that have more than one tier. Measures errors as MeasureErrors() does.
+    void SetTargetPsnr( float psnr, bool bgr, bool wide );
+    std::vector<Tier> Tiers() const;
+    // Makes the bc1 high quality encoder write pixels with alpha below 128 as transparent black, and leaves
+    // their color out of the measured errors. Must be called before any blocks are processed.
+    void SetPunchThrough() { m_punchThrough = true; }
+    // Blocks still below the target after the slowest tier
+    size_t MissedBlocks() const { return m_missed; }
+
+    void Process( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool dither, bool useHeuristics, bool highQuality, const bc7enc_reduce_entropy_params* rdo );
+    void ProcessRGBA( const uint32_t* src, uint32_t blocks, size_t offset, size_t width, bool useHeuristics, bool highQuality, const bc7enc_compress_block_params* params, const bc7enc_reduce_entropy_params* rdo );
 
     const v2i& Size() const { return m_size; }
+    // Offset of the next slice in Process(), slices are numbered one after another
+    size_t SliceBlocks() const { return m_sliceBlocks; }
+    const uint8_t* Blocks() const { return m_data + m_dataOffset; }
+    size_t BlocksSize() const { return m_maplen - m_dataOffset; }
 
 private:
+    struct Frame
+    {
+        size_t size;    // uncompressed
+        std::vector<uint8_t> data;
+    };
+
+    typedef std::function<void( int tier, const uint32_t* src, uint64_t* dst, uint32_t blocks )> CompressFn;
+
+    uint64_t* ImageBlocks( size_t offset ) const;
+    void CompressRgb( int tier, const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool dither, bool useHeuristics, bool highQuality, const bc7enc_reduce_entropy_params* rdo );
+    void CompressRgba( int tier, const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool useHeuristics, bool highQuality, const bc7enc_compress_block_params* params, const bc7enc_reduce_entropy_params* rdo );
+    void Escalate( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t offset, size_t width, const CompressFn& compress );
+    // Summed error of the color channels of the codec
+    uint32_t ColorError( const BlockError& error ) const;
+    bool MissesTarget( const BlockError& error ) const;
+    void CompressStrip( const uint64_t* dst, uint32_t blocks );
+    void WriteStrip( const uint64_t* dst, uint32_t blocks );
+    void WriteGaps();
+    void MeasureStrip( const uint32_t* src, const uint64_t* dst, uint32_t blocks, size_t offset, size_t width );
+    void WriteFrames();
+
     uint8_t* m_data;
     v2i m_size;
     size_t m_dataOffset;
     FILE* m_file;
     size_t m_maplen;
     CodecType m_type;
+    std::vector<Level> m_levels;
+    std::vector<Image> m_images;
+    TextureLayout m_layout;
+    int m_slices;
+    size_t m_sliceBlocks;
+    int m_zstd;
+
+    Supercompression m_stream;
+    std::map<size_t, Frame> m_frames;   // keyed by offset in the output file
+    std::mutex m_framesLock;            // also guards m_written
+
+    int m_fd;           // -1 unless a pwrite writer is used
+    int m_directFd;     // opened with O_DIRECT, -1 if not requested or not supported
+    TextureError m_error;
+    std::map<size_t, size_t> m_written; // sizes of the strips already in the file, keyed by offset
+
+    std::vector<BlockError> m_errors;
+    bool m_bgr;
+    bool m_wide;
+    bool m_punchThrough;
+
+    int m_tiers;        // 0 without a target PSNR
+    uint32_t m_targetSse;
+    std::atomic<size_t> m_tierBlocks[MaxTiers];
+    std::atomic<uint64_t> m_tierTime[MaxTiers];
+    std::atomic<size_t> m_missed;
 };
 
 typedef std::shared_ptr<BlockData> BlockDataPtr;
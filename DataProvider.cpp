@@ -1,18 +1,21 @@
 #include <assert.h>
 #include <utility>
 
+#include <tracy/Tracy.hpp>
+
 #include "BitmapDownsampled.hpp"
 #include "DataProvider.hpp"
 #include "MipMap.hpp"
+#include "Trace.hpp"
 
-DataProvider::DataProvider( const char* fn, bool mipmap, bool bgr, bool linearize )
+DataProvider::DataProvider( const char* fn, bool mipmap, bool bgr, bool linearize, bool wide, bool snorm )
     : m_offset( 0 )
     , m_lines( 32 )
     , m_mipmap( mipmap )
     , m_done( false )
     , m_linearize( linearize )
 {
-    m_bmp.emplace_back( new Bitmap( fn, m_lines, bgr ) );
+    m_bmp.emplace_back( new Bitmap( fn, m_lines, bgr, wide, snorm ) );
     m_current = m_bmp[0].get();
 }
 
@@ -22,7 +25,7 @@ DataProvider::~DataProvider()
 
 unsigned int DataProvider::NumberOfParts() const
 {
-    unsigned int parts = ( ( m_bmp[0]->Size().y / 4 ) + m_lines - 1 ) / m_lines;
+    unsigned int parts = ( ( m_bmp[0]->PaddedHeight() / 4 ) + m_lines - 1 ) / m_lines;
 
     if( m_mipmap )
     {
@@ -35,7 +38,7 @@ unsigned int DataProvider::NumberOfParts() const
             current.x = std::max( 1, current.x / 2 );
             current.y = std::max( 1, current.y / 2 );
             lines *= 2;
-            parts += ( ( std::max( 4, current.y ) / 4 ) + lines - 1 ) / lines;
+            parts += ( ( ( current.y + 3 ) / 4 ) + lines - 1 ) / lines;
         }
         assert( current.x == 1 && current.y == 1 );
     }
@@ -45,6 +48,8 @@ unsigned int DataProvider::NumberOfParts() const
 
 DataPart DataProvider::NextPart()
 {
+    ZoneScoped;
+    TraceScope trace( "Next part", m_bmp.size() - 1 );
     assert( !m_done );
 
     unsigned int lines = m_lines;
@@ -53,12 +58,14 @@ DataPart DataProvider::NextPart()
     const auto ptr = m_current->NextBlock( lines, done );
     DataPart ret = {
         ptr,
-        std::max<unsigned int>( 4, m_current->Size().x ),
+        (unsigned int)m_current->Stride(),
         lines,
-        m_offset
+        m_offset,
+        (unsigned int)m_bmp.size() - 1
     };
 
-    m_offset += m_current->Size().x / 4 * lines;
+    m_offset += ret.width / 4 * lines;
+    ZoneValue( ret.level );
 
     if( done )
     {
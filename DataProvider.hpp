@@ -13,12 +13,13 @@ struct DataPart
     unsigned int width;
     unsigned int lines;
     unsigned int offset;
+    unsigned int level;     // mip level
 };
 
 class DataProvider
 {
 public:
-    DataProvider( const char* fn, bool mipmap, bool bgr, bool linearize );
+    DataProvider( const char* fn, bool mipmap, bool bgr, bool linearize, bool wide = false, bool snorm = false );
     ~DataProvider();
 
     unsigned int NumberOfParts() const;
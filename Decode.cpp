@@ -722,6 +722,88 @@ static etcpak_force_inline void DecodeRGBAPart( uint64_t d, uint64_t alpha, uint
     }
 }
 
+static etcpak_force_inline void DecodeRGB8A1Part( uint64_t d, uint32_t* dst, uint32_t w )
+{
+    // opaque blocks are identical to ETC2 RGB in differential, T, H or planar mode
+    if( d & 0x02000000 )
+    {
+        DecodeRGBPart( d, dst, w );
+        return;
+    }
+
+    d = ConvertByteOrder( d );
+
+    uint32_t r0 = ( d & 0xF8000000 ) >> 27;
+    uint32_t g0 = ( d & 0x00F80000 ) >> 19;
+    uint32_t b0 = ( d & 0x0000F800 ) >> 11;
+
+    int32_t dr = ( int32_t(d) << 5 ) >> 29;
+    int32_t dg = ( int32_t(d) << 13 ) >> 29;
+    int32_t db = ( int32_t(d) << 21 ) >> 29;
+
+    int32_t r1 = int32_t(r0) + dr;
+    int32_t g1 = int32_t(g0) + dg;
+    int32_t b1 = int32_t(b0) + db;
+
+    const uint32_t indexes = ( d >> 32 ) & 0xFFFFFFFF;
+
+    // in T and H modes index 2 is transparent, P mode ignores the opaque flag
+    if( (r1 < 0) || (r1 > 31) )
+    {
+        DecodeT( d, dst, w );
+    }
+    else if( (g1 < 0) || (g1 > 31) )
+    {
+        DecodeH( d, dst, w );
+    }
+    else if( (b1 < 0) || (b1 > 31) )
+    {
+        DecodePlanar( d, dst, w );
+        return;
+    }
+    else
+    {
+        const int32_t br[2] = { int32_t( ( r0 << 3 ) | ( r0 >> 2 ) ), ( r1 << 3 ) | ( r1 >> 2 ) };
+        const int32_t bg[2] = { int32_t( ( g0 << 3 ) | ( g0 >> 2 ) ), ( g1 << 3 ) | ( g1 >> 2 ) };
+        const int32_t bb[2] = { int32_t( ( b0 << 3 ) | ( b0 >> 2 ) ), ( b1 << 3 ) | ( b1 >> 2 ) };
+
+        unsigned int tcw[2];
+        tcw[0] = ( d & 0xE0 ) >> 5;
+        tcw[1] = ( d & 0x1C ) >> 2;
+
+        for( int i=0; i<4; i++ )
+        {
+            for( int j=0; j<4; j++ )
+            {
+                const uint8_t index = ( ( ( indexes >> ( j + i * 4 + 16 ) ) & 0x1 ) << 1 ) | ( ( indexes >> ( j + i * 4 ) ) & 0x1 );
+                if( index == 2 )
+                {
+                    dst[j*w+i] = 0;
+                    continue;
+                }
+                const auto s = ( d & 0x1 ) ? j/2 : i/2;
+                const auto mod = index == 0 ? 0 : g_table[tcw[s]][index];
+                const auto rc = clampu8( br[s] + mod );
+                const auto gc = clampu8( bg[s] + mod );
+                const auto bc = clampu8( bb[s] + mod );
+                dst[j*w+i] = rc | ( gc << 8 ) | ( bc << 16 ) | 0xFF000000;
+            }
+        }
+        return;
+    }
+
+    for( int i=0; i<4; i++ )
+    {
+        for( int j=0; j<4; j++ )
+        {
+            if( ( ( indexes >> ( j + i * 4 + 16 ) ) & 0x1 ) && !( ( indexes >> ( j + i * 4 ) ) & 0x1 ) )
+            {
+                dst[j*w+i] = 0;
+            }
+        }
+    }
+}
+
 static etcpak_force_inline void DecodeRPart( uint64_t r, uint32_t* dst, uint32_t w, bool isSigned = false )
 {
     r = _bswap64( r );
@@ -836,9 +918,39 @@ static etcpak_force_inline void DecodeBc1Part( uint64_t d, uint32_t* dst, uint32
         g = (int(g0)+g1)/2;
         b = (int(b0)+b1)/2;
         dict[2] = 0xFF000000 | ( b << 16 ) | ( g << 8 ) | r;
-        dict[3] = 0xFF000000;
+        dict[3] = 0;
     }
 
+    memcpy( dst+0, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+1, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+2, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+3, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    dst += w;
+
+    memcpy( dst+0, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+1, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+2, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+3, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    dst += w;
+
+    memcpy( dst+0, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+1, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+2, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    memcpy( dst+3, dict + (idx & 0x3), 4 );
+    idx >>= 2;
+    dst += w;
+
     memcpy( dst+0, dict + (idx & 0x3), 4 );
     idx >>= 2;
     memcpy( dst+1, dict + (idx & 0x3), 4 );
@@ -1136,6 +1248,20 @@ static etcpak_force_inline void DecodeBc5Part( uint64_t r, uint64_t g, uint32_t*
     gidx >>= 3;
     dst += w;
 
+    dst[0] = rdict[ridx & 0x7] | gdict[gidx & 0x7] | 0xFF000000;
+    ridx >>= 3;
+    gidx >>= 3;
+    dst[1] = rdict[ridx & 0x7] | gdict[gidx & 0x7] | 0xFF000000;
+    ridx >>= 3;
+    gidx >>= 3;
+    dst[2] = rdict[ridx & 0x7] | gdict[gidx & 0x7] | 0xFF000000;
+    ridx >>= 3;
+    gidx >>= 3;
+    dst[3] = rdict[ridx & 0x7] | gdict[gidx & 0x7] | 0xFF000000;
+    ridx >>= 3;
+    gidx >>= 3;
+    dst += w;
+
     dst[0] = rdict[ridx & 0x7] | gdict[gidx & 0x7] | 0xFF000000;
     ridx >>= 3;
     gidx >>= 3;
@@ -1252,6 +1378,20 @@ void DecodeRGBA(const uint64_t* src, uint32_t* dst, int32_t width, int32_t heigh
     }
 }
 
+void DecodeRGB8A1(const uint64_t* src, uint32_t* dst, int32_t width, int32_t height)
+{
+    for( int y=0; y<height/4; y++ )
+    {
+        for( int x=0; x<width/4; x++ )
+        {
+            uint64_t d = *src++;
+            DecodeRGB8A1Part( d, dst, width );
+            dst += 4;
+        }
+        dst += width*3;
+    }
+}
+
 void DecodeR(const uint64_t* src, uint32_t* dst, int32_t width, int32_t height, bool isSigned)
 {
     for( int y=0; y < height/4; y++ )
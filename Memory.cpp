@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <errno.h>
+#  include <string.h>
+#  include <sys/mman.h>
+#  ifdef __linux__
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#  endif
+#endif
+
+#include "Memory.hpp"
+
+#ifdef _WIN32
+
+void* LargeAlloc( size_t size, bool interleave )
+{
+    (void)interleave;
+    auto ret = VirtualAlloc( nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+    if( !ret )
+    {
+        fprintf( stderr, "Cannot allocate %zu bytes (error %lu)\n", size, (unsigned long)GetLastError() );
+        abort();
+    }
+    return ret;
+}
+
+void LargeFree( void* ptr, size_t size )
+{
+    (void)size;
+    if( ptr ) VirtualFree( ptr, 0, MEM_RELEASE );
+}
+
+#else
+
+enum { HugePage = 2 * 1024 * 1024 };
+
+// Callers have no way to continue without the buffer
+static void* Map( size_t len )
+{
+    void* ptr = mmap( nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( ptr == MAP_FAILED )
+    {
+        fprintf( stderr, "Cannot allocate %zu bytes: %s\n", len, strerror( errno ) );
+        abort();
+    }
+    return ptr;
+}
+
+static size_t MappedSize( size_t size )
+{
+    if( size >= HugePage ) return ( size + HugePage - 1 ) & ~size_t( HugePage - 1 );
+    const size_t page = sysconf( _SC_PAGESIZE );
+    return ( size + page - 1 ) & ~( page - 1 );
+}
+
+#ifdef __linux__
+enum { MaxNodes = 1024 };
+enum { MpolInterleave = 3 };    // from linux/mempolicy.h, libnuma is not needed for one syscall
+
+// Nodes listed in the sysfs range format, e.g. "0-1,3". Zero if there is only one node.
+static int NumaNodes( unsigned long* mask )
+{
+    FILE* f = fopen( "/sys/devices/system/node/online", "r" );
+    if( !f ) return 0;
+    int nodes = 0;
+    int first, last;
+    while( fscanf( f, "%i", &first ) == 1 )
+    {
+        last = first;
+        char sep = fgetc( f );
+        if( sep == '-' )
+        {
+            if( fscanf( f, "%i", &last ) != 1 ) break;
+            sep = fgetc( f );
+        }
+        for( int i=first; i<=last && i<MaxNodes; i++ )
+        {
+            mask[i / ( 8 * sizeof( unsigned long ) )] |= 1ul << ( i % ( 8 * sizeof( unsigned long ) ) );
+            nodes++;
+        }
+        if( sep != ',' ) break;
+    }
+    fclose( f );
+    return nodes > 1 ? nodes : 0;
+}
+#endif
+
+void* LargeAlloc( size_t size, bool interleave )
+{
+    const auto len = MappedSize( size );
+    void* ret;
+    if( len >= HugePage )
+    {
+        // over-allocate to align the mapping, huge pages only back aligned ranges
+        auto ptr = (uint8_t*)Map( len + HugePage );
+        const auto aligned = (uint8_t*)( ( uintptr_t( ptr ) + HugePage - 1 ) & ~uintptr_t( HugePage - 1 ) );
+        if( aligned != ptr ) munmap( ptr, aligned - ptr );
+        munmap( aligned + len, ptr + HugePage - aligned );
+        ret = aligned;
+#ifdef MADV_HUGEPAGE
+        madvise( ret, len, MADV_HUGEPAGE );
+#endif
+    }
+    else
+    {
+        ret = Map( len );
+    }
+
+#if defined __linux__ && defined SYS_mbind
+    if( interleave )
+    {
+        static unsigned long mask[MaxNodes / ( 8 * sizeof( unsigned long ) )];
+        static const int nodes = NumaNodes( mask );
+        // the policy is only a hint, allocation works the same without it
+        if( nodes != 0 ) syscall( SYS_mbind, ret, len, MpolInterleave, mask, MaxNodes, 0 );
+    }
+#endif
+
+    return ret;
+}
+
+void LargeFree( void* ptr, size_t size )
+{
+    if( ptr ) munmap( ptr, MappedSize( size ) );
+}
+
+#endif
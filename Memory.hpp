@@ -0,0 +1,13 @@
+#ifndef __MEMORY_HPP__
+#define __MEMORY_HPP__
+
+#include <stddef.h>
+
+// Zeroed, page aligned memory for image and block buffers. Buffers of 2 MB and more are
+// aligned to and advised for transparent huge pages. Pages are placed on the NUMA node that
+// first touches them, or with interleave spread over all nodes, for data that one thread writes
+// and all workers read.
+void* LargeAlloc( size_t size, bool interleave = false );
+void LargeFree( void* ptr, size_t size );
+
+#endif
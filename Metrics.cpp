@@ -0,0 +1,489 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "ForceInline.hpp"
+#include "Math.hpp"
+#include "Metrics.hpp"
+#include "TaskDispatch.hpp"
+
+#ifdef __AVX2__
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  else
+#    include <x86intrin.h>
+#  endif
+#endif
+
+enum { Luma = 4 };
+
+static const double MsSsimWeight[5] = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+
+struct Source
+{
+    const uint32_t* bmp;
+    const uint32_t* out;
+    size_t bmpStride;       // in uint32_t, wide bitmaps take two per pixel
+    size_t outStride;
+    bool bgr;
+    bool wide;
+    bool punchThrough;      // the color of source pixels with alpha < 128 is not compared
+};
+
+// Sums of one task, added together in order once all tasks are done
+struct Partial
+{
+    uint64_t sse[4];
+    double ssim[5];         // R, G, B, A, luma
+    double cs;              // contrast and structure term of luma
+};
+
+static etcpak_force_inline int CalcLuma( int r, int g, int b )
+{
+    return ( r * 54 + g * 183 + b * 19 + 128 ) >> 8;
+}
+
+static etcpak_force_inline void LoadSource( const Source& s, const uint32_t* ptr, int* c )
+{
+    if( s.wide )
+    {
+        auto w = (const uint16_t*)ptr;
+        for( int i=0; i<4; i++ ) c[i] = w[i] >> 8;
+    }
+    else
+    {
+        for( int i=0; i<4; i++ ) c[i] = ( *ptr >> ( i * 8 ) ) & 0xFF;
+    }
+    if( s.bgr ) std::swap( c[0], c[2] );
+    c[Luma] = CalcLuma( c[0], c[1], c[2] );
+}
+
+static etcpak_force_inline void LoadOutput( uint32_t px, int* c )
+{
+    for( int i=0; i<4; i++ ) c[i] = ( px >> ( i * 8 ) ) & 0xFF;
+    c[Luma] = CalcLuma( c[0], c[1], c[2] );
+}
+
+// Transparent pixels of punch-through alpha formats keep no color, the source takes the decoded one
+static etcpak_force_inline void MaskTransparent( int* a, const int* b )
+{
+    if( a[3] >= 128 ) return;
+    for( int c=0; c<3; c++ ) a[c] = b[c];
+    a[Luma] = b[Luma];
+}
+
+static etcpak_force_inline void Ssim( double sx, double sy, double sxx, double syy, double sxy, double n, double& ssim, double& cs )
+{
+    constexpr double C1 = 6.5025;       // ( 0.01 * 255 )^2
+    constexpr double C2 = 58.5225;      // ( 0.03 * 255 )^2
+
+    const double mx = sx / n;
+    const double my = sy / n;
+    const double vx = sxx / n - mx * mx;
+    const double vy = syy / n - my * my;
+    const double cov = sxy / n - mx * my;
+
+    cs = ( 2 * cov + C2 ) / ( vx + vy + C2 );
+    ssim = ( 2 * mx * my + C1 ) / ( mx * mx + my * my + C1 ) * cs;
+}
+
+// Window sums are indexed [x, y, x², y², xy][R, G, B, A, luma]. If lb is set, the luma of each
+// 2x2 pixels is summed into the half resolution planes lb and lo, for the next MS-SSIM scale.
+static void WindowScalar( const Source& s, int x, int y, int32_t sum[5][5], uint16_t* lb, uint16_t* lo, size_t lstride )
+{
+    memset( sum, 0, sizeof( int32_t ) * 25 );
+    const int scale = s.wide ? 2 : 1;
+    for( int j=0; j<8; j++ )
+    {
+        auto pb = s.bmp + ( y + j ) * s.bmpStride + x * scale;
+        auto po = s.out + ( y + j ) * s.outStride + x;
+        for( int i=0; i<8; i++ )
+        {
+            int a[5], b[5];
+            LoadSource( s, pb + i * scale, a );
+            LoadOutput( po[i], b );
+            if( s.punchThrough ) MaskTransparent( a, b );
+            for( int c=0; c<5; c++ )
+            {
+                sum[0][c] += a[c];
+                sum[1][c] += b[c];
+                sum[2][c] += a[c] * a[c];
+                sum[3][c] += b[c] * b[c];
+                sum[4][c] += a[c] * b[c];
+            }
+            if( lb )
+            {
+                const size_t idx = j / 2 * lstride + i / 2;
+                if( ( ( i | j ) & 1 ) == 0 ) lb[idx] = lo[idx] = 0;
+                lb[idx] += a[Luma];
+                lo[idx] += b[Luma];
+            }
+        }
+    }
+}
+
+#ifdef __AVX2__
+// Luma of 8 pixels, weights are R, G, B, 0 for each pixel
+static etcpak_force_inline __m256i Luma8( __m256i px, __m256i weights )
+{
+    const __m256i lo = _mm256_unpacklo_epi8( px, _mm256_setzero_si256() );
+    const __m256i hi = _mm256_unpackhi_epi8( px, _mm256_setzero_si256() );
+    const __m256i y = _mm256_hadd_epi32( _mm256_madd_epi16( lo, weights ), _mm256_madd_epi16( hi, weights ) );
+    return _mm256_srli_epi32( _mm256_add_epi32( y, _mm256_set1_epi32( 128 ) ), 8 );
+}
+
+static etcpak_force_inline void Reduce( __m256i v, int32_t* dst )
+{
+    _mm_storeu_si128( (__m128i*)dst, _mm_add_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) ) );
+}
+
+static etcpak_force_inline int32_t ReduceAll( __m256i v )
+{
+    __m128i r = _mm_add_epi32( _mm256_castsi256_si128( v ), _mm256_extracti128_si256( v, 1 ) );
+    r = _mm_add_epi32( r, _mm_shuffle_epi32( r, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    r = _mm_add_epi32( r, _mm_shuffle_epi32( r, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    return _mm_cvtsi128_si32( r );
+}
+
+static void WindowAvx2( const Source& s, int x, int y, int32_t sum[5][5], uint16_t* lb, uint16_t* lo, size_t lstride )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16( 1 );
+
+    // Pairs up the channels of two pixels (R0 R1 G0 G1 B0 B1 A0 A1), so that madd sums one channel
+    const __m256i outShuffle = _mm256_setr_epi8( 0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15, 0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15 );
+    const __m256i bmpShuffle = s.bgr ? _mm256_setr_epi8( 2, 6, 1, 5, 0, 4, 3, 7, 10, 14, 9, 13, 8, 12, 11, 15, 2, 6, 1, 5, 0, 4, 3, 7, 10, 14, 9, 13, 8, 12, 11, 15 ) : outShuffle;
+    const __m256i outWeights = _mm256_set1_epi64x( 0x0000001300B70036 );
+    const __m256i bmpWeights = s.bgr ? _mm256_set1_epi64x( 0x0000003600B70013 ) : outWeights;
+
+    __m256i sx = zero, sy = zero, sxx = zero, syy = zero, sxy = zero;
+    __m256i lx = zero, ly = zero, lxx = zero, lyy = zero, lxy = zero;
+    __m256i hb = zero, ho = zero;
+    for( int j=0; j<8; j++ )
+    {
+        const __m256i b = _mm256_loadu_si256( (const __m256i*)( s.bmp + ( y + j ) * s.bmpStride + x ) );
+        const __m256i o = _mm256_loadu_si256( (const __m256i*)( s.out + ( y + j ) * s.outStride + x ) );
+
+        const __m256i bs = _mm256_shuffle_epi8( b, bmpShuffle );
+        const __m256i os = _mm256_shuffle_epi8( o, outShuffle );
+        const __m256i b0 = _mm256_unpacklo_epi8( bs, zero );
+        const __m256i b1 = _mm256_unpackhi_epi8( bs, zero );
+        const __m256i o0 = _mm256_unpacklo_epi8( os, zero );
+        const __m256i o1 = _mm256_unpackhi_epi8( os, zero );
+
+        sx = _mm256_add_epi32( sx, _mm256_add_epi32( _mm256_madd_epi16( b0, one ), _mm256_madd_epi16( b1, one ) ) );
+        sy = _mm256_add_epi32( sy, _mm256_add_epi32( _mm256_madd_epi16( o0, one ), _mm256_madd_epi16( o1, one ) ) );
+        sxx = _mm256_add_epi32( sxx, _mm256_add_epi32( _mm256_madd_epi16( b0, b0 ), _mm256_madd_epi16( b1, b1 ) ) );
+        syy = _mm256_add_epi32( syy, _mm256_add_epi32( _mm256_madd_epi16( o0, o0 ), _mm256_madd_epi16( o1, o1 ) ) );
+        sxy = _mm256_add_epi32( sxy, _mm256_add_epi32( _mm256_madd_epi16( b0, o0 ), _mm256_madd_epi16( b1, o1 ) ) );
+
+        // luma is below 256, the upper halves of the 32 bit lanes are zero in madd
+        const __m256i yb = Luma8( b, bmpWeights );
+        const __m256i yo = Luma8( o, outWeights );
+        lx = _mm256_add_epi32( lx, yb );
+        ly = _mm256_add_epi32( ly, yo );
+        lxx = _mm256_add_epi32( lxx, _mm256_madd_epi16( yb, yb ) );
+        lyy = _mm256_add_epi32( lyy, _mm256_madd_epi16( yo, yo ) );
+        lxy = _mm256_add_epi32( lxy, _mm256_madd_epi16( yb, yo ) );
+
+        if( lb )
+        {
+            hb = _mm256_add_epi32( hb, _mm256_hadd_epi32( yb, yb ) );
+            ho = _mm256_add_epi32( ho, _mm256_hadd_epi32( yo, yo ) );
+            if( j & 1 )
+            {
+                const __m128i rb = _mm256_castsi256_si128( _mm256_permute4x64_epi64( hb, _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+                const __m128i ro = _mm256_castsi256_si128( _mm256_permute4x64_epi64( ho, _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+                _mm_storel_epi64( (__m128i*)( lb + j / 2 * lstride ), _mm_packus_epi32( rb, rb ) );
+                _mm_storel_epi64( (__m128i*)( lo + j / 2 * lstride ), _mm_packus_epi32( ro, ro ) );
+                hb = ho = zero;
+            }
+        }
+    }
+
+    Reduce( sx, sum[0] );
+    Reduce( sy, sum[1] );
+    Reduce( sxx, sum[2] );
+    Reduce( syy, sum[3] );
+    Reduce( sxy, sum[4] );
+    sum[0][Luma] = ReduceAll( lx );
+    sum[1][Luma] = ReduceAll( ly );
+    sum[2][Luma] = ReduceAll( lxx );
+    sum[3][Luma] = ReduceAll( lyy );
+    sum[4][Luma] = ReduceAll( lxy );
+}
+#endif
+
+static void AddWindow( const int32_t sum[5][5], Partial& p )
+{
+    for( int c=0; c<5; c++ )
+    {
+        double ssim, cs;
+        Ssim( sum[0][c], sum[1][c], sum[2][c], sum[3][c], sum[4][c], 64, ssim, cs );
+        p.ssim[c] += ssim;
+        if( c == Luma )
+        {
+            p.cs += cs;
+        }
+        else
+        {
+            p.sse[c] += int64_t( sum[2][c] ) + sum[3][c] - 2 * int64_t( sum[4][c] );
+        }
+    }
+}
+
+// Pixels outside of full windows only count towards the error
+static void AddError( const Source& s, int x0, int x1, int y0, int y1, Partial& p )
+{
+    const int scale = s.wide ? 2 : 1;
+    for( int y=y0; y<y1; y++ )
+    {
+        for( int x=x0; x<x1; x++ )
+        {
+            int a[5], b[5];
+            LoadSource( s, s.bmp + y * s.bmpStride + x * scale, a );
+            LoadOutput( s.out[y * s.outStride + x], b );
+            if( s.punchThrough ) MaskTransparent( a, b );
+            for( int c=0; c<4; c++ ) p.sse[c] += sq( a[c] - b[c] );
+        }
+    }
+}
+
+static void Strip( const Source& s, int y, int w, int h, uint16_t* lb, uint16_t* lo, size_t lstride, Partial& p )
+{
+    if( y + 8 > h )
+    {
+        AddError( s, 0, w, y, h, p );
+        return;
+    }
+
+    const int w8 = w & ~7;
+    int32_t sum[5][5];
+    for( int x=0; x<w8; x+=8 )
+    {
+        const size_t idx = y / 2 * lstride + x / 2;
+#ifdef __AVX2__
+        if( !s.wide && !s.punchThrough )
+        {
+            WindowAvx2( s, x, y, sum, lb ? lb + idx : nullptr, lo ? lo + idx : nullptr, lstride );
+        }
+        else
+#endif
+        {
+            WindowScalar( s, x, y, sum, lb ? lb + idx : nullptr, lo ? lo + idx : nullptr, lstride );
+        }
+        AddWindow( sum, p );
+    }
+    AddError( s, w8, w, y, y + 8, p );
+}
+
+// Windows of the luma planes at the coarser MS-SSIM scales
+template<typename T>
+static void PlaneStrip( const T* a, const T* b, int w, int y, double norm, Partial& p )
+{
+    for( int x=0; x+8<=w; x+=8 )
+    {
+        double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        for( int j=0; j<8; j++ )
+        {
+            auto pa = a + size_t( y + j ) * w + x;
+            auto pb = b + size_t( y + j ) * w + x;
+            for( int i=0; i<8; i++ )
+            {
+                const double va = pa[i] * norm;
+                const double vb = pb[i] * norm;
+                sx += va;
+                sy += vb;
+                sxx += va * va;
+                syy += vb * vb;
+                sxy += va * vb;
+            }
+        }
+        double ssim, cs;
+        Ssim( sx, sy, sxx, syy, sxy, 64, ssim, cs );
+        p.ssim[Luma] += ssim;
+        p.cs += cs;
+    }
+}
+
+template<typename T>
+static std::vector<float> Downsample( const T* src, int w, int h, float norm )
+{
+    const int dw = w / 2;
+    const int dh = h / 2;
+    std::vector<float> ret( size_t( dw ) * dh );
+    for( int y=0; y<dh; y++ )
+    {
+        auto s0 = src + size_t( y * 2 ) * w;
+        auto s1 = s0 + w;
+        for( int x=0; x<dw; x++ )
+        {
+            ret[size_t( y ) * dw + x] = ( float( s0[x*2] ) + s0[x*2+1] + s1[x*2] + s1[x*2+1] ) * norm * 0.25f;
+        }
+    }
+    return ret;
+}
+
+// Each task sums a few strips into its own partial result
+template<typename F>
+static Partial ForEachStrip( int strips, const F& f )
+{
+    constexpr int StripsPerTask = 8;
+    std::vector<Partial> partial( ( strips + StripsPerTask - 1 ) / StripsPerTask, Partial {} );
+    for( size_t i=0; i<partial.size(); i++ )
+    {
+        TaskDispatch::Queue( [&f, &partial, i, strips] {
+            const int end = std::min<int>( strips, ( i + 1 ) * StripsPerTask );
+            for( int j=i*StripsPerTask; j<end; j++ ) f( j, partial[i] );
+        } );
+    }
+    TaskDispatch::Sync();
+
+    Partial ret = {};
+    for( auto& p : partial )
+    {
+        for( int c=0; c<4; c++ ) ret.sse[c] += p.sse[c];
+        for( int c=0; c<5; c++ ) ret.ssim[c] += p.ssim[c];
+        ret.cs += p.cs;
+    }
+    return ret;
+}
+
+ImageMetrics CalcMetrics( const Bitmap& bmp, const Bitmap& out, bool bgr, bool punchThrough )
+{
+    assert( bmp.Size() == out.Size() );
+    assert( !out.Wide() );
+
+    const int w = bmp.Size().x;
+    const int h = bmp.Size().y;
+    const Source s = { bmp.Data(), out.Data(), size_t( bmp.Stride() ) * ( bmp.Wide() ? 2 : 1 ), size_t( out.Stride() ), bgr, bmp.Wide(), punchThrough };
+
+    // MS-SSIM uses up to five scales, as long as a window fits
+    int scales = 0;
+    for( int sw = w & ~7, sh = h & ~7; scales < 5 && sw >= 8 && sh >= 8; sw /= 2, sh /= 2 ) scales++;
+
+    int pw = ( w & ~7 ) / 2;
+    int ph = ( h & ~7 ) / 2;
+    std::vector<uint16_t> lumaBmp, lumaOut;
+    if( scales > 1 )
+    {
+        lumaBmp.resize( size_t( pw ) * ph );
+        lumaOut.resize( size_t( pw ) * ph );
+    }
+    const auto lb = scales > 1 ? lumaBmp.data() : nullptr;
+    const auto lo = scales > 1 ? lumaOut.data() : nullptr;
+
+    const auto res = ForEachStrip( ( h + 7 ) / 8, [&s, w, h, lb, lo, pw]( int strip, Partial& p ) { Strip( s, strip * 8, w, h, lb, lo, pw, p ); } );
+
+    ImageMetrics ret = {};
+    ret.scales = scales;
+    for( int c=0; c<4; c++ ) ret.mse[c] = res.sse[c] / ( double( w ) * h );
+    if( scales == 0 ) return ret;
+
+    double windows = double( w / 8 ) * ( h / 8 );
+    for( int c=0; c<4; c++ ) ret.ssim[c] = res.ssim[c] / windows;
+
+    // contrast and structure of all scales but the last one, which uses the full SSIM
+    double weights = 0;
+    for( int i=0; i<scales; i++ ) weights += MsSsimWeight[i];
+    double msssim = 1;
+    double cs = res.cs / windows;
+    double ssim = res.ssim[Luma] / windows;
+    std::vector<float> fb, fo;
+    for( int i=1; i<scales; i++ )
+    {
+        msssim *= pow( std::max( cs, 0. ), MsSsimWeight[i-1] / weights );
+        if( i > 1 )
+        {
+            if( i == 2 )
+            {
+                fb = Downsample( lb, pw, ph, 0.25f );
+                fo = Downsample( lo, pw, ph, 0.25f );
+            }
+            else
+            {
+                fb = Downsample( fb.data(), pw, ph, 1.f );
+                fo = Downsample( fo.data(), pw, ph, 1.f );
+            }
+            pw /= 2;
+            ph /= 2;
+        }
+        const auto p = i == 1
+            ? ForEachStrip( ph / 8, [lb, lo, pw]( int strip, Partial& p ) { PlaneStrip( lb, lo, pw, strip * 8, 0.25, p ); } )
+            : ForEachStrip( ph / 8, [&fb, &fo, pw]( int strip, Partial& p ) { PlaneStrip( fb.data(), fo.data(), pw, strip * 8, 1., p ); } );
+        windows = double( pw / 8 ) * ( ph / 8 );
+        cs = p.cs / windows;
+        ssim = p.ssim[Luma] / windows;
+    }
+    ret.msssim = msssim * pow( std::max( ssim, 0. ), MsSsimWeight[scales-1] / weights );
+
+    return ret;
+}
+
+void CalcBlockMse( const BlockError* errors, const v2i& size, double* mse )
+{
+    const size_t blocks = size_t( ( size.x + 3 ) / 4 ) * ( ( size.y + 3 ) / 4 );
+    uint64_t sse[4] = {};
+    for( size_t i=0; i<blocks; i++ )
+    {
+        for( int c=0; c<4; c++ ) sse[c] += errors[i].sse[c];
+    }
+    for( int c=0; c<4; c++ ) mse[c] = sse[c] / ( double( size.x ) * size.y );
+}
+
+BitmapPtr BlockErrorHeatmap( const BlockError* errors, const v2i& size, uint32_t mask )
+{
+    struct Stop
+    {
+        float rmse;
+        float color[3];
+    };
+    static const Stop Stops[] = {
+        { 0, { 0, 0, 0 } },
+        { 1, { 0, 0, 255 } },
+        { 2, { 0, 255, 255 } },
+        { 4, { 0, 255, 0 } },
+        { 8, { 255, 255, 0 } },
+        { 16, { 255, 0, 0 } }
+    };
+    constexpr int NumStops = sizeof( Stops ) / sizeof( Stop );
+
+    const int channels = CountSetBits( mask );
+    assert( channels > 0 );
+
+    auto ret = std::make_shared<Bitmap>( size );
+    const int bw = ( size.x + 3 ) / 4;
+    const int bh = ( size.y + 3 ) / 4;
+    for( int by=0; by<bh; by++ )
+    {
+        for( int bx=0; bx<bw; bx++ )
+        {
+            const auto& e = errors[by * bw + bx];
+            uint64_t sse = 0;
+            for( int c=0; c<4; c++ )
+            {
+                if( mask & ( 1 << c ) ) sse += e.sse[c];
+            }
+            const int pixels = std::min( 4, size.x - bx * 4 ) * std::min( 4, size.y - by * 4 );
+            const float rmse = sqrt( float( sse ) / ( pixels * channels ) );
+
+            int i = 1;
+            while( i < NumStops - 1 && rmse > Stops[i].rmse ) i++;
+            const float t = std::min( 1.f, ( rmse - Stops[i-1].rmse ) / ( Stops[i].rmse - Stops[i-1].rmse ) );
+            uint32_t px = 0xFF000000;
+            for( int c=0; c<3; c++ )
+            {
+                px |= uint32_t( Stops[i-1].color[c] + ( Stops[i].color[c] - Stops[i-1].color[c] ) * t + 0.5f ) << ( c * 8 );
+            }
+
+            auto dst = ret->Data() + by * 4 * ret->Stride() + bx * 4;
+            for( int y=0; y<4; y++ )
+            {
+                for( int x=0; x<4; x++ ) dst[x] = px;
+                dst += ret->Stride();
+            }
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,38 @@
+#ifndef __METRICS_HPP__
+#define __METRICS_HPP__
+
+#include <math.h>
+
+#include "Bitmap.hpp"
+
+struct ImageMetrics
+{
+    double mse[4];      // R, G, B, A
+    double ssim[4];     // mean over all 8x8 windows
+    double msssim;      // of luma
+    int scales;         // used by MS-SSIM, 0 if the image is smaller than one window
+};
+
+// Squared error of one block against its source pixels
+struct BlockError
+{
+    uint32_t sse[4];    // R, G, B, A
+};
+
+// Compares the source image with its decoded texture in one pass, split into tasks on the
+// TaskDispatch workers. With bgr set, red and blue are swapped in the source image. With punchThrough
+// set, the color of source pixels with alpha < 128 is not compared, as such formats discard it.
+ImageMetrics CalcMetrics( const Bitmap& bmp, const Bitmap& out, bool bgr, bool punchThrough = false );
+
+// Mean squared error per channel of an image, from the errors of its blocks
+void CalcBlockMse( const BlockError* errors, const v2i& size, double* mse );
+// Block errors as a picture of the image size, black where lossless, then through blue, cyan, green
+// and yellow to red at an RMSE of 16 or more. Only the channels in mask (bit 0 is red) are counted.
+BitmapPtr BlockErrorHeatmap( const BlockError* errors, const v2i& size, uint32_t mask );
+
+static inline double Psnr( double mse )
+{
+    return 20 * log10( 255. ) - 10 * log10( mse );
+}
+
+#endif
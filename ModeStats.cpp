@@ -0,0 +1,133 @@
+#ifdef ETCPAK_MODE_STATS
+
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+#include "ModeStats.hpp"
+
+static std::mutex s_lock;
+static std::vector<std::unique_ptr<ModeStats>> s_threads;    // outlive the threads
+
+void ModeStats::Add( const ModeStats& other )
+{
+    etc2Solid += other.etc2Solid;
+    for( int i=0; i<3; i++ ) etc2Heuristic[i] += other.etc2Heuristic[i];
+    for( int i=0; i<5; i++ ) etcMode[i] += other.etcMode[i];
+    for( int i=0; i<9; i++ ) bc7Mode[i] += other.bc7Mode[i];
+    for( int i=0; i<64; i++ ) bc7Partition[i] += other.bc7Partition[i];
+}
+
+static ModeStats* RegisterThread()
+{
+    std::lock_guard<std::mutex> lock( s_lock );
+    s_threads.emplace_back( std::make_unique<ModeStats>() );
+    return s_threads.back().get();
+}
+
+ModeStats& ThreadModeStats()
+{
+    static thread_local ModeStats* stats = RegisterThread();
+    return *stats;
+}
+
+ModeStats CollectModeStats()
+{
+    std::lock_guard<std::mutex> lock( s_lock );
+    ModeStats ret = {};
+    for( auto& stats : s_threads ) ret.Add( *stats );
+    return ret;
+}
+
+void CountBlockModes( CodecType type, const uint64_t* blocks, uint32_t num )
+{
+    auto& stats = ThreadModeStats();
+    switch( type )
+    {
+    case Etc1:
+    case Etc2_RGB:
+    case Etc2_RGB8A1:
+        for( uint32_t i=0; i<num; i++ ) stats.etcMode[EtcBlockMode( blocks[i], type == Etc2_RGB8A1 )]++;
+        break;
+    case Etc2_RGBA:
+        for( uint32_t i=0; i<num; i++ ) stats.etcMode[EtcBlockMode( blocks[i*2+1] )]++;
+        break;
+    case Bc7:
+        for( uint32_t i=0; i<num; i++ )
+        {
+            const auto b = blocks[i*2];
+            int mode = 0;
+            while( mode < 8 && !( b & ( 1 << mode ) ) ) mode++;
+            stats.bc7Mode[mode]++;
+            if( mode == 1 || mode == 3 || mode == 7 ) stats.bc7Partition[( b >> ( mode + 1 ) ) & 0x3F]++;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void PrintModeStats( const ModeStats& stats )
+{
+    uint64_t etc = 0;
+    for( int i=0; i<5; i++ ) etc += stats.etcMode[i];
+    uint64_t bc7 = 0;
+    for( int i=0; i<9; i++ ) bc7 += stats.bc7Mode[i];
+
+    printf( "Block modes\n" );
+    if( etc != 0 )
+    {
+        printf( "  ETC:" );
+        for( int i=0; i<5; i++ ) printf( "%s %s %llu (%0.1f%%)", i == 0 ? "" : ",", EtcModeNames[i], (unsigned long long)stats.etcMode[i], stats.etcMode[i] * 100. / etc );
+        printf( "\n" );
+        const auto heuristic = stats.etc2Heuristic[0] + stats.etc2Heuristic[1] + stats.etc2Heuristic[2];
+        printf( "  ETC2 solid: %llu, heuristic: planar %llu, T/H %llu, undecided %llu\n", (unsigned long long)stats.etc2Solid, (unsigned long long)stats.etc2Heuristic[1], (unsigned long long)stats.etc2Heuristic[2], (unsigned long long)stats.etc2Heuristic[0] );
+        if( heuristic == 0 && stats.etc2Solid == 0 ) printf( "  (etc1 and etc2 without heuristics do not count these)\n" );
+    }
+    if( bc7 != 0 )
+    {
+        printf( "  BC7:" );
+        bool first = true;
+        for( int i=0; i<9; i++ )
+        {
+            if( stats.bc7Mode[i] == 0 ) continue;
+            printf( "%s mode %i %llu (%0.1f%%)", first ? "" : ",", i, (unsigned long long)stats.bc7Mode[i], stats.bc7Mode[i] * 100. / bc7 );
+            first = false;
+        }
+        printf( "\n  BC7 partitions of two subset blocks, most used first:" );
+        uint64_t used[64];
+        memcpy( used, stats.bc7Partition, sizeof( used ) );
+        for( int n=0; n<8; n++ )
+        {
+            int best = 0;
+            for( int i=1; i<64; i++ ) if( used[i] > used[best] ) best = i;
+            if( used[best] == 0 ) break;
+            printf( "%s %i: %llu", n == 0 ? "" : ",", best, (unsigned long long)used[best] );
+            used[best] = 0;
+        }
+        printf( "\n" );
+    }
+}
+
+static void WriteArray( FILE* f, const uint64_t* v, int num )
+{
+    fprintf( f, "[" );
+    for( int i=0; i<num; i++ ) fprintf( f, "%s%llu", i == 0 ? "" : ", ", (unsigned long long)v[i] );
+    fprintf( f, "]" );
+}
+
+void WriteModeStats( FILE* f, const ModeStats& stats )
+{
+    fprintf( f, "{\n  \"etc2_solid\": %llu,\n", (unsigned long long)stats.etc2Solid );
+    fprintf( f, "  \"etc2_heuristic\": { \"undecided\": %llu, \"planar\": %llu, \"th\": %llu },\n", (unsigned long long)stats.etc2Heuristic[0], (unsigned long long)stats.etc2Heuristic[1], (unsigned long long)stats.etc2Heuristic[2] );
+    fprintf( f, "  \"etc_modes\": {" );
+    for( int i=0; i<5; i++ ) fprintf( f, "%s \"%s\": %llu", i == 0 ? "" : ",", EtcModeNames[i], (unsigned long long)stats.etcMode[i] );
+    fprintf( f, " },\n  \"bc7_modes\": " );
+    WriteArray( f, stats.bc7Mode, 9 );
+    fprintf( f, ",\n  \"bc7_partitions\": " );
+    WriteArray( f, stats.bc7Partition, 64 );
+    fprintf( f, "\n}\n" );
+}
+
+#endif
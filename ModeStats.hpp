@@ -0,0 +1,66 @@
+#ifndef __MODESTATS_HPP__
+#define __MODESTATS_HPP__
+
+// Block mode classification, and counters of the encoder mode decisions compiled in with the
+// ETCPAK_MODE_STATS cmake option
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ForceInline.hpp"
+
+static const char* const EtcModeNames[5] = { "individual", "differential", "T", "H", "planar" };
+
+// Mode of an ETC1/ETC2 color block, indexing EtcModeNames. Punch-through blocks have no individual
+// mode, the bit flags opaque blocks instead.
+static etcpak_force_inline int EtcBlockMode( uint64_t block, bool punchThrough = false )
+{
+    uint32_t d;
+    memcpy( &d, &block, 4 );
+    d = ( d >> 24 ) | ( ( d >> 8 ) & 0xFF00 ) | ( ( d << 8 ) & 0xFF0000 ) | ( d << 24 );
+    if( !punchThrough && !( d & 0x2 ) ) return 0;
+    const int r = int( d >> 27 ) + ( ( int32_t( d ) << 5 ) >> 29 );
+    const int g = int( ( d >> 19 ) & 0x1F ) + ( ( int32_t( d ) << 13 ) >> 29 );
+    const int b = int( ( d >> 11 ) & 0x1F ) + ( ( int32_t( d ) << 21 ) >> 29 );
+    if( r < 0 || r > 31 ) return 2;
+    if( g < 0 || g > 31 ) return 3;
+    if( b < 0 || b > 31 ) return 4;
+    return 1;
+}
+
+#ifdef ETCPAK_MODE_STATS
+
+#include <stdio.h>
+
+#include "TextureHeader.hpp"
+
+struct ModeStats
+{
+    uint64_t etc2Solid;
+    uint64_t etc2Heuristic[3];  // undecided, planar (returned right away), T/H
+    uint64_t etcMode[5];        // individual, differential, T, H, planar
+    uint64_t bc7Mode[9];        // 8 is the reserved mode
+    uint64_t bc7Partition[64];  // of two subset blocks
+
+    void Add( const ModeStats& other );
+};
+
+// Counters of the calling thread. Every thread registers its own on first use, so the encoders
+// count without synchronization.
+ModeStats& ThreadModeStats();
+// Sums the counters of all threads. Only call it while no blocks are compressed, e.g. after
+// TaskDispatch::Sync().
+ModeStats CollectModeStats();
+
+// Counts the final modes of compressed blocks
+void CountBlockModes( CodecType type, const uint64_t* blocks, uint32_t num );
+
+void PrintModeStats( const ModeStats& stats );
+void WriteModeStats( FILE* f, const ModeStats& stats );
+
+#  define ETCPAK_COUNT( counter ) ThreadModeStats().counter++
+#else
+#  define ETCPAK_COUNT( counter )
+#endif
+
+#endif
@@ -3,9 +3,13 @@
 #include "ForceInline.hpp"
 #include "ProcessDxtc.hpp"
 
+#include <algorithm>
 #include <assert.h>
+#include <limits>
+#include <math.h>
 #include <stdint.h>
 #include <string.h>
+#include <vector>
 
 #ifdef __ARM_NEON
 #  include <arm_neon.h>
@@ -218,6 +222,11 @@ static etcpak_force_inline uint64_t ProcessRGB( const uint8_t* src )
         return uint64_t( to565( c ) ) << 16;
     }
 
+    px0 = _mm_and_si128( px0, _mm_set1_epi32( 0xFFFFFF ) );
+    px1 = _mm_and_si128( px1, _mm_set1_epi32( 0xFFFFFF ) );
+    px2 = _mm_and_si128( px2, _mm_set1_epi32( 0xFFFFFF ) );
+    px3 = _mm_and_si128( px3, _mm_set1_epi32( 0xFFFFFF ) );
+
     __m128i min0 = _mm_min_epu8( px0, px1 );
     __m128i min1 = _mm_min_epu8( px2, px3 );
     __m128i min2 = _mm_min_epu8( min0, min1 );
@@ -538,6 +547,11 @@ static etcpak_force_inline void ProcessRGB_AVX( const uint8_t* src, char*& dst )
         return;
     }
 
+    px0 = _mm256_and_si256( px0, _mm256_set1_epi32( 0xFFFFFF ) );
+    px1 = _mm256_and_si256( px1, _mm256_set1_epi32( 0xFFFFFF ) );
+    px2 = _mm256_and_si256( px2, _mm256_set1_epi32( 0xFFFFFF ) );
+    px3 = _mm256_and_si256( px3, _mm256_set1_epi32( 0xFFFFFF ) );
+
     __m256i min0 = _mm256_min_epu8( px0, px1 );
     __m256i min1 = _mm256_min_epu8( px2, px3 );
     __m256i min2 = _mm256_min_epu8( min0, min1 );
@@ -813,70 +827,831 @@ static etcpak_force_inline uint64_t ProcessAlpha_SSE( __m128i px0, __m128i px1,
 
     return ProcessOneChannel_SSE( a );
 }
-#endif
 
-void CompressBc1( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
+// Gathers one channel of a 4x4 block into the 16 bytes of a register, in row order.
+static etcpak_force_inline __m128i LoadChannel_SSE( const uint32_t* src, size_t width, int channel )
 {
+    __m128i px0 = _mm_loadu_si128( (__m128i*)( src + width * 0 ) );
+    __m128i px1 = _mm_loadu_si128( (__m128i*)( src + width * 1 ) );
+    __m128i px2 = _mm_loadu_si128( (__m128i*)( src + width * 2 ) );
+    __m128i px3 = _mm_loadu_si128( (__m128i*)( src + width * 3 ) );
+
+    __m128i mask = _mm_setr_epi32( 0x0c080400 + channel * 0x01010101, -1, -1, -1 );
+
+    __m128i m0 = _mm_shuffle_epi8( px0, mask );
+    __m128i m1 = _mm_shuffle_epi8( px1, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
+    __m128i m2 = _mm_shuffle_epi8( px2, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
+    __m128i m3 = _mm_shuffle_epi8( px3, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
+    __m128i m4 = _mm_or_si128( m0, m1 );
+    __m128i m5 = _mm_or_si128( m2, m3 );
+
+    return _mm_or_si128( m4, m5 );
+}
+#endif
+
 #ifdef __AVX2__
-    if( width%8 == 0 )
+// Two horizontally adjacent blocks, one per 128-bit lane.
+static etcpak_force_inline __m256i LoadChannel_AVX( const uint32_t* src, size_t width, int channel )
+{
+    __m256i px0 = _mm256_loadu_si256( (__m256i*)( src + width * 0 ) );
+    __m256i px1 = _mm256_loadu_si256( (__m256i*)( src + width * 1 ) );
+    __m256i px2 = _mm256_loadu_si256( (__m256i*)( src + width * 2 ) );
+    __m256i px3 = _mm256_loadu_si256( (__m256i*)( src + width * 3 ) );
+
+    __m256i mask = _mm256_setr_epi32( 0x0c080400 + channel * 0x01010101, -1, -1, -1, 0x0c080400 + channel * 0x01010101, -1, -1, -1 );
+
+    __m256i m0 = _mm256_shuffle_epi8( px0, mask );
+    __m256i m1 = _mm256_shuffle_epi8( px1, _mm256_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
+    __m256i m2 = _mm256_shuffle_epi8( px2, _mm256_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
+    __m256i m3 = _mm256_shuffle_epi8( px3, _mm256_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
+    __m256i m4 = _mm256_or_si256( m0, m1 );
+    __m256i m5 = _mm256_or_si256( m2, m3 );
+
+    return _mm256_or_si256( m4, m5 );
+}
+
+// Lane by lane equivalent of ProcessOneChannel_SSE, so the output does not depend on the code path.
+static etcpak_force_inline void ProcessOneChannel_AVX( __m256i a, uint64_t* dst )
+{
+    __m256i solidCmp = _mm256_shuffle_epi8( a, _mm256_setzero_si256() );
+    __m256i cmpRes = _mm256_cmpeq_epi8( a, solidCmp );
+    const uint32_t solid = _mm256_movemask_epi8( cmpRes );
+    if( solid == 0xFFFFFFFF )
+    {
+        dst[0] = uint8_t( _mm256_extract_epi8( a, 0 ) );
+        dst[1] = uint8_t( _mm256_extract_epi8( a, 16 ) );
+        return;
+    }
+
+    __m256i a1 = _mm256_shuffle_epi32( a, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+    __m256i max1 = _mm256_max_epu8( a, a1 );
+    __m256i min1 = _mm256_min_epu8( a, a1 );
+    __m256i amax2 = _mm256_shuffle_epi32( max1, _MM_SHUFFLE( 0, 0, 2, 2 ) );
+    __m256i amin2 = _mm256_shuffle_epi32( min1, _MM_SHUFFLE( 0, 0, 2, 2 ) );
+    __m256i max2 = _mm256_max_epu8( max1, amax2 );
+    __m256i min2 = _mm256_min_epu8( min1, amin2 );
+    __m256i amax3 = _mm256_alignr_epi8( max2, max2, 2 );
+    __m256i amin3 = _mm256_alignr_epi8( min2, min2, 2 );
+    __m256i max3 = _mm256_max_epu8( max2, amax3 );
+    __m256i min3 = _mm256_min_epu8( min2, amin3 );
+    __m256i amax4 = _mm256_alignr_epi8( max3, max3, 1 );
+    __m256i amin4 = _mm256_alignr_epi8( min3, min3, 1 );
+    __m256i max = _mm256_max_epu8( max3, amax4 );
+    __m256i min = _mm256_min_epu8( min3, amin4 );
+    __m256i minmax = _mm256_unpacklo_epi8( max, min );
+
+    __m256i r = _mm256_sub_epi8( max, min );
+    const int range0 = _mm256_extract_epi8( r, 0 );
+    const int range1 = _mm256_extract_epi8( r, 16 );
+    __m256i rv = _mm256_inserti128_si256( _mm256_set1_epi16( DivTableAlpha[range0] ), _mm_set1_epi16( DivTableAlpha[range1] ), 1 );
+
+    __m256i v = _mm256_sub_epi8( a, min );
+
+    __m256i lo16 = _mm256_unpacklo_epi8( v, _mm256_setzero_si256() );
+    __m256i hi16 = _mm256_unpackhi_epi8( v, _mm256_setzero_si256() );
+
+    __m256i lomul = _mm256_mulhi_epu16( lo16, rv );
+    __m256i himul = _mm256_mulhi_epu16( hi16, rv );
+
+    __m256i p0 = _mm256_packus_epi16( lomul, himul );
+
+    // Remap to the BC4 index order and pack the 3 bit indices in registers, instead of the 6 bit table lookups done by the SSE version.
+    __m256i table = _mm256_setr_epi8( 1, 7, 6, 5, 4, 3, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 7, 6, 5, 4, 3, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+    __m256i i0 = _mm256_shuffle_epi8( table, p0 );
+    __m256i i1 = _mm256_maddubs_epi16( i0, _mm256_set1_epi16( 0x0801 ) );
+    __m256i i2 = _mm256_madd_epi16( i1, _mm256_set1_epi32( 0x00400001 ) );
+    __m256i i3 = _mm256_and_si256( _mm256_or_si256( i2, _mm256_srli_epi64( i2, 20 ) ), _mm256_set1_epi64x( 0xFFFFFF ) );
+
+    uint64_t idx[4];
+    uint16_t mm[16];
+    _mm256_storeu_si256( (__m256i*)idx, i3 );
+    _mm256_storeu_si256( (__m256i*)mm, minmax );
+
+    for( int j=0; j<2; j++ )
+    {
+        if( ( ( solid >> ( j*16 ) ) & 0xFFFF ) == 0xFFFF )
+        {
+            dst[j] = mm[j*8] & 0xFF;
+        }
+        else
+        {
+            const uint64_t data = idx[j*2] | ( idx[j*2+1] << 24 );
+            dst[j] = (uint64_t)mm[j*8] | ( data << 16 );
+        }
+    }
+}
+#endif
+
+#if defined __ARM_NEON && defined __aarch64__
+static const uint8_t ChannelGather_NEON[16] = { 0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 44, 48, 52, 56, 60 };
+
+// Gathers one channel of a 4x4 block into the 16 bytes of a register, in row order.
+static etcpak_force_inline uint8x16_t LoadChannel_NEON( const uint32_t* src, size_t width, int channel )
+{
+    uint8x16x4_t px;
+    px.val[0] = vld1q_u8( (const uint8_t*)( src + width * 0 ) );
+    px.val[1] = vld1q_u8( (const uint8_t*)( src + width * 1 ) );
+    px.val[2] = vld1q_u8( (const uint8_t*)( src + width * 2 ) );
+    px.val[3] = vld1q_u8( (const uint8_t*)( src + width * 3 ) );
+
+    return vqtbl4q_u8( px, vaddq_u8( vld1q_u8( ChannelGather_NEON ), vdupq_n_u8( channel ) ) );
+}
+
+// Same math as ProcessOneChannel_SSE, so ARM and x86 produce identical output.
+static etcpak_force_inline uint64_t ProcessOneChannel_NEON( uint8x16_t a )
+{
+    const uint8_t min = vminvq_u8( a );
+    const uint8_t max = vmaxvq_u8( a );
+    if( min == max ) return max;
+
+    const uint16x4_t rv = vdup_n_u16( DivTableAlpha[max - min] );
+    const uint8x16_t v = vsubq_u8( a, vdupq_n_u8( min ) );
+
+    const uint16x8_t lo16 = vmovl_u8( vget_low_u8( v ) );
+    const uint16x8_t hi16 = vmovl_u8( vget_high_u8( v ) );
+
+    const uint16x4_t m0 = vshrn_n_u32( vmull_u16( vget_low_u16( lo16 ), rv ), 16 );
+    const uint16x4_t m1 = vshrn_n_u32( vmull_u16( vget_high_u16( lo16 ), rv ), 16 );
+    const uint16x4_t m2 = vshrn_n_u32( vmull_u16( vget_low_u16( hi16 ), rv ), 16 );
+    const uint16x4_t m3 = vshrn_n_u32( vmull_u16( vget_high_u16( hi16 ), rv ), 16 );
+
+    const uint8x16_t p0 = vcombine_u8( vqmovn_u16( vcombine_u16( m0, m1 ) ), vqmovn_u16( vcombine_u16( m2, m3 ) ) );
+
+    // Remap to the BC4 index order, then pack the 3 bit indices pairwise: 8 -> 6 -> 12 -> 24 bits per 64-bit lane.
+    const uint8x16_t i0 = vqtbl1q_u8( vcombine_u8( vld1_u8( AlphaIndexTable ), vdup_n_u8( 0 ) ), p0 );
+    const uint16x8_t i1 = vreinterpretq_u16_u8( i0 );
+    const uint32x4_t i2 = vreinterpretq_u32_u16( vsraq_n_u16( vandq_u16( i1, vdupq_n_u16( 0xFF ) ), i1, 5 ) );
+    const uint64x2_t i3 = vreinterpretq_u64_u32( vsraq_n_u32( vandq_u32( i2, vdupq_n_u32( 0xFFFF ) ), i2, 10 ) );
+    const uint64x2_t i4 = vsraq_n_u64( vandq_u64( i3, vdupq_n_u64( 0xFFFFFFFF ) ), i3, 20 );
+
+    const uint64_t data = vgetq_lane_u64( i4, 0 ) | ( vgetq_lane_u64( i4, 1 ) << 24 );
+    return max | ( min << 8 ) | ( data << 16 );
+}
+#endif
+
+// Higher quality color tier. Endpoints start at the extremes of the principal axis of the block colors and are then refined with least-squares
+// fits to the chosen selectors. Blocks are returned in the final BC1 layout, without the need for the DxtcIndexTable fixup.
+struct Bc1Fit
+{
+    float px[3][16];
+    uint32_t transparent;
+};
+
+static etcpak_force_inline void Expand565( uint16_t c, float* out )
+{
+    out[0] = float( ( ( c & 0xF800 ) >> 8 ) | ( ( c & 0xF800 ) >> 13 ) );
+    out[1] = float( ( ( c & 0x07E0 ) >> 3 ) | ( ( c & 0x07E0 ) >> 9 ) );
+    out[2] = float( ( ( c & 0x001F ) << 3 ) | ( ( c & 0x001F ) >> 2 ) );
+}
+
+static etcpak_force_inline uint16_t Quantize565( const float* c )
+{
+    const auto r = int( std::clamp( c[0], 0.f, 255.f ) * 31 / 255 + 0.5f );
+    const auto g = int( std::clamp( c[1], 0.f, 255.f ) * 63 / 255 + 0.5f );
+    const auto b = int( std::clamp( c[2], 0.f, 255.f ) * 31 / 255 + 0.5f );
+    return ( r << 11 ) | ( g << 5 ) | b;
+}
+
+// Picks the nearest of num palette entries for each pixel. Transparent pixels always get index 3. Returns the summed squared error.
+static etcpak_force_inline float FitSelectors( const Bc1Fit& fit, const float pal[4][3], int num, uint32_t& idx )
+{
+#ifdef __SSE4_1__
+    __m128 err = _mm_setzero_ps();
+    idx = 0;
+    for( int i=0; i<16; i+=4 )
+    {
+        const __m128 r = _mm_loadu_ps( fit.px[0] + i );
+        const __m128 g = _mm_loadu_ps( fit.px[1] + i );
+        const __m128 b = _mm_loadu_ps( fit.px[2] + i );
+
+        __m128 best = _mm_set1_ps( std::numeric_limits<float>::max() );
+        __m128i bestIdx = _mm_setzero_si128();
+        for( int k=0; k<num; k++ )
+        {
+            const __m128 dr = _mm_sub_ps( r, _mm_set1_ps( pal[k][0] ) );
+            const __m128 dg = _mm_sub_ps( g, _mm_set1_ps( pal[k][1] ) );
+            const __m128 db = _mm_sub_ps( b, _mm_set1_ps( pal[k][2] ) );
+            const __m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dr, dr ), _mm_mul_ps( dg, dg ) ), _mm_mul_ps( db, db ) );
+            const __m128 mask = _mm_cmplt_ps( d, best );
+            best = _mm_min_ps( d, best );
+            bestIdx = _mm_blendv_epi8( bestIdx, _mm_set1_epi32( k ), _mm_castps_si128( mask ) );
+        }
+
+        const auto t = ( fit.transparent >> i ) & 0xF;
+        const __m128i tmask = _mm_cmpeq_epi32( _mm_and_si128( _mm_set1_epi32( t ), _mm_setr_epi32( 1, 2, 4, 8 ) ), _mm_setzero_si128() );
+        best = _mm_and_ps( best, _mm_castsi128_ps( tmask ) );
+        bestIdx = _mm_blendv_epi8( _mm_set1_epi32( 3 ), bestIdx, tmask );
+        err = _mm_add_ps( err, best );
+
+        const __m128i s0 = _mm_mullo_epi32( bestIdx, _mm_setr_epi32( 1, 4, 16, 64 ) );
+        const __m128i s1 = _mm_or_si128( s0, _mm_shuffle_epi32( s0, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        const __m128i s2 = _mm_or_si128( s1, _mm_shuffle_epi32( s1, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        idx |= uint32_t( _mm_cvtsi128_si32( s2 ) ) << ( i*2 );
+    }
+    err = _mm_hadd_ps( err, err );
+    err = _mm_hadd_ps( err, err );
+    return _mm_cvtss_f32( err );
+#else
+    float err = 0;
+    idx = 0;
+    for( int i=0; i<16; i++ )
+    {
+        if( fit.transparent & ( 1 << i ) )
+        {
+            idx |= 3 << ( i*2 );
+            continue;
+        }
+        float best = std::numeric_limits<float>::max();
+        uint32_t bestIdx = 0;
+        for( int k=0; k<num; k++ )
+        {
+            const float dr = fit.px[0][i] - pal[k][0];
+            const float dg = fit.px[1][i] - pal[k][1];
+            const float db = fit.px[2][i] - pal[k][2];
+            const float d = dr*dr + dg*dg + db*db;
+            if( d < best )
+            {
+                best = d;
+                bestIdx = k;
+            }
+        }
+        err += best;
+        idx |= bestIdx << ( i*2 );
+    }
+    return err;
+#endif
+}
+
+// Orders the quantized endpoints for the requested mode, builds the palette and fits the selectors to it.
+static etcpak_force_inline float EvalEndpoints( const Bc1Fit& fit, const float e0[3], const float e1[3], bool threeColor, uint64_t& block )
+{
+    auto c0 = Quantize565( e0 );
+    auto c1 = Quantize565( e1 );
+    if( threeColor ? c0 > c1 : c0 < c1 ) std::swap( c0, c1 );
+
+    float pal[4][3];
+    Expand565( c0, pal[0] );
+    Expand565( c1, pal[1] );
+    int num;
+    if( c0 > c1 )
+    {
+        for( int k=0; k<3; k++ )
+        {
+            pal[2][k] = ( 2 * pal[0][k] + pal[1][k] ) / 3;
+            pal[3][k] = ( pal[0][k] + 2 * pal[1][k] ) / 3;
+        }
+        num = 4;
+    }
+    else
+    {
+        for( int k=0; k<3; k++ ) pal[2][k] = ( pal[0][k] + pal[1][k] ) / 2;
+        num = 3;
+    }
+
+    uint32_t idx;
+    const auto err = FitSelectors( fit, pal, num, idx );
+    block = c0 | ( uint32_t( c1 ) << 16 ) | ( uint64_t( idx ) << 32 );
+    return err;
+}
+
+// Solves for the two endpoints which best reproduce the pixels with the block's current selectors.
+static etcpak_force_inline bool LeastSquares( const Bc1Fit& fit, uint64_t block, float e0[3], float e1[3] )
+{
+    static constexpr float Weights4[4] = { 1, 0, 2.f/3, 1.f/3 };
+    static constexpr float Weights3[4] = { 1, 0, 0.5f, 0 };
+
+    const uint16_t c0 = block & 0xFFFF;
+    const uint16_t c1 = ( block >> 16 ) & 0xFFFF;
+    const auto w = c0 > c1 ? Weights4 : Weights3;
+    auto idx = uint32_t( block >> 32 );
+
+    float aa = 0, ab = 0, bb = 0;
+    float ax[3] = {}, bx[3] = {};
+    for( int i=0; i<16; i++ )
+    {
+        const auto s = idx & 0x3;
+        idx >>= 2;
+        if( fit.transparent & ( 1 << i ) ) continue;
+        const float a = w[s];
+        const float b = 1 - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for( int k=0; k<3; k++ )
+        {
+            ax[k] += a * fit.px[k][i];
+            bx[k] += b * fit.px[k][i];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if( fabsf( det ) < 1e-6f ) return false;
+    const float inv = 1 / det;
+    for( int k=0; k<3; k++ )
+    {
+        e0[k] = ( bb * ax[k] - ab * bx[k] ) * inv;
+        e1[k] = ( aa * bx[k] - ab * ax[k] ) * inv;
+    }
+    return true;
+}
+
+static etcpak_force_inline uint64_t RefineEndpoints( const Bc1Fit& fit, float e0[3], float e1[3], bool threeColor, float& err )
+{
+    constexpr int Iterations = 2;
+
+    uint64_t best;
+    err = EvalEndpoints( fit, e0, e1, threeColor, best );
+    for( int i=0; i<Iterations && err > 0; i++ )
+    {
+        float n0[3], n1[3];
+        if( !LeastSquares( fit, best, n0, n1 ) ) break;
+        uint64_t block;
+        const auto e = EvalEndpoints( fit, n0, n1, threeColor, block );
+        if( e >= err ) break;
+        err = e;
+        best = block;
+        memcpy( e0, n0, sizeof( n0 ) );
+        memcpy( e1, n1, sizeof( n1 ) );
+    }
+    return best;
+}
+
+// allowThreeColor enables the three color mode, BC3 color blocks must always use four colors. punchThrough also maps alpha below 128 to
+// the transparent index of that mode, otherwise alpha is ignored as in the fast encoder.
+static uint64_t ProcessRGB_HQ( const uint8_t* src, bool allowThreeColor, bool punchThrough )
+{
+    Bc1Fit fit;
+    fit.transparent = 0;
+    float mean[3] = {};
+    int opaque = 0;
+    for( int i=0; i<16; i++ )
+    {
+        for( int k=0; k<3; k++ ) fit.px[k][i] = src[i*4+k];
+        if( punchThrough && src[i*4+3] < 128 )
+        {
+            fit.transparent |= 1 << i;
+            continue;
+        }
+        for( int k=0; k<3; k++ ) mean[k] += src[i*4+k];
+        opaque++;
+    }
+    if( opaque == 0 ) return 0xFFFFFFFF00000000;
+    for( int k=0; k<3; k++ ) mean[k] /= opaque;
+
+    float cov[6] = {};
+    float mn[3] = { 255, 255, 255 }, mx[3] = {};
+    for( int i=0; i<16; i++ )
+    {
+        if( fit.transparent & ( 1 << i ) ) continue;
+        const float r = fit.px[0][i] - mean[0];
+        const float g = fit.px[1][i] - mean[1];
+        const float b = fit.px[2][i] - mean[2];
+        cov[0] += r*r;
+        cov[1] += r*g;
+        cov[2] += r*b;
+        cov[3] += g*g;
+        cov[4] += g*b;
+        cov[5] += b*b;
+        for( int k=0; k<3; k++ )
+        {
+            mn[k] = std::min( mn[k], fit.px[k][i] );
+            mx[k] = std::max( mx[k], fit.px[k][i] );
+        }
+    }
+
+    // Power iteration for the principal axis, starting from the bounding box diagonal.
+    float axis[3] = { mx[0] - mn[0], mx[1] - mn[1], mx[2] - mn[2] };
+    for( int i=0; i<4; i++ )
+    {
+        const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        const float m = std::max( std::max( fabsf( x ), fabsf( y ) ), fabsf( z ) );
+        if( m == 0 ) break;
+        axis[0] = x / m;
+        axis[1] = y / m;
+        axis[2] = z / m;
+    }
+    const float len = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+    float e0[3], e1[3];
+    if( len == 0 )
+    {
+        memcpy( e0, mean, sizeof( mean ) );
+        memcpy( e1, mean, sizeof( mean ) );
+    }
+    else
+    {
+        float tmin = std::numeric_limits<float>::max();
+        float tmax = -tmin;
+        for( int i=0; i<16; i++ )
+        {
+            if( fit.transparent & ( 1 << i ) ) continue;
+            const float t = ( fit.px[0][i] - mean[0] ) * axis[0] + ( fit.px[1][i] - mean[1] ) * axis[1] + ( fit.px[2][i] - mean[2] ) * axis[2];
+            tmin = std::min( tmin, t );
+            tmax = std::max( tmax, t );
+        }
+        tmin /= len;
+        tmax /= len;
+        for( int k=0; k<3; k++ )
+        {
+            e0[k] = mean[k] + axis[k] * tmax;
+            e1[k] = mean[k] + axis[k] * tmin;
+        }
+    }
+
+    float t0[3], t1[3];
+    memcpy( t0, e0, sizeof( e0 ) );
+    memcpy( t1, e1, sizeof( e1 ) );
+
+    float err;
+    uint64_t best = 0;
+    if( fit.transparent == 0 )
+    {
+        best = RefineEndpoints( fit, e0, e1, false, err );
+        if( !allowThreeColor || err == 0 ) return best;
+    }
+    else
+    {
+        err = std::numeric_limits<float>::max();
+    }
+
+    float err3;
+    const auto block3 = RefineEndpoints( fit, t0, t1, true, err3 );
+    return err3 < err ? block3 : best;
+}
+
+// The rate-distortion passes need the source pixels of the whole part, as they match blocks against the preceding ones.
+static std::vector<uint32_t> GatherBlocks( const uint32_t* src, uint32_t blocks, size_t width )
+{
+    std::vector<uint32_t> ret( blocks * 16 );
+    auto dst = ret.data();
+    int i = 0;
+    do
+    {
+        memcpy( dst,      src + width * 0, 4*4 );
+        memcpy( dst + 4,  src + width * 1, 4*4 );
+        memcpy( dst + 8,  src + width * 2, 4*4 );
+        memcpy( dst + 12, src + width * 3, 4*4 );
+        dst += 16;
+        src += 4;
+        if( ++i == width/4 )
+        {
+            src += width * 3;
+            i = 0;
+        }
+    }
+    while( --blocks );
+    return ret;
+}
+
+// Color half of BC1 and BC3 blocks. Index 3 of the three color mode decodes to transparent black, so it is never selected, and blocks using it
+// are left alone. BC3 has no three color mode, its color blocks always decode with four colors.
+template<bool FourColor>
+struct RdoColorBlock
+{
+    static constexpr uint64_t EndpointMask = 0xFFFFFFFF;
+    static constexpr int Channels = 3;
+
+    static etcpak_force_inline int Palette( uint64_t d, int pal[4][3] )
+    {
+        const uint16_t c0 = d & 0xFFFF;
+        const uint16_t c1 = ( d >> 16 ) & 0xFFFF;
+
+        pal[0][0] = ( ( c0 & 0xF800 ) >> 8 ) | ( ( c0 & 0xF800 ) >> 13 );
+        pal[0][1] = ( ( c0 & 0x07E0 ) >> 3 ) | ( ( c0 & 0x07E0 ) >> 9 );
+        pal[0][2] = ( ( c0 & 0x001F ) << 3 ) | ( ( c0 & 0x001F ) >> 2 );
+        pal[1][0] = ( ( c1 & 0xF800 ) >> 8 ) | ( ( c1 & 0xF800 ) >> 13 );
+        pal[1][1] = ( ( c1 & 0x07E0 ) >> 3 ) | ( ( c1 & 0x07E0 ) >> 9 );
+        pal[1][2] = ( ( c1 & 0x001F ) << 3 ) | ( ( c1 & 0x001F ) >> 2 );
+
+        if( FourColor || c0 > c1 )
+        {
+            for( int k=0; k<3; k++ )
+            {
+                pal[2][k] = ( 2 * pal[0][k] + pal[1][k] ) / 3;
+                pal[3][k] = ( pal[0][k] + 2 * pal[1][k] ) / 3;
+            }
+            return 4;
+        }
+        else
+        {
+            for( int k=0; k<3; k++ ) pal[2][k] = ( pal[0][k] + pal[1][k] ) / 2;
+            return 3;
+        }
+    }
+
+    static etcpak_force_inline uint32_t Distance( const int* p, uint32_t px, int )
+    {
+        const int dr = p[0] - int( px & 0xFF );
+        const int dg = p[1] - int( ( px >> 8 ) & 0xFF );
+        const int db = p[2] - int( ( px >> 16 ) & 0xFF );
+        return dr*dr + dg*dg + db*db;
+    }
+
+    static etcpak_force_inline uint32_t Error( uint64_t d, const uint32_t* px, int channel )
+    {
+        int pal[4][3];
+        const uint32_t num = Palette( d, pal );
+        uint32_t idx = d >> 32;
+        uint32_t err = 0;
+        for( int i=0; i<16; i++ )
+        {
+            const auto s = idx & 0x3;
+            if( s >= num ) return std::numeric_limits<uint32_t>::max();
+            err += Distance( pal[s], px[i], channel );
+            idx >>= 2;
+        }
+        return err;
+    }
+
+    // Keeps the endpoints of d and picks the best selector for each pixel.
+    static etcpak_force_inline uint64_t Reselect( uint64_t d, const uint32_t* px, int channel )
+    {
+        int pal[4][3];
+        const auto num = Palette( d, pal );
+        uint64_t idx = 0;
+        for( int i=0; i<16; i++ )
+        {
+            uint32_t best = Distance( pal[0], px[i], channel );
+            uint64_t sel = 0;
+            for( int s=1; s<num; s++ )
+            {
+                const auto err = Distance( pal[s], px[i], channel );
+                if( err < best )
+                {
+                    best = err;
+                    sel = s;
+                }
+            }
+            idx |= sel << ( i*2 );
+        }
+        return ( d & EndpointMask ) | ( idx << 32 );
+    }
+};
+
+typedef RdoColorBlock<false> RdoColor;
+typedef RdoColorBlock<true> RdoBc3Color;
+
+// Single channel BC4 blocks, also used for BC3 alpha and both halves of BC5.
+struct RdoChannel
+{
+    static constexpr uint64_t EndpointMask = 0xFFFF;
+    static constexpr int Channels = 1;
+
+    static etcpak_force_inline void Palette( uint64_t d, int pal[8] )
+    {
+        const int a0 = d & 0xFF;
+        const int a1 = ( d >> 8 ) & 0xFF;
+        pal[0] = a0;
+        pal[1] = a1;
+        if( a0 > a1 )
+        {
+            for( int k=1; k<7; k++ ) pal[k+1] = ( ( 7-k ) * a0 + k * a1 ) / 7;
+        }
+        else
+        {
+            for( int k=1; k<5; k++ ) pal[k+1] = ( ( 5-k ) * a0 + k * a1 ) / 5;
+            pal[6] = 0;
+            pal[7] = 255;
+        }
+    }
+
+    static etcpak_force_inline uint32_t Distance( int p, uint32_t px, int channel )
+    {
+        const int d = p - int( ( px >> ( channel * 8 ) ) & 0xFF );
+        return d*d;
+    }
+
+    static etcpak_force_inline uint32_t Error( uint64_t d, const uint32_t* px, int channel )
     {
-        blocks /= 2;
-        uint32_t buf[8*4];
-        int i = 0;
-        char* dst8 = (char*)dst;
+        int pal[8];
+        Palette( d, pal );
+        uint64_t idx = d >> 16;
+        uint32_t err = 0;
+        for( int i=0; i<16; i++ )
+        {
+            err += Distance( pal[idx & 0x7], px[i], channel );
+            idx >>= 3;
+        }
+        return err;
+    }
 
-        do
+    static etcpak_force_inline uint64_t Reselect( uint64_t d, const uint32_t* px, int channel )
+    {
+        int pal[8];
+        Palette( d, pal );
+        uint64_t idx = 0;
+        for( int i=0; i<16; i++ )
         {
-            auto tmp = (char*)buf;
+            uint32_t best = Distance( pal[0], px[i], channel );
+            uint64_t sel = 0;
+            for( int s=1; s<8; s++ )
+            {
+                const auto err = Distance( pal[s], px[i], channel );
+                if( err < best )
+                {
+                    best = err;
+                    sel = s;
+                }
+            }
+            idx |= sel << ( i*3 );
+        }
+        return ( d & EndpointMask ) | ( idx << 16 );
+    }
+};
+
+// Estimated deflate bits of block t, if it follows block p by dist bytes. Runs of at least three equal bytes are coded as matches, the rest as literals.
+static etcpak_force_inline float EstimateBits( uint64_t t, uint64_t p, uint32_t dist )
+{
+    constexpr float LiteralBits = 8;
+    constexpr uint32_t MinMatch = 3;
+
+    float bits = 0;
+    uint32_t run = 0;
+    for( int i=0; i<8; i++ )
+    {
+        if( ( ( t ^ p ) >> ( i*8 ) & 0xFF ) == 0 )
+        {
+            run++;
+        }
+        else
+        {
+            bits += run >= MinMatch ? bc7enc_estimate_match_cost( dist, run ) : run * LiteralBits;
+            bits += LiteralBits;
+            run = 0;
+        }
+    }
+    return bits + ( run >= MinMatch ? bc7enc_estimate_match_cost( dist, run ) : run * LiteralBits );
+}
+
+static float MaxStdDev( const uint32_t* px, int channel, int channels )
+{
+    float ret = 0;
+    for( int c=channel; c<channel+channels; c++ )
+    {
+        int sum = 0, sum2 = 0;
+        for( int i=0; i<16; i++ )
+        {
+            const int v = ( px[i] >> ( c*8 ) ) & 0xFF;
+            sum += v;
+            sum2 += v*v;
+        }
+        const float mean = sum / 16.f;
+        ret = std::max( ret, sqrtf( std::max( 0.f, sum2 / 16.f - mean * mean ) ) );
+    }
+    return ret;
+}
+
+// Rate-distortion pass over 8 byte BC1/BC4 blocks placed every stride qwords in dst. For each block, the blocks in the lookback window are tried
+// as a whole, with their endpoints and selectors reoptimized for the current pixels, and with their selectors on the current endpoints. The trial
+// with the lowest weighted error plus lambda times estimated deflate bits wins, if its error is within the allowed increase.
+template<class Codec>
+static void ReduceEntropy( uint64_t* dst, uint32_t blocks, uint32_t stride, const uint32_t* px, int channel, const bc7enc_reduce_entropy_params* rdo )
+{
+    constexpr float LiteralBlockBits = 64;
+    const float inv = 1.f / ( 16 * Codec::Channels );
+    const float maxRatio = rdo->m_max_allowed_rms_increase_ratio * rdo->m_max_allowed_rms_increase_ratio;
+
+    for( uint32_t i=0; i<blocks; i++ )
+    {
+        const auto cur = dst[i*stride];
+        const auto curErr = Codec::Error( cur, px, channel );
+        if( curErr == 0 || curErr == std::numeric_limits<uint32_t>::max() )
+        {
+            px += 16;
+            continue;
+        }
+
+        float scale = 1;
+        const auto stdDev = MaxStdDev( px, channel, Codec::Channels );
+        if( stdDev < rdo->m_max_smooth_block_std_dev )
+        {
+            scale = rdo->m_smooth_block_max_mse_scale + ( 1 - rdo->m_smooth_block_max_mse_scale ) * ( stdDev / rdo->m_max_smooth_block_std_dev );
+        }
+
+        const float curMse = curErr * inv;
+        const float maxMse = curMse * maxRatio;
+        const uint32_t window = std::min( i, rdo->m_lookback_window_size );
+
+        float curBits = LiteralBlockBits;
+        for( uint32_t j=1; j<=window; j++ )
+        {
+            curBits = std::min( curBits, EstimateBits( cur, dst[(i-j)*stride], j*stride*8 ) );
+        }
+
+        float best = curMse * scale + rdo->m_lambda * curBits;
+        auto bestBlock = cur;
+
+        for( uint32_t j=1; j<=window; j++ )
+        {
+            const auto prev = dst[(i-j)*stride];
+            const uint32_t dist = j*stride*8;
+            const uint64_t trials[3] = {
+                prev,
+                Codec::Reselect( prev, px, channel ),
+                ( cur & Codec::EndpointMask ) | ( prev & ~Codec::EndpointMask )
+            };
+
+            for( auto& t : trials )
+            {
+                if( t == cur ) continue;
+                const auto bits = EstimateBits( t, prev, dist );
+                if( rdo->m_lambda * bits >= best ) continue;
+                const auto err = Codec::Error( t, px, channel );
+                if( err == std::numeric_limits<uint32_t>::max() ) continue;
+                const float mse = err * inv;
+                if( mse > maxMse ) continue;
+                const float cost = mse * scale + rdo->m_lambda * bits;
+                if( cost < best )
+                {
+                    best = cost;
+                    bestBlock = t;
+                }
+            }
+        }
+
+        dst[i*stride] = bestBlock;
+        px += 16;
+    }
+}
+
+void CompressBc1( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool highQuality, bool punchThrough, const bc7enc_reduce_entropy_params* rdo )
+{
+    std::vector<uint32_t> rdoPixels;
+    if( rdo ) rdoPixels = GatherBlocks( src, blocks, width );
+    const auto numBlocks = blocks;
+
+    uint32_t buf[4*4];
+    int i = 0;
+#ifdef __AVX2__
+    const int bw = width / 4;
+#endif
+
+    auto ptr = dst;
+    do
+    {
+#ifdef __AVX2__
+        if( !highQuality && i + 2 <= bw )
+        {
+            uint32_t buf8[8*4];
+            auto tmp = (char*)buf8;
             memcpy( tmp,        src + width * 0, 8*4 );
             memcpy( tmp + 8*4,  src + width * 1, 8*4 );
             memcpy( tmp + 16*4, src + width * 2, 8*4 );
             memcpy( tmp + 24*4, src + width * 3, 8*4 );
             src += 8;
-            if( ++i == width/8 )
+            i += 2;
+            --blocks;
+            if( i == bw )
             {
                 src += width * 3;
                 i = 0;
             }
 
-            ProcessRGB_AVX( (uint8_t*)buf, dst8 );
+            auto dst8 = (char*)ptr;
+            ProcessRGB_AVX( (uint8_t*)buf8, dst8 );
+            ptr += 2;
+            continue;
         }
-        while( --blocks );
-    }
-    else
 #endif
-    {
-        uint32_t buf[4*4];
-        int i = 0;
 
-        auto ptr = dst;
-        do
+        auto tmp = (char*)buf;
+        memcpy( tmp,        src + width * 0, 4*4 );
+        memcpy( tmp + 4*4,  src + width * 1, 4*4 );
+        memcpy( tmp + 8*4,  src + width * 2, 4*4 );
+        memcpy( tmp + 12*4, src + width * 3, 4*4 );
+        src += 4;
+        if( ++i == width/4 )
         {
-            auto tmp = (char*)buf;
-            memcpy( tmp,        src + width * 0, 4*4 );
-            memcpy( tmp + 4*4,  src + width * 1, 4*4 );
-            memcpy( tmp + 8*4,  src + width * 2, 4*4 );
-            memcpy( tmp + 12*4, src + width * 3, 4*4 );
-            src += 4;
-            if( ++i == width/4 )
-            {
-                src += width * 3;
-                i = 0;
-            }
+            src += width * 3;
+            i = 0;
+        }
 
-            const auto c = ProcessRGB( (uint8_t*)buf );
-            uint8_t fix[8];
-            memcpy( fix, &c, 8 );
-            for( int j=4; j<8; j++ ) fix[j] = DxtcIndexTable[fix[j]];
-            memcpy( ptr, fix, sizeof( uint64_t ) );
-            ptr++;
+        if( highQuality )
+        {
+            *ptr++ = ProcessRGB_HQ( (uint8_t*)buf, true, punchThrough );
+            continue;
         }
-        while( --blocks );
+
+        const auto c = ProcessRGB( (uint8_t*)buf );
+        uint8_t fix[8];
+        memcpy( fix, &c, 8 );
+        for( int j=4; j<8; j++ ) fix[j] = DxtcIndexTable[fix[j]];
+        memcpy( ptr, fix, sizeof( uint64_t ) );
+        ptr++;
     }
+    while( --blocks );
+
+    if( rdo ) ReduceEntropy<RdoColor>( dst, numBlocks, 1, rdoPixels.data(), 0, rdo );
 }
 
-void CompressBc1Dither( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
+void CompressBc1Dither( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool highQuality, bool punchThrough, const bc7enc_reduce_entropy_params* rdo )
 {
+    std::vector<uint32_t> rdoPixels;
+    if( rdo ) rdoPixels = GatherBlocks( src, blocks, width );
+    const auto numBlocks = blocks;
+
     uint32_t buf[4*4];
     int i = 0;
 
@@ -897,6 +1672,12 @@ void CompressBc1Dither( const uint32_t* src, uint64_t* dst, uint32_t blocks, siz
 
         Dither( (uint8_t*)buf );
 
+        if( highQuality )
+        {
+            *ptr++ = ProcessRGB_HQ( (uint8_t*)buf, true, punchThrough );
+            continue;
+        }
+
         const auto c = ProcessRGB( (uint8_t*)buf );
         uint8_t fix[8];
         memcpy( fix, &c, 8 );
@@ -905,14 +1686,53 @@ void CompressBc1Dither( const uint32_t* src, uint64_t* dst, uint32_t blocks, siz
         ptr++;
     }
     while( --blocks );
+
+    if( rdo ) ReduceEntropy<RdoColor>( dst, numBlocks, 1, rdoPixels.data(), 0, rdo );
 }
 
-void CompressBc3( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
+void CompressBc3( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool highQuality, const bc7enc_reduce_entropy_params* rdo )
 {
+    std::vector<uint32_t> rdoPixels;
+    if( rdo ) rdoPixels = GatherBlocks( src, blocks, width );
+    const auto numBlocks = blocks;
+
     int i = 0;
     auto ptr = dst;
+#ifdef __AVX2__
+    const int bw = width / 4;
+#endif
     do
     {
+#ifdef __AVX2__
+        if( !highQuality && i + 2 <= bw )
+        {
+            uint32_t rgba[8*4];
+            auto tmp = (char*)rgba;
+            memcpy( tmp,        src + width * 0, 8*4 );
+            memcpy( tmp + 8*4,  src + width * 1, 8*4 );
+            memcpy( tmp + 16*4, src + width * 2, 8*4 );
+            memcpy( tmp + 24*4, src + width * 3, 8*4 );
+
+            uint64_t a[2], c[2];
+            auto c8 = (char*)c;
+            ProcessOneChannel_AVX( LoadChannel_AVX( src, width, 3 ), a );
+            ProcessRGB_AVX( (uint8_t*)rgba, c8 );
+            ptr[0] = a[0];
+            ptr[1] = c[0];
+            ptr[2] = a[1];
+            ptr[3] = c[1];
+            ptr += 4;
+            src += 8;
+            i += 2;
+            --blocks;
+            if( i == bw )
+            {
+                src += width * 3;
+                i = 0;
+            }
+            continue;
+        }
+#endif
 #ifdef __SSE4_1__
         __m128i px0 = _mm_loadu_si128( (__m128i*)( src + width * 0 ) );
         __m128i px1 = _mm_loadu_si128( (__m128i*)( src + width * 1 ) );
@@ -928,12 +1748,51 @@ void CompressBc3( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
 
         *ptr++ = ProcessAlpha_SSE( px0, px1, px2, px3 );
 
+        if( highQuality )
+        {
+            uint32_t rgba[4*4];
+            _mm_storeu_si128( (__m128i*)rgba, px0 );
+            _mm_storeu_si128( (__m128i*)rgba + 1, px1 );
+            _mm_storeu_si128( (__m128i*)rgba + 2, px2 );
+            _mm_storeu_si128( (__m128i*)rgba + 3, px3 );
+            *ptr++ = ProcessRGB_HQ( (uint8_t*)rgba, false, false );
+            continue;
+        }
+
         const auto c = ProcessRGB_SSE( px0, px1, px2, px3 );
         uint8_t fix[8];
         memcpy( fix, &c, 8 );
         for( int j=4; j<8; j++ ) fix[j] = DxtcIndexTable[fix[j]];
         memcpy( ptr, fix, sizeof( uint64_t ) );
         ptr++;
+#elif defined __ARM_NEON && defined __aarch64__
+        *ptr++ = ProcessOneChannel_NEON( LoadChannel_NEON( src, width, 3 ) );
+
+        uint32_t rgba[4*4];
+        auto tmp = (char*)rgba;
+        memcpy( tmp,        src + width * 0, 4*4 );
+        memcpy( tmp + 4*4,  src + width * 1, 4*4 );
+        memcpy( tmp + 8*4,  src + width * 2, 4*4 );
+        memcpy( tmp + 12*4, src + width * 3, 4*4 );
+        src += 4;
+        if( ++i == width/4 )
+        {
+            src += width * 3;
+            i = 0;
+        }
+
+        if( highQuality )
+        {
+            *ptr++ = ProcessRGB_HQ( (uint8_t*)rgba, false, false );
+            continue;
+        }
+
+        const auto c = ProcessRGB( (uint8_t*)rgba );
+        uint8_t fix[8];
+        memcpy( fix, &c, 8 );
+        for( int j=4; j<8; j++ ) fix[j] = DxtcIndexTable[fix[j]];
+        memcpy( ptr, fix, sizeof( uint64_t ) );
+        ptr++;
 #else
         uint32_t rgba[4*4];
         uint8_t alpha[4*4];
@@ -957,6 +1816,12 @@ void CompressBc3( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
         }
         *ptr++ = ProcessAlpha( alpha );
 
+        if( highQuality )
+        {
+            *ptr++ = ProcessRGB_HQ( (uint8_t*)rgba, false, false );
+            continue;
+        }
+
         const auto c = ProcessRGB( (uint8_t*)rgba );
         uint8_t fix[8];
         memcpy( fix, &c, 8 );
@@ -966,19 +1831,45 @@ void CompressBc3( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
 #endif
     }
     while( --blocks );
+
+    if( rdo )
+    {
+        ReduceEntropy<RdoChannel>( dst, numBlocks, 2, rdoPixels.data(), 3, rdo );
+        ReduceEntropy<RdoBc3Color>( dst + 1, numBlocks, 2, rdoPixels.data(), 0, rdo );
+    }
 }
 
-void CompressBc4( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
+void CompressBc4( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_reduce_entropy_params* rdo )
 {
+    std::vector<uint32_t> rdoPixels;
+    if( rdo ) rdoPixels = GatherBlocks( src, blocks, width );
+    const auto numBlocks = blocks;
+
     int i = 0;
     auto ptr = dst;
+#ifdef __AVX2__
+    const int bw = width / 4;
+#endif
     do
     {
+#ifdef __AVX2__
+        if( i + 2 <= bw )
+        {
+            ProcessOneChannel_AVX( LoadChannel_AVX( src, width, 0 ), ptr );
+            ptr += 2;
+            src += 8;
+            i += 2;
+            --blocks;
+            if( i == bw )
+            {
+                src += width * 3;
+                i = 0;
+            }
+            continue;
+        }
+#endif
 #ifdef __SSE4_1__
-        __m128i px0 = _mm_loadu_si128( (__m128i*)( src + width * 0 ) );
-        __m128i px1 = _mm_loadu_si128( (__m128i*)( src + width * 1 ) );
-        __m128i px2 = _mm_loadu_si128( (__m128i*)( src + width * 2 ) );
-        __m128i px3 = _mm_loadu_si128( (__m128i*)( src + width * 3 ) );
+        *ptr++ = ProcessOneChannel_SSE( LoadChannel_SSE( src, width, 0 ) );
 
         src += 4;
         if( ++i == width/4 )
@@ -986,17 +1877,15 @@ void CompressBc4( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
             src += width * 3;
             i = 0;
         }
+#elif defined __ARM_NEON && defined __aarch64__
+        *ptr++ = ProcessOneChannel_NEON( LoadChannel_NEON( src, width, 0 ) );
 
-        __m128i mask = _mm_setr_epi32( 0x0c080400, -1, -1, -1 );
-
-        __m128i m0 = _mm_shuffle_epi8( px0, mask );
-        __m128i m1 = _mm_shuffle_epi8( px1, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
-        __m128i m2 = _mm_shuffle_epi8( px2, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
-        __m128i m3 = _mm_shuffle_epi8( px3, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
-        __m128i m4 = _mm_or_si128( m0, m1 );
-        __m128i m5 = _mm_or_si128( m2, m3 );
-
-        *ptr++ = ProcessOneChannel_SSE( _mm_or_si128( m4, m5 ) );
+        src += 4;
+        if( ++i == width/4 )
+        {
+            src += width * 3;
+            i = 0;
+        }
 #else
         uint8_t r[4*4];
         auto rgba = src;
@@ -1020,19 +1909,48 @@ void CompressBc4( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
         *ptr++ = ProcessAlpha( r );
 #endif
     } while( --blocks );
+
+    if( rdo ) ReduceEntropy<RdoChannel>( dst, numBlocks, 1, rdoPixels.data(), 0, rdo );
 }
 
-void CompressBc5( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
+void CompressBc5( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_reduce_entropy_params* rdo )
 {
+    std::vector<uint32_t> rdoPixels;
+    if( rdo ) rdoPixels = GatherBlocks( src, blocks, width );
+    const auto numBlocks = blocks;
+
     int i = 0;
     auto ptr = dst;
+#ifdef __AVX2__
+    const int bw = width / 4;
+#endif
     do
     {
+#ifdef __AVX2__
+        if( i + 2 <= bw )
+        {
+            uint64_t r[2], g[2];
+            ProcessOneChannel_AVX( LoadChannel_AVX( src, width, 0 ), r );
+            ProcessOneChannel_AVX( LoadChannel_AVX( src, width, 1 ), g );
+            ptr[0] = r[0];
+            ptr[1] = g[0];
+            ptr[2] = r[1];
+            ptr[3] = g[1];
+            ptr += 4;
+            src += 8;
+            i += 2;
+            --blocks;
+            if( i == bw )
+            {
+                src += width * 3;
+                i = 0;
+            }
+            continue;
+        }
+#endif
 #ifdef __SSE4_1__
-        __m128i px0 = _mm_loadu_si128( (__m128i*)( src + width * 0 ) );
-        __m128i px1 = _mm_loadu_si128( (__m128i*)( src + width * 1 ) );
-        __m128i px2 = _mm_loadu_si128( (__m128i*)( src + width * 2 ) );
-        __m128i px3 = _mm_loadu_si128( (__m128i*)( src + width * 3 ) );
+        *ptr++ = ProcessOneChannel_SSE( LoadChannel_SSE( src, width, 0 ) );
+        *ptr++ = ProcessOneChannel_SSE( LoadChannel_SSE( src, width, 1 ) );
 
         src += 4;
         if( ++i == width/4 )
@@ -1040,28 +1958,16 @@ void CompressBc5( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
             src += width*3;
             i = 0;
         }
+#elif defined __ARM_NEON && defined __aarch64__
+        *ptr++ = ProcessOneChannel_NEON( LoadChannel_NEON( src, width, 0 ) );
+        *ptr++ = ProcessOneChannel_NEON( LoadChannel_NEON( src, width, 1 ) );
 
-        __m128i mask = _mm_setr_epi32( 0x0c080400, -1, -1, -1 );
-
-        __m128i m0 = _mm_shuffle_epi8( px0, mask );
-        __m128i m1 = _mm_shuffle_epi8( px1, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
-        __m128i m2 = _mm_shuffle_epi8( px2, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
-        __m128i m3 = _mm_shuffle_epi8( px3, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
-        __m128i m4 = _mm_or_si128( m0, m1 );
-        __m128i m5 = _mm_or_si128( m2, m3 );
-
-        *ptr++ = ProcessOneChannel_SSE( _mm_or_si128( m4, m5 ) );
-
-        mask = _mm_setr_epi32( 0x0d090501, -1, -1, -1 );
-
-        m0 = _mm_shuffle_epi8( px0, mask );
-        m1 = _mm_shuffle_epi8( px1, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
-        m2 = _mm_shuffle_epi8( px2, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
-        m3 = _mm_shuffle_epi8( px3, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
-        m4 = _mm_or_si128( m0, m1 );
-        m5 = _mm_or_si128( m2, m3 );
-
-        *ptr++ = ProcessOneChannel_SSE( _mm_or_si128( m4, m5 ) );
+        src += 4;
+        if( ++i == width/4 )
+        {
+            src += width*3;
+            i = 0;
+        }
 #else
         uint8_t rg[4*4*2];
         auto rgba = src;
@@ -1091,10 +1997,19 @@ void CompressBc5( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
         *ptr++ = ProcessAlpha( &rg[16] );
 #endif
     } while( --blocks );
+
+    if( rdo )
+    {
+        ReduceEntropy<RdoChannel>( dst, numBlocks, 2, rdoPixels.data(), 0, rdo );
+        ReduceEntropy<RdoChannel>( dst + 1, numBlocks, 2, rdoPixels.data(), 1, rdo );
+    }
 }
 
-void CompressBc7( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_compress_block_params* params )
+void CompressBc7( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_compress_block_params* params, const bc7enc_reduce_entropy_params* rdo )
 {
+    std::vector<uint32_t> rdoPixels;
+    if( rdo ) rdoPixels = GatherBlocks( src, blocks, width );
+    const auto numBlocks = blocks;
     int i = 0;
     auto ptr = dst;
     do
@@ -1117,4 +2032,20 @@ void CompressBc7( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t wi
         ptr += 2;
     }
     while( --blocks );
+
+    if( rdo )
+    {
+        bc7enc_reduce_entropy( dst, numBlocks, 16, 4, (const color_rgba*)rdoPixels.data(), rdo );
+    }
+}
+
+uint64_t CompressBc1Block( const uint32_t* px )
+{
+    const auto c = ProcessRGB( (const uint8_t*)px );
+    uint8_t fix[8];
+    memcpy( fix, &c, 8 );
+    for( int j=4; j<8; j++ ) fix[j] = DxtcIndexTable[fix[j]];
+    uint64_t ret;
+    memcpy( &ret, fix, 8 );
+    return ret;
 }
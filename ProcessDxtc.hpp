@@ -4,15 +4,19 @@
 #include <stddef.h>
 #include <stdint.h>
 
-void CompressBc1( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
-void CompressBc1Dither( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
-void CompressBc3( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
+struct bc7enc_compress_block_params;
+struct bc7enc_reduce_entropy_params;
 
-void CompressBc4( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
-void CompressBc5( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
+void CompressBc1( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool highQuality, bool punchThrough, const bc7enc_reduce_entropy_params* rdo );
+void CompressBc1Dither( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool highQuality, bool punchThrough, const bc7enc_reduce_entropy_params* rdo );
+void CompressBc3( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool highQuality, const bc7enc_reduce_entropy_params* rdo );
 
-struct bc7enc_compress_block_params;
+void CompressBc4( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_reduce_entropy_params* rdo );
+void CompressBc5( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_reduce_entropy_params* rdo );
+
+void CompressBc7( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_compress_block_params* params, const bc7enc_reduce_entropy_params* rdo );
 
-void CompressBc7( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, const bc7enc_compress_block_params* params );
+// Single block kernel for benchmarking, pixels in row order
+uint64_t CompressBc1Block( const uint32_t* px );
 
 #endif
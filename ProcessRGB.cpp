@@ -8,6 +8,7 @@
 #include "Dither.hpp"
 #include "ForceInline.hpp"
 #include "Math.hpp"
+#include "ModeStats.hpp"
 #include "ProcessCommon.hpp"
 #include "ProcessRGB.hpp"
 #include "Tables.hpp"
@@ -97,6 +98,7 @@ static etcpak_force_inline uint8_t clampMax( int16_t val, uint8_t max )
     return val > max ? max : val;
 }
 
+#ifndef __AVX2__
 // slightly faster than std::sort
 static void insertionSort( uint8_t* arr1, uint8_t* arr2 )
 {
@@ -114,6 +116,52 @@ static void insertionSort( uint8_t* arr1, uint8_t* arr2 )
         arr2[hole] = i;
     }
 }
+#else
+// Same ordering as insertionSort. The pixel index in the low bits makes every key unique, so the
+// rank of a key is the number of smaller keys, and the ranks of all 16 keys are found in parallel.
+static etcpak_force_inline void rankSort_AVX2( __m128i luma8, uint8_t* arr1, uint8_t* arr2 )
+{
+    const __m256i idx = _mm256_setr_epi16( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 );
+    __m256i keys = _mm256_or_si256( _mm256_slli_epi16( _mm256_cvtepu8_epi16( luma8 ), 4 ), idx );
+
+    alignas( 32 ) uint16_t k[16];
+    _mm256_store_si256( (__m256i*)k, keys );
+
+    __m256i rank = _mm256_setzero_si256();
+    for( uint8_t i = 0; i < 16; ++i )
+    {
+        rank = _mm256_sub_epi16( rank, _mm256_cmpgt_epi16( keys, _mm256_set1_epi16( k[i] ) ) );
+    }
+
+    alignas( 32 ) uint16_t r[16];
+    _mm256_store_si256( (__m256i*)r, rank );
+    for( uint8_t i = 0; i < 16; ++i )
+    {
+        arr1[r[i]] = k[i] >> 4;
+        arr2[r[i]] = i;
+    }
+}
+
+// Index of the split between sorted luma values that gives the smallest sum of both ranges,
+// matching the first minimum found by the scalar scan.
+static etcpak_force_inline uint8_t findSplit_AVX2( const uint8_t* luma, const uint8_t* diffBonus )
+{
+    __m128i l = _mm_loadu_si128( (const __m128i*)luma );
+    __m128i gap = _mm_sub_epi8( _mm_srli_si128( l, 1 ), l );
+
+    __m256i bonus = _mm256_cvtepu8_epi16( _mm_loadu_si128( (const __m128i*)diffBonus ) );
+    __m256i range = _mm256_set1_epi16( luma[15] - luma[0] );
+    __m256i sum = _mm256_sub_epi16( _mm256_add_epi16( range, bonus ), _mm256_cvtepu8_epi16( gap ) );
+    // there are only 15 split points
+    sum = _mm256_or_si256( sum, _mm256_setr_epi16( 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1 ) );
+
+    uint32_t lo = _mm_cvtsi128_si32( _mm_minpos_epu16( _mm256_castsi256_si128( sum ) ) );
+    uint32_t hi = _mm_cvtsi128_si32( _mm_minpos_epu16( _mm256_extracti128_si256( sum, 1 ) ) );
+
+    if( ( hi & 0xFFFF ) < ( lo & 0xFFFF ) ) return 8 + ( hi >> 16 );
+    return lo >> 16;
+}
+#endif
 
 //converts indices from  |a0|a1|e0|e1|i0|i1|m0|m1|b0|b1|f0|f1|j0|j1|n0|n1|c0|c1|g0|g1|k0|k1|o0|o1|d0|d1|h0|h1|l0|l1|p0|p1| previously used by T- and H-modes
 //                     into  |p0|o0|n0|m0|l0|k0|j0|i0|h0|g0|f0|e0|d0|c0|b0|a0|p1|o1|n1|m1|l1|k1|j1|i1|h1|g1|f1|e1|d1|c1|b1|a1| which should be used for all modes.
@@ -2134,6 +2182,11 @@ uint32_t calculateErrorTH( bool tMode, uint8_t* src, uint8_t( colorsRGB444 )[2][
 
 #ifdef __AVX2__
     __m128i reverseMask = _mm_set_epi8( 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15 );
+
+    // RGB ordering, extended into 3x256 bits for error comparisions
+    __m256i b16 = _mm256_cvtepu8_epi16( _mm_shuffle_epi8( b8, reverseMask ) );
+    __m256i g16 = _mm256_cvtepu8_epi16( _mm_shuffle_epi8( g8, reverseMask ) );
+    __m256i r16 = _mm256_cvtepu8_epi16( _mm_shuffle_epi8( r8, reverseMask ) );
 #endif
 
     // test distances
@@ -2154,28 +2207,10 @@ uint32_t calculateErrorTH( bool tMode, uint8_t* src, uint8_t( colorsRGB444 )[2][
         }
 
 #ifdef __AVX2__
-        // RGB ordering
-        __m128i b8Rev = _mm_shuffle_epi8( b8, reverseMask );
-        __m128i g8Rev = _mm_shuffle_epi8( g8, reverseMask );
-        __m128i r8Rev = _mm_shuffle_epi8( r8, reverseMask );
-
-        // extends 3x128 bits RGB into 3x256 bits RGB for error comparisions
-        static const __m128i zero = _mm_setzero_si128();
-        __m128i b8Lo = _mm_unpacklo_epi8( b8Rev, zero );
-        __m128i g8Lo = _mm_unpacklo_epi8( g8Rev, zero );
-        __m128i r8Lo = _mm_unpacklo_epi8( r8Rev, zero );
-        __m128i b8Hi = _mm_unpackhi_epi8( b8Rev, zero );
-        __m128i g8Hi = _mm_unpackhi_epi8( g8Rev, zero );
-        __m128i r8Hi = _mm_unpackhi_epi8( r8Rev, zero );
-
-        __m256i b8 = _mm256_set_m128i( b8Hi, b8Lo );
-        __m256i g8 = _mm256_set_m128i( g8Hi, g8Lo );
-        __m256i r8 = _mm256_set_m128i( r8Hi, r8Lo );
-
         // caculates differences between the pixel colrs and the palette colors
-        __m256i diffb = _mm256_abs_epi16( _mm256_sub_epi16( b8, _mm256_set1_epi16( possibleColors[0][B] ) ) );
-        __m256i diffg = _mm256_abs_epi16( _mm256_sub_epi16( g8, _mm256_set1_epi16( possibleColors[0][G] ) ) );
-        __m256i diffr = _mm256_abs_epi16( _mm256_sub_epi16( r8, _mm256_set1_epi16( possibleColors[0][R] ) ) );
+        __m256i diffb = _mm256_abs_epi16( _mm256_sub_epi16( b16, _mm256_set1_epi16( possibleColors[0][B] ) ) );
+        __m256i diffg = _mm256_abs_epi16( _mm256_sub_epi16( g16, _mm256_set1_epi16( possibleColors[0][G] ) ) );
+        __m256i diffr = _mm256_abs_epi16( _mm256_sub_epi16( r16, _mm256_set1_epi16( possibleColors[0][R] ) ) );
 
         // luma-based error calculations
         static const __m256i bWeight = _mm256_set1_epi16( 14 );
@@ -2193,9 +2228,9 @@ uint32_t calculateErrorTH( bool tMode, uint8_t* src, uint8_t( colorsRGB444 )[2][
         static const uint32_t masks[4] = { 0, 0x55555555, 0xAAAAAAAA, 0xFFFFFFFF };
         for( uint8_t c = 1; c < 4; c++ )
         {
-            __m256i diffb = _mm256_abs_epi16( _mm256_sub_epi16( b8, _mm256_set1_epi16( possibleColors[c][B] ) ) );
-            __m256i diffg = _mm256_abs_epi16( _mm256_sub_epi16( g8, _mm256_set1_epi16( possibleColors[c][G] ) ) );
-            __m256i diffr = _mm256_abs_epi16( _mm256_sub_epi16( r8, _mm256_set1_epi16( possibleColors[c][R] ) ) );
+            __m256i diffb = _mm256_abs_epi16( _mm256_sub_epi16( b16, _mm256_set1_epi16( possibleColors[c][B] ) ) );
+            __m256i diffg = _mm256_abs_epi16( _mm256_sub_epi16( g16, _mm256_set1_epi16( possibleColors[c][G] ) ) );
+            __m256i diffr = _mm256_abs_epi16( _mm256_sub_epi16( r16, _mm256_set1_epi16( possibleColors[c][R] ) ) );
 
             diffb = _mm256_mullo_epi16( diffb, bWeight );
             diffg = _mm256_mullo_epi16( diffg, gWeight );
@@ -2214,13 +2249,12 @@ uint32_t calculateErrorTH( bool tMode, uint8_t* src, uint8_t( colorsRGB444 )[2][
             pixColors = prevPixColors | mskPixColors;
         }
 
-        // accumulate the block error
-        alignas( 32 ) uint16_t pixErr16[16] = { 0, };
-        _mm256_storeu_si256( (__m256i*)pixErr16, lowestPixErr );
-        for( uint8_t p = 0; p < 16; p++ )
-        {
-            blockErr += (int)( pixErr16[p] ) * pixErr16[p];
-        }
+        // accumulate the block error; a pixel error is at most 128 * 255, so the signed multiply is exact
+        __m256i sq = _mm256_madd_epi16( lowestPixErr, lowestPixErr );
+        __m128i sum = _mm_add_epi32( _mm256_castsi256_si128( sq ), _mm256_extracti128_si256( sq, 1 ) );
+        sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        blockErr = _mm_cvtsi128_si32( sum );
 #else
         for( size_t y = 0; y < 4; ++y )
         {
@@ -2273,8 +2307,8 @@ uint32_t compressBlockTH( uint8_t *src, Luma& l, uint32_t& compressed1, uint32_t
 #endif
 {
 #ifdef __AVX2__
-    alignas( 8 ) uint8_t luma[16] = { 0, };
-    _mm_storeu_si128 ( (__m128i* )luma, l.luma8 );
+    // filled in sorted order by rankSort_AVX2
+    alignas( 16 ) uint8_t luma[16];
 #elif defined __ARM_NEON && defined __aarch64__
     alignas( 8 ) uint8_t luma[16] = { 0 };
     vst1q_u8( luma, l.luma8 );
@@ -2284,6 +2318,15 @@ uint32_t compressBlockTH( uint8_t *src, Luma& l, uint32_t& compressed1, uint32_t
 
     uint8_t pixIdx[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
 
+    static const uint8_t diffBonus[16] = {8, 4, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 4, 8, 0};
+
+#ifdef __AVX2__
+    // 1) sorts the pairs of (luma, pix_idx)
+    rankSort_AVX2( l.luma8, luma, pixIdx );
+
+    // 2) finds the min (left+right)
+    uint8_t minSumRangeIdx = findSplit_AVX2( luma, diffBonus );
+#else
     // 1) sorts the pairs of (luma, pix_idx)
     insertionSort( luma, pixIdx );
 
@@ -2291,7 +2334,6 @@ uint32_t compressBlockTH( uint8_t *src, Luma& l, uint32_t& compressed1, uint32_t
     uint8_t minSumRangeIdx = 0;
     uint16_t minSumRangeValue;
     uint16_t sum;
-    static const uint8_t diffBonus[15] = {8, 4, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 4, 8};
     const int16_t temp = luma[15] - luma[0];
 
     minSumRangeValue = luma[15] - luma[1] + diffBonus[0];
@@ -2311,6 +2353,7 @@ uint32_t compressBlockTH( uint8_t *src, Luma& l, uint32_t& compressed1, uint32_t
         minSumRangeValue = sum;
         minSumRangeIdx = 14;
     }
+#endif
     uint8_t lRange, rRange;
 
     lRange = luma[minSumRangeIdx] - luma[0];
@@ -2514,17 +2557,10 @@ static etcpak_force_inline uint64_t EncodeSelectors( uint64_t d, const T terr[2]
 
 }
 
-static etcpak_force_inline uint64_t ProcessRGB( const uint8_t* src )
-{
 #ifdef __AVX2__
-    uint64_t d = CheckSolid_AVX2( src );
-    if( d != 0 ) return d;
-
-    alignas(32) v4i a[8];
-
-    __m128i err0 = PrepareAverages_AVX2( a, src );
-
-    // Get index of minimum error (err0)
+// Index of the minimum error of the four average encodings
+static etcpak_force_inline uint32_t GetLeastError_AVX2( __m128i err0 ) noexcept
+{
     __m128i err1 = _mm_shuffle_epi32(err0, _MM_SHUFFLE(2, 3, 0, 1));
     __m128i errMin0 = _mm_min_epu32(err0, err1);
 
@@ -2535,7 +2571,20 @@ static etcpak_force_inline uint64_t ProcessRGB( const uint8_t* src )
 
     uint32_t mask = _mm_movemask_epi8(errMask);
 
-    uint32_t idx = _bit_scan_forward(mask) >> 2;
+    return _bit_scan_forward(mask) >> 2;
+}
+#endif
+
+static etcpak_force_inline uint64_t ProcessRGB( const uint8_t* src )
+{
+#ifdef __AVX2__
+    uint64_t d = CheckSolid_AVX2( src );
+    if( d != 0 ) return d;
+
+    alignas(32) v4i a[8];
+
+    __m128i err0 = PrepareAverages_AVX2( a, src );
+    uint32_t idx = GetLeastError_AVX2( err0 );
 
     d |= EncodeAverages_AVX2( a, idx );
 
@@ -2575,6 +2624,59 @@ static etcpak_force_inline uint64_t ProcessRGB( const uint8_t* src )
 #endif
 }
 
+#ifdef __AVX2__
+// Same as ProcessRGB, for two blocks at once. Each stage is issued for both blocks before moving to
+// the next one, so the two independent dependency chains can execute in parallel.
+static etcpak_force_inline void ProcessRGB_x2_AVX2( const uint8_t* src0, const uint8_t* src1, uint64_t* dst )
+{
+    uint64_t d0 = CheckSolid_AVX2( src0 );
+    uint64_t d1 = CheckSolid_AVX2( src1 );
+    if( d0 != 0 || d1 != 0 )
+    {
+        dst[0] = d0 != 0 ? d0 : ProcessRGB( src0 );
+        dst[1] = d1 != 0 ? d1 : ProcessRGB( src1 );
+        return;
+    }
+
+    alignas(32) v4i a0[8];
+    alignas(32) v4i a1[8];
+
+    __m128i err0 = PrepareAverages_AVX2( a0, src0 );
+    __m128i err1 = PrepareAverages_AVX2( a1, src1 );
+
+    uint32_t idx0 = GetLeastError_AVX2( err0 );
+    uint32_t idx1 = GetLeastError_AVX2( err1 );
+
+    d0 = EncodeAverages_AVX2( a0, idx0 );
+    d1 = EncodeAverages_AVX2( a1, idx1 );
+
+    alignas(32) uint32_t terr0[2][8] = {};
+    alignas(32) uint32_t terr1[2][8] = {};
+    alignas(32) uint32_t tsel0[8];
+    alignas(32) uint32_t tsel1[8];
+
+    if ((idx0 == 0) || (idx0 == 2))
+    {
+        FindBestFit_4x2_AVX2( terr0, tsel0, a0, idx0 * 2, src0 );
+    }
+    else
+    {
+        FindBestFit_2x4_AVX2( terr0, tsel0, a0, idx0 * 2, src0 );
+    }
+    if ((idx1 == 0) || (idx1 == 2))
+    {
+        FindBestFit_4x2_AVX2( terr1, tsel1, a1, idx1 * 2, src1 );
+    }
+    else
+    {
+        FindBestFit_2x4_AVX2( terr1, tsel1, a1, idx1 * 2, src1 );
+    }
+
+    dst[0] = EncodeSelectors_AVX2( d0, terr0, tsel0, (idx0 % 2) == 1 );
+    dst[1] = EncodeSelectors_AVX2( d1, terr1, tsel1, (idx1 % 2) == 1 );
+}
+#endif
+
 #ifdef __AVX2__
 // horizontal min/max functions. https://stackoverflow.com/questions/22256525/horizontal-minimum-and-maximum-using-sse
 // if an error occurs in GCC, please change the value of -march in CFLAGS to a specific value for your CPU (e.g., skylake).
@@ -2981,15 +3083,18 @@ static etcpak_force_inline uint8_t SelectModeETC2( const Luma& luma )
     return ModeUndecided;
 }
 
-static etcpak_force_inline uint64_t ProcessRGB_ETC2( const uint8_t* src, bool useHeuristics )
+static etcpak_force_inline uint64_t ProcessRGB_ETC2( const uint8_t* src, bool useHeuristics, bool differentialOnly = false )
 {
 #ifdef __AVX2__
     uint64_t d = CheckSolid_AVX2( src );
-    if( d != 0 ) return d;
 #else
     uint64_t d = CheckSolid( src );
-    if (d != 0) return d;
 #endif
+    if( d != 0 )
+    {
+        ETCPAK_COUNT( etc2Solid );
+        return d;
+    }
 
     uint8_t mode = ModeUndecided;
     Luma luma;
@@ -2999,6 +3104,7 @@ static etcpak_force_inline uint64_t ProcessRGB_ETC2( const uint8_t* src, bool us
     {
         CalculateLuma( ch, luma );
         mode = SelectModeETC2( luma );
+        ETCPAK_COUNT( etc2Heuristic[mode] );
     }
 
     auto plane = Planar_AVX2( ch, mode, useHeuristics );
@@ -3006,19 +3112,8 @@ static etcpak_force_inline uint64_t ProcessRGB_ETC2( const uint8_t* src, bool us
 
     alignas( 32 ) v4i a[8];
     __m128i err0 = PrepareAverages_AVX2( a, plane.sum4 );
-
-    // Get index of minimum error (err0)
-    __m128i err1 = _mm_shuffle_epi32( err0, _MM_SHUFFLE( 2, 3, 0, 1 ) );
-    __m128i errMin0 = _mm_min_epu32(err0, err1);
-
-    __m128i errMin1 = _mm_shuffle_epi32( errMin0, _MM_SHUFFLE( 1, 0, 3, 2 ) );
-    __m128i errMin2 = _mm_min_epu32( errMin1, errMin0 );
-
-    __m128i errMask = _mm_cmpeq_epi32( errMin2, err0 );
-
-    uint32_t mask = _mm_movemask_epi8( errMask );
-
-    size_t idx = _bit_scan_forward( mask ) >> 2;
+    if( differentialOnly ) err0 = _mm_or_si128( err0, _mm_setr_epi32( -1, -1, 0, 0 ) );
+    size_t idx = GetLeastError_AVX2( err0 );
 
     d = EncodeAverages_AVX2( a, idx );
 
@@ -3077,6 +3172,7 @@ static etcpak_force_inline uint64_t ProcessRGB_ETC2( const uint8_t* src, bool us
         CalculateLuma( src, luma );
 #endif
         mode = SelectModeETC2( luma );
+        ETCPAK_COUNT( etc2Heuristic[mode] );
     }
 #ifdef __ARM_NEON
     auto result = Planar_NEON( src, mode, useHeuristics );
@@ -3088,7 +3184,7 @@ static etcpak_force_inline uint64_t ProcessRGB_ETC2( const uint8_t* src, bool us
     v4i a[8];
     unsigned int err[4] = {};
     PrepareAverages( a, src, err );
-    size_t idx = GetLeastError( err, 4 );
+    size_t idx = differentialOnly ? GetLeastError( err + 2, 2 ) + 2 : GetLeastError( err, 4 );
     EncodeAverages( d, a, idx );
 
 #if ( defined __SSE4_1__ || defined __ARM_NEON ) && !defined REFERENCE_IMPLEMENTATION
@@ -3131,6 +3227,136 @@ static etcpak_force_inline uint64_t ProcessRGB_ETC2( const uint8_t* src, bool us
 #endif
 }
 
+// In ETC2 RGB8A1 the differential bit is reinterpreted as an opaque flag, so individual mode is unavailable. Opaque
+// blocks are encoded as in ETC2 RGB. Blocks with transparent pixels use differential mode with the flag cleared, in
+// which selector 2 marks a transparent pixel and selector 0 has no modifier.
+static etcpak_force_inline uint64_t ProcessRGB8A1_ETC2( const uint8_t* src, bool useHeuristics )
+{
+#ifdef __AVX2__
+    const __m256i px0 = _mm256_loadu_si256( (const __m256i*)src );
+    const __m256i px1 = _mm256_loadu_si256( (const __m256i*)src + 1 );
+    const uint32_t opaque = _mm256_movemask_ps( _mm256_castsi256_ps( px0 ) ) | ( _mm256_movemask_ps( _mm256_castsi256_ps( px1 ) ) << 8 );
+#elif defined __SSE4_1__
+    uint32_t opaque = 0;
+    for( int i=0; i<4; i++ )
+    {
+        opaque |= _mm_movemask_ps( _mm_castsi128_ps( _mm_loadu_si128( (const __m128i*)src + i ) ) ) << ( i*4 );
+    }
+#else
+    uint32_t opaque = 0;
+    for( int i=0; i<16; i++ )
+    {
+        opaque |= ( src[i*4+3] >> 7 ) << i;
+    }
+#endif
+    if( opaque == 0xFFFF ) return ProcessRGB_ETC2( src, useHeuristics, true );
+    if( opaque == 0 ) return FixByteOrder( 0xFFFF000000000000 );
+
+    // The modifier is added to all channels, so with dist = sum of (base - pixel) over channels the error of modifier m
+    // is err0 + 2*m*dist + 3*m^2, ignoring clamping. Per pixel, +mod or -mod beats no modifier when 2*|dist| > 3*mod.
+    uint64_t best = 0;
+    int32_t bestErr = std::numeric_limits<int32_t>::max();
+    for( int flip=0; flip<2; flip++ )
+    {
+        const uint32_t sub[2] = { flip ? 0x3333u : 0x00FFu, flip ? 0xCCCCu : 0xFF00u };
+
+        int c5[2][3];
+        for( int s=0; s<2; s++ )
+        {
+            const uint32_t px = ( opaque & sub[s] ) ? opaque & sub[s] : opaque;
+            int sum[3] = {};
+            int cnt = 0;
+            for( int i=0; i<16; i++ )
+            {
+                if( px & ( 1 << i ) )
+                {
+                    sum[0] += src[i*4+2];
+                    sum[1] += src[i*4+1];
+                    sum[2] += src[i*4+0];
+                    cnt++;
+                }
+            }
+            for( int c=0; c<3; c++ )
+            {
+                c5[s][c] = mul8bit( ( sum[c] + cnt / 2 ) / cnt, 31 );
+            }
+        }
+
+        uint64_t d = uint64_t( flip ) << 24;
+        for( int c=0; c<3; c++ )
+        {
+            const int diff = std::min( 3, std::max( -4, c5[1][c] - c5[0][c] ) );
+            c5[1][c] = c5[0][c] + diff;
+            d |= uint64_t( ( c5[0][c] << 3 ) | ( diff & 0x7 ) ) << ( c*8 );
+        }
+
+        int32_t err = 0;
+        for( int s=0; s<2; s++ )
+        {
+            const int r = ( c5[s][0] << 3 ) | ( c5[s][0] >> 2 );
+            const int g = ( c5[s][1] << 3 ) | ( c5[s][1] >> 2 );
+            const int b = ( c5[s][2] << 3 ) | ( c5[s][2] >> 2 );
+
+            const uint32_t px = opaque & sub[s];
+            int32_t dist[16];
+            for( int i=0; i<16; i++ )
+            {
+                if( px & ( 1 << i ) )
+                {
+                    const int dr = r - src[i*4+2];
+                    const int dg = g - src[i*4+1];
+                    const int db = b - src[i*4+0];
+                    err += dr*dr + dg*dg + db*db;
+                    dist[i] = dr + dg + db;
+                }
+            }
+
+            int32_t tErr = 0;
+            int tIdx = 0;
+            for( int t=0; t<8; t++ )
+            {
+                const int32_t mod = g_table[t][1];
+                int32_t e = 0;
+                for( int i=0; i<16; i++ )
+                {
+                    if( px & ( 1 << i ) )
+                    {
+                        const int32_t ad = abs( dist[i] );
+                        if( 2*ad > 3*mod ) e += 3*mod*mod - 2*mod*ad;
+                    }
+                }
+                if( e < tErr )
+                {
+                    tErr = e;
+                    tIdx = t;
+                }
+            }
+
+            err += tErr;
+            d |= uint64_t( tIdx ) << ( s == 0 ? 29 : 26 );
+            const int32_t mod = g_table[tIdx][1];
+            for( int i=0; i<16; i++ )
+            {
+                if( ( px & ( 1 << i ) ) && 2*abs( dist[i] ) > 3*mod )
+                {
+                    // selector 1 adds the modifier, selector 3 subtracts it
+                    d |= uint64_t( 1 ) << ( i + 32 );
+                    if( dist[i] > 0 ) d |= uint64_t( 1 ) << ( i + 48 );
+                }
+            }
+        }
+        d |= uint64_t( ~opaque & 0xFFFF ) << 48;
+
+        if( err < bestErr )
+        {
+            bestErr = err;
+            best = d;
+        }
+    }
+
+    return FixByteOrder( best );
+}
+
 #ifdef __SSE4_1__
 template<int K>
 static etcpak_force_inline __m128i Widen( const __m128i src )
@@ -3858,12 +4084,421 @@ static etcpak_force_inline uint64_t ProcessAlpha_ETC2( const uint8_t* src )
 #endif
 }
 
+// 11-bit EAC (R11, RG11) from 16-bit source data. Errors are measured on values reduced to 13 bits,
+// which keeps two bits of precision below the 11-bit code values, while the squared error of a
+// whole block still fits in 32 bits.
+//
+// Signed blocks are handled in the same unsigned domain, offset by 1024. The signed base -127..127
+// becomes 1..255, the reconstructed values -1023..1023 become 1..2047, and 16-bit source values
+// are mapped linearly onto that range, 0x8000 being zero.
+
+// Multiplier and base that center modifier table t on the block range, the multiplier moved by d.
+template<bool Signed>
+static etcpak_force_inline void Eac11Fit( int mn, int mx, int t, int d, int& base, int& mul )
+{
+    const int mul0 = std::min( 15, ( ( ( ( mx - mn ) * g_alphaRange[t] ) >> 16 ) + 16 ) >> 5 );
+    mul = std::min( 15, std::max( 0, mul0 + d ) );
+    base = std::min( 255, std::max( Signed ? 1 : 0, ( ( ( mn + mx ) >> 2 ) - ( g_alpha[t][3] + g_alpha[t][7] ) * g_alpha11Mul[mul] ) >> 4 ) );
+}
+
+template<bool Signed>
+static etcpak_force_inline void Eac11Reconstruct( int base, int mul, int table, uint16_t* rec )
+{
+    for( int i=0; i<8; i++ )
+    {
+        const int v = std::min( 2047, std::max( Signed ? 1 : 0, base * 8 + ( Signed ? 0 : 4 ) + g_alpha[table][i] * g_alpha11Mul[mul] ) );
+        rec[i] = Signed ? v << 2 : ( v << 2 ) | ( v >> 9 );
+    }
+}
+
+#ifdef __AVX2__
+template<bool Signed>
+static etcpak_force_inline __m256i Eac11Value_AVX2( __m256i base, __m256i mul, int k )
+{
+    __m256i v0 = _mm256_add_epi16( base, _mm256_mullo_epi16( g_alpha_AVX[k], mul ) );
+    __m256i v1 = _mm256_min_epi16( _mm256_max_epi16( v0, _mm256_set1_epi16( Signed ? 1 : 0 ) ), _mm256_set1_epi16( 2047 ) );
+    if( Signed ) return _mm256_slli_epi16( v1, 2 );
+    return _mm256_or_si256( _mm256_slli_epi16( v1, 2 ), _mm256_srli_epi16( v1, 9 ) );
+}
+
+// Distance of pixel p to the nearest of the eight reconstructed values.
+static etcpak_force_inline __m256i Eac11MinDiff_AVX2( __m256i p, __m256i r0, __m256i r1, __m256i r2, __m256i r3, __m256i r4, __m256i r5, __m256i r6, __m256i r7 )
+{
+    __m256i d0 = _mm256_abs_epi16( _mm256_sub_epi16( p, r0 ) );
+    __m256i d1 = _mm256_abs_epi16( _mm256_sub_epi16( p, r1 ) );
+    __m256i d2 = _mm256_abs_epi16( _mm256_sub_epi16( p, r2 ) );
+    __m256i d3 = _mm256_abs_epi16( _mm256_sub_epi16( p, r3 ) );
+    __m256i d4 = _mm256_abs_epi16( _mm256_sub_epi16( p, r4 ) );
+    __m256i d5 = _mm256_abs_epi16( _mm256_sub_epi16( p, r5 ) );
+    __m256i d6 = _mm256_abs_epi16( _mm256_sub_epi16( p, r6 ) );
+    __m256i d7 = _mm256_abs_epi16( _mm256_sub_epi16( p, r7 ) );
+
+    __m256i m0 = _mm256_min_epu16( d0, d1 );
+    __m256i m1 = _mm256_min_epu16( d2, d3 );
+    __m256i m2 = _mm256_min_epu16( d4, d5 );
+    __m256i m3 = _mm256_min_epu16( d6, d7 );
+
+    return _mm256_min_epu16( _mm256_min_epu16( m0, m1 ), _mm256_min_epu16( m2, m3 ) );
+}
+
+// Fits all 16 modifier tables to each of the N channels and calculates their errors. Table t is
+// kept in 16-bit lane t, so a single pass over the pixels evaluates every table, and the channels
+// share that pass.
+template<int N, bool Signed>
+static etcpak_force_inline void Eac11TableError_AVX2( const uint16_t (*px)[16], const int* mn, const int* mx, int d, uint16_t (*base)[16], uint16_t (*mul)[16], uint32_t (*err)[16] )
+{
+    __m256i rec[N][8];
+    for( int c=0; c<N; c++ )
+    {
+        __m256i range = _mm256_set1_epi16( mx[c] - mn[c] );
+        __m256i mul0 = _mm256_srli_epi16( _mm256_add_epi16( _mm256_mulhi_epu16( range, g_alphaRange_AVX ), _mm256_set1_epi16( 16 ) ), 5 );
+        __m256i mul1 = _mm256_add_epi16( _mm256_min_epi16( mul0, _mm256_set1_epi16( 15 ) ), _mm256_set1_epi16( d ) );
+        __m256i m = _mm256_min_epi16( _mm256_max_epi16( mul1, _mm256_setzero_si256() ), _mm256_set1_epi16( 15 ) );
+        __m256i m11 = _mm256_max_epi16( _mm256_slli_epi16( m, 3 ), _mm256_set1_epi16( 1 ) );
+
+        __m256i mid = _mm256_set1_epi16( ( mn[c] + mx[c] ) >> 2 );
+        __m256i b0 = _mm256_sub_epi16( mid, _mm256_mullo_epi16( _mm256_add_epi16( g_alpha_AVX[3], g_alpha_AVX[7] ), m11 ) );
+        __m256i b = _mm256_min_epi16( _mm256_max_epi16( _mm256_srai_epi16( b0, 4 ), _mm256_set1_epi16( Signed ? 1 : 0 ) ), _mm256_set1_epi16( 255 ) );
+
+        _mm256_store_si256( (__m256i*)base[c], b );
+        _mm256_store_si256( (__m256i*)mul[c], m );
+
+        __m256i b11 = _mm256_add_epi16( _mm256_slli_epi16( b, 3 ), _mm256_set1_epi16( Signed ? 0 : 4 ) );
+        rec[c][0] = Eac11Value_AVX2<Signed>( b11, m11, 0 );
+        rec[c][1] = Eac11Value_AVX2<Signed>( b11, m11, 1 );
+        rec[c][2] = Eac11Value_AVX2<Signed>( b11, m11, 2 );
+        rec[c][3] = Eac11Value_AVX2<Signed>( b11, m11, 3 );
+        rec[c][4] = Eac11Value_AVX2<Signed>( b11, m11, 4 );
+        rec[c][5] = Eac11Value_AVX2<Signed>( b11, m11, 5 );
+        rec[c][6] = Eac11Value_AVX2<Signed>( b11, m11, 6 );
+        rec[c][7] = Eac11Value_AVX2<Signed>( b11, m11, 7 );
+    }
+
+    __m256i lo[N], hi[N];
+    for( int c=0; c<N; c++ )
+    {
+        lo[c] = _mm256_setzero_si256();
+        hi[c] = _mm256_setzero_si256();
+    }
+    for( int i=0; i<16; i+=2 )
+    {
+        for( int c=0; c<N; c++ )
+        {
+            const auto r = rec[c];
+            __m256i d0 = Eac11MinDiff_AVX2( _mm256_set1_epi16( px[c][i] ), r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7] );
+            __m256i d1 = Eac11MinDiff_AVX2( _mm256_set1_epi16( px[c][i+1] ), r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7] );
+
+            // pixel pairs are squared and summed to 32 bits; unpacklo has tables 0-3 and 8-11, unpackhi the rest
+            __m256i l = _mm256_unpacklo_epi16( d0, d1 );
+            __m256i h = _mm256_unpackhi_epi16( d0, d1 );
+            lo[c] = _mm256_add_epi32( lo[c], _mm256_madd_epi16( l, l ) );
+            hi[c] = _mm256_add_epi32( hi[c], _mm256_madd_epi16( h, h ) );
+        }
+    }
+
+    for( int c=0; c<N; c++ )
+    {
+        _mm256_store_si256( (__m256i*)err[c], _mm256_permute2x128_si256( lo[c], hi[c], 0x20 ) );
+        _mm256_store_si256( (__m256i*)( err[c] + 8 ), _mm256_permute2x128_si256( lo[c], hi[c], 0x31 ) );
+    }
+}
+
+static etcpak_force_inline __m256i Eac11Broadcast_AVX2( __m256i rec, int k )
+{
+    return _mm256_shuffle_epi8( rec, _mm256_set1_epi16( 0x0100 + k * 0x0202 ) );
+}
+
+static etcpak_force_inline uint32_t Eac11Error_AVX2( const uint16_t* px, const uint16_t* rec )
+{
+    __m256i p = _mm256_load_si256( (const __m256i*)px );
+    __m256i r = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)rec ) );
+    __m256i minDiff = _mm256_abs_epi16( _mm256_sub_epi16( p, Eac11Broadcast_AVX2( r, 0 ) ) );
+    for( int k=1; k<8; k++ )
+    {
+        minDiff = _mm256_min_epu16( minDiff, _mm256_abs_epi16( _mm256_sub_epi16( p, Eac11Broadcast_AVX2( r, k ) ) ) );
+    }
+    __m256i e = _mm256_madd_epi16( minDiff, minDiff );
+    __m128i s = _mm_add_epi32( _mm256_castsi256_si128( e ), _mm256_extracti128_si256( e, 1 ) );
+    s = _mm_add_epi32( s, _mm_shuffle_epi32( s, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    s = _mm_add_epi32( s, _mm_shuffle_epi32( s, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    return _mm_cvtsi128_si32( s );
+}
+#elif defined __ARM_NEON && defined __aarch64__
+static etcpak_force_inline uint32_t Eac11Error_NEON( const uint16_t* px, const uint16_t* rec )
+{
+    uint16x8_t px0 = vld1q_u16( px );
+    uint16x8_t px1 = vld1q_u16( px + 8 );
+    uint16x8_t r = vld1q_u16( rec );
+    uint16x8_t min0 = vabdq_u16( px0, vdupq_laneq_u16( r, 0 ) );
+    uint16x8_t min1 = vabdq_u16( px1, vdupq_laneq_u16( r, 0 ) );
+    min0 = vminq_u16( min0, vabdq_u16( px0, vdupq_laneq_u16( r, 1 ) ) );
+    min1 = vminq_u16( min1, vabdq_u16( px1, vdupq_laneq_u16( r, 1 ) ) );
+    min0 = vminq_u16( min0, vabdq_u16( px0, vdupq_laneq_u16( r, 2 ) ) );
+    min1 = vminq_u16( min1, vabdq_u16( px1, vdupq_laneq_u16( r, 2 ) ) );
+    min0 = vminq_u16( min0, vabdq_u16( px0, vdupq_laneq_u16( r, 3 ) ) );
+    min1 = vminq_u16( min1, vabdq_u16( px1, vdupq_laneq_u16( r, 3 ) ) );
+    min0 = vminq_u16( min0, vabdq_u16( px0, vdupq_laneq_u16( r, 4 ) ) );
+    min1 = vminq_u16( min1, vabdq_u16( px1, vdupq_laneq_u16( r, 4 ) ) );
+    min0 = vminq_u16( min0, vabdq_u16( px0, vdupq_laneq_u16( r, 5 ) ) );
+    min1 = vminq_u16( min1, vabdq_u16( px1, vdupq_laneq_u16( r, 5 ) ) );
+    min0 = vminq_u16( min0, vabdq_u16( px0, vdupq_laneq_u16( r, 6 ) ) );
+    min1 = vminq_u16( min1, vabdq_u16( px1, vdupq_laneq_u16( r, 6 ) ) );
+    min0 = vminq_u16( min0, vabdq_u16( px0, vdupq_laneq_u16( r, 7 ) ) );
+    min1 = vminq_u16( min1, vabdq_u16( px1, vdupq_laneq_u16( r, 7 ) ) );
+    uint32x4_t sum = vmull_u16( vget_low_u16( min0 ), vget_low_u16( min0 ) );
+    sum = vmlal_u16( sum, vget_high_u16( min0 ), vget_high_u16( min0 ) );
+    sum = vmlal_u16( sum, vget_low_u16( min1 ), vget_low_u16( min1 ) );
+    sum = vmlal_u16( sum, vget_high_u16( min1 ), vget_high_u16( min1 ) );
+    return vaddvq_u32( sum );
+}
+#endif
+
+static etcpak_force_inline uint32_t Eac11Error( const uint16_t* px, const uint16_t* rec )
+{
+#ifdef __AVX2__
+    return Eac11Error_AVX2( px, rec );
+#elif defined __ARM_NEON && defined __aarch64__
+    return Eac11Error_NEON( px, rec );
+#else
+    uint32_t sum = 0;
+    for( int i=0; i<16; i++ )
+    {
+        int minDiff = abs( px[i] - rec[0] );
+        for( int k=1; k<8; k++ ) minDiff = std::min( minDiff, abs( px[i] - rec[k] ) );
+        sum += minDiff * minDiff;
+    }
+    return sum;
+#endif
+}
+
+template<int N, bool Signed>
+static etcpak_force_inline void Eac11TableError( const uint16_t (*px)[16], const int* mn, const int* mx, int d, uint16_t (*base)[16], uint16_t (*mul)[16], uint32_t (*err)[16] )
+{
+#ifdef __AVX2__
+    Eac11TableError_AVX2<N, Signed>( px, mn, mx, d, base, mul, err );
+#else
+    for( int c=0; c<N; c++ )
+    {
+        for( int t=0; t<16; t++ )
+        {
+            int b, m;
+            Eac11Fit<Signed>( mn[c], mx[c], t, d, b, m );
+            base[c][t] = b;
+            mul[c][t] = m;
+
+            uint16_t rec[8];
+            Eac11Reconstruct<Signed>( b, m, t, rec );
+            err[c][t] = Eac11Error( px[c], rec );
+        }
+    }
+#endif
+}
+
+static etcpak_force_inline uint64_t Eac11Indices( const uint16_t* px, const uint16_t* rec )
+{
+    uint64_t d = 0;
+#ifdef __AVX2__
+    __m256i p = _mm256_load_si256( (const __m256i*)px );
+    __m256i r = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i*)rec ) );
+    __m256i minDiff = _mm256_abs_epi16( _mm256_sub_epi16( p, Eac11Broadcast_AVX2( r, 0 ) ) );
+    __m256i idx = _mm256_setzero_si256();
+    for( int k=1; k<8; k++ )
+    {
+        __m256i diff = _mm256_abs_epi16( _mm256_sub_epi16( p, Eac11Broadcast_AVX2( r, k ) ) );
+        __m256i mask = _mm256_cmpgt_epi16( minDiff, diff );
+        minDiff = _mm256_min_epi16( minDiff, diff );
+        idx = _mm256_blendv_epi8( idx, _mm256_set1_epi16( k ), mask );
+    }
+    alignas( 32 ) uint16_t buf[16];
+    _mm256_store_si256( (__m256i*)buf, idx );
+    for( int i=0; i<16; i++ )
+    {
+        d |= uint64_t( buf[i] ) << ( 45 - i * 3 );
+    }
+#else
+    for( int i=0; i<16; i++ )
+    {
+        int idx = 0;
+        int minDiff = abs( px[i] - rec[0] );
+        for( int k=1; k<8; k++ )
+        {
+            const int diff = abs( px[i] - rec[k] );
+            if( diff < minDiff )
+            {
+                minDiff = diff;
+                idx = k;
+            }
+        }
+        d |= uint64_t( idx ) << ( 45 - i * 3 );
+    }
+#endif
+    return d;
+}
+
+// First of the modifier tables with the least error
+static etcpak_force_inline int Eac11BestTable( const uint32_t* err )
+{
+#ifdef __AVX2__
+    __m256i e0 = _mm256_load_si256( (const __m256i*)err );
+    __m256i e1 = _mm256_load_si256( (const __m256i*)( err + 8 ) );
+    __m256i m = _mm256_min_epu32( e0, e1 );
+    m = _mm256_min_epu32( m, _mm256_permute2x128_si256( m, m, 1 ) );
+    m = _mm256_min_epu32( m, _mm256_shuffle_epi32( m, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    m = _mm256_min_epu32( m, _mm256_shuffle_epi32( m, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+    const uint32_t mask = _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpeq_epi32( e0, m ) ) ) |
+        ( _mm256_movemask_ps( _mm256_castsi256_ps( _mm256_cmpeq_epi32( e1, m ) ) ) << 8 );
+    return _bit_scan_forward( mask );
+#else
+    int best = 0;
+    for( int t=1; t<16; t++ )
+    {
+        if( err[t] < err[best] ) best = t;
+    }
+    return best;
+#endif
+}
+
+// Encodes N channels (R, or R and G) of one block. src holds 16 values per channel, in column order.
+template<int N, bool Signed>
+static etcpak_force_inline void ProcessEac11( const uint16_t* src, uint64_t* dst, bool highQuality )
+{
+    alignas( 32 ) uint16_t px[N][16];
+    int mn[N], mx[N];
+#ifdef __AVX2__
+    for( int c=0; c<N; c++ )
+    {
+        __m256i s = _mm256_loadu_si256( (const __m256i*)( src + c*16 ) );
+        __m256i p = _mm256_srli_epi16( s, 3 );
+        if( Signed ) p = _mm256_add_epi16( _mm256_sub_epi16( p, _mm256_srli_epi16( s, 13 ) ), _mm256_set1_epi16( 4 ) );
+        _mm256_store_si256( (__m256i*)px[c], p );
+
+        __m128i p0 = _mm256_castsi256_si128( p );
+        __m128i p1 = _mm256_extracti128_si256( p, 1 );
+        __m128i min = _mm_minpos_epu16( _mm_min_epu16( p0, p1 ) );
+        __m128i max = _mm_minpos_epu16( _mm_xor_si128( _mm_max_epu16( p0, p1 ), _mm_set1_epi16( -1 ) ) );
+        mn[c] = _mm_extract_epi16( min, 0 );
+        mx[c] = 0xFFFF ^ _mm_extract_epi16( max, 0 );
+    }
+#else
+    for( int c=0; c<N; c++ )
+    {
+        mn[c] = 0xFFFF;
+        mx[c] = 0;
+        for( int i=0; i<16; i++ )
+        {
+            const int v = src[c*16+i];
+            px[c][i] = Signed ? ( v >> 3 ) - ( v >> 13 ) + 4 : v >> 3;
+            mn[c] = std::min<int>( mn[c], px[c][i] );
+            mx[c] = std::max<int>( mx[c], px[c][i] );
+        }
+    }
+#endif
+
+    uint32_t bestErr[N];
+    int bestBase[N], bestMul[N], bestTable[N];
+    for( int c=0; c<N; c++ )
+    {
+        // a valid encoding in both modes, always replaced by the first candidate
+        bestErr[c] = std::numeric_limits<uint32_t>::max();
+        bestBase[c] = 128;
+        bestMul[c] = 1;
+        bestTable[c] = 0;
+    }
+
+    // Every modifier table is tried with the multiplier that stretches it over the block range. In
+    // high quality mode also with the next two larger ones, as clamping at the ends of the 11-bit
+    // range and the rounded base make the fitted multiplier too small more often than too large.
+    const int sweeps = highQuality ? 3 : 1;
+    for( int d=0; d<sweeps; d++ )
+    {
+        alignas( 32 ) uint16_t base[N][16];
+        alignas( 32 ) uint16_t mul[N][16];
+        alignas( 32 ) uint32_t err[N][16];
+        Eac11TableError<N, Signed>( px, mn, mx, d, base, mul, err );
+
+        for( int c=0; c<N; c++ )
+        {
+            const int t = Eac11BestTable( err[c] );
+            if( err[c][t] < bestErr[c] )
+            {
+                bestErr[c] = err[c][t];
+                bestBase[c] = base[c][t];
+                bestMul[c] = mul[c][t];
+                bestTable[c] = t;
+            }
+        }
+    }
+
+    for( int c=0; c<N; c++ )
+    {
+        // The centered base is rounded; its neighbours may fit the values better.
+        const int refBase = bestBase[c];
+        for( int d=-1; d<=1; d+=2 )
+        {
+            const int base = std::min( 255, std::max( Signed ? 1 : 0, refBase + d ) );
+            uint16_t rec[8];
+            Eac11Reconstruct<Signed>( base, bestMul[c], bestTable[c], rec );
+            const auto err = Eac11Error( px[c], rec );
+            if( err < bestErr[c] )
+            {
+                bestErr[c] = err;
+                bestBase[c] = base;
+            }
+        }
+
+        uint16_t rec[8];
+        Eac11Reconstruct<Signed>( bestBase[c], bestMul[c], bestTable[c], rec );
+
+        const uint8_t baseCode = Signed ? uint8_t( bestBase[c] - 128 ) : bestBase[c];
+        const uint64_t d = ( uint64_t( baseCode ) << 56 ) |
+            ( uint64_t( bestMul[c] ) << 52 ) |
+            ( uint64_t( bestTable[c] ) << 48 ) |
+            Eac11Indices( px[c], rec );
+
+        dst[c] = _bswap64( d );
+    }
+}
+
 void CompressEtc1Rgb( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
 {
     int w = 0;
     uint32_t buf[4*4];
+#ifdef __AVX2__
+    alignas( 32 ) uint32_t buf2[2][4*4];
+#endif
     do
     {
+#ifdef __AVX2__
+        if( blocks >= 2 && size_t( w + 2 ) <= width/4 )
+        {
+            for( int i=0; i<2; i++ )
+            {
+                __m128 px0 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 0 ) ) );
+                __m128 px1 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 1 ) ) );
+                __m128 px2 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 2 ) ) );
+                __m128 px3 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 3 ) ) );
+
+                _MM_TRANSPOSE4_PS( px0, px1, px2, px3 );
+
+                _mm_store_si128( (__m128i*)(buf2[i] + 0),  _mm_castps_si128( px0 ) );
+                _mm_store_si128( (__m128i*)(buf2[i] + 4),  _mm_castps_si128( px1 ) );
+                _mm_store_si128( (__m128i*)(buf2[i] + 8),  _mm_castps_si128( px2 ) );
+                _mm_store_si128( (__m128i*)(buf2[i] + 12), _mm_castps_si128( px3 ) );
+
+                src += 4;
+            }
+            w += 2;
+            if( size_t( w ) == width/4 )
+            {
+                src += width * 3;
+                w = 0;
+            }
+            ProcessRGB_x2_AVX2( (uint8_t*)buf2[0], (uint8_t*)buf2[1], dst );
+            dst += 2;
+            --blocks;
+            continue;
+        }
+#endif
 #ifdef __SSE4_1__
         __m128 px0 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 0 ) ) );
         __m128 px1 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 1 ) ) );
@@ -3996,6 +4631,50 @@ void CompressEtc2Rgb( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_
     while( --blocks );
 }
 
+void CompressEtc2Rgb8A1( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool useHeuristics )
+{
+    size_t w = 0;
+    uint32_t buf[4*4];
+    do
+    {
+#ifdef __SSE4_1__
+        __m128 px0 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 0 ) ) );
+        __m128 px1 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 1 ) ) );
+        __m128 px2 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 2 ) ) );
+        __m128 px3 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 3 ) ) );
+
+        _MM_TRANSPOSE4_PS( px0, px1, px2, px3 );
+
+        _mm_store_si128( (__m128i*)(buf + 0),  _mm_castps_si128( px0 ) );
+        _mm_store_si128( (__m128i*)(buf + 4),  _mm_castps_si128( px1 ) );
+        _mm_store_si128( (__m128i*)(buf + 8),  _mm_castps_si128( px2 ) );
+        _mm_store_si128( (__m128i*)(buf + 12), _mm_castps_si128( px3 ) );
+
+        src += 4;
+#else
+        auto ptr = buf;
+        for( int x=0; x<4; x++ )
+        {
+            *ptr++ = *src;
+            src += width;
+            *ptr++ = *src;
+            src += width;
+            *ptr++ = *src;
+            src += width;
+            *ptr++ = *src;
+            src -= width * 3 - 1;
+        }
+#endif
+        if( ++w == width/4 )
+        {
+            src += width * 3;
+            w = 0;
+        }
+        *dst++ = ProcessRGB8A1_ETC2( (uint8_t*)buf, useHeuristics );
+    }
+    while( --blocks );
+}
+
 void CompressEtc2Rgba( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool useHeuristics )
 {
     int w = 0;
@@ -4069,142 +4748,85 @@ void CompressEtc2Rgba( const uint32_t* src, uint64_t* dst, uint32_t blocks, size
     while( --blocks );
 }
 
-void CompressEacR( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
+void CompressEacR( const uint64_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool isSigned, bool highQuality )
 {
     int w = 0;
-    uint8_t r[4*4];
+    uint16_t r[4*4];
     do
     {
-#ifdef __SSE4_1__
-        __m128 px0 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 0 ) ) );
-        __m128 px1 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 1 ) ) );
-        __m128 px2 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 2 ) ) );
-        __m128 px3 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 3 ) ) );
-
-        _MM_TRANSPOSE4_PS( px0, px1, px2, px3 );
-
-        __m128i c0 = _mm_castps_si128( px0 );
-        __m128i c1 = _mm_castps_si128( px1 );
-        __m128i c2 = _mm_castps_si128( px2 );
-        __m128i c3 = _mm_castps_si128( px3 );
-
-        __m128i mask = _mm_setr_epi32( 0x0e0a0602, -1, -1, -1 );
-
-        __m128i a0 = _mm_shuffle_epi8( c0, mask );
-        __m128i a1 = _mm_shuffle_epi8( c1, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
-        __m128i a2 = _mm_shuffle_epi8( c2, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
-        __m128i a3 = _mm_shuffle_epi8( c3, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
-
-        __m128i s0 = _mm_or_si128( a0, a1 );
-        __m128i s1 = _mm_or_si128( a2, a3 );
-        __m128i s2 = _mm_or_si128( s0, s1 );
-
-        _mm_store_si128( (__m128i*)r, s2 );
-
-        src += 4;
-#else
-        auto ptr8 = r;
+        auto ptr = r;
         for( int x=0; x<4; x++ )
         {
-            auto v = *src;
-            *ptr8++ = (v & 0xff0000) >> 16;
-            src += width;
-            v = *src;
-            *ptr8++ = (v & 0xff0000) >> 16;
-            src += width;
-            v = *src;
-            *ptr8++ = (v & 0xff0000) >> 16;
-            src += width;
-            v = *src;
-            *ptr8++ = (v & 0xff0000) >> 16;
-            src -= width * 3 - 1;
+            *ptr++ = uint16_t( src[width * 0] >> 32 );
+            *ptr++ = uint16_t( src[width * 1] >> 32 );
+            *ptr++ = uint16_t( src[width * 2] >> 32 );
+            *ptr++ = uint16_t( src[width * 3] >> 32 );
+            src++;
         }
-#endif
         if( ++w == width/4 )
         {
             src += width * 3;
             w = 0;
         }
-        *dst++ = ProcessAlpha_ETC2<false>( r );
+        if( isSigned )
+        {
+            ProcessEac11<1, true>( r, dst++, highQuality );
+        }
+        else
+        {
+            ProcessEac11<1, false>( r, dst++, highQuality );
+        }
     }
     while( --blocks );
 }
 
-void CompressEacRg( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width )
+void CompressEacRg( const uint64_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool isSigned, bool highQuality )
 {
     int w = 0;
-    uint8_t rg[4*4*2];
+    uint16_t rg[4*4*2];
     do
     {
-#ifdef __SSE4_1__
-        __m128 px0 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 0 ) ) );
-        __m128 px1 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 1 ) ) );
-        __m128 px2 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 2 ) ) );
-        __m128 px3 = _mm_castsi128_ps( _mm_loadu_si128( (__m128i*)( src + width * 3 ) ) );
-
-        _MM_TRANSPOSE4_PS( px0, px1, px2, px3 );
-
-        __m128i c0 = _mm_castps_si128( px0 );
-        __m128i c1 = _mm_castps_si128( px1 );
-        __m128i c2 = _mm_castps_si128( px2 );
-        __m128i c3 = _mm_castps_si128( px3 );
-
-        __m128i mask = _mm_setr_epi32( 0x0e0a0602, -1, -1, -1 );
-
-        __m128i r0 = _mm_shuffle_epi8( c0, mask );
-        __m128i r1 = _mm_shuffle_epi8( c1, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
-        __m128i r2 = _mm_shuffle_epi8( c2, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
-        __m128i r3 = _mm_shuffle_epi8( c3, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
-
-        __m128i s0 = _mm_or_si128( r0, r1 );
-        __m128i s1 = _mm_or_si128( r2, r3 );
-        __m128i s2 = _mm_or_si128( s0, s1 );
-
-        _mm_store_si128( (__m128i*)rg, s2 );
-
-        mask = _mm_setr_epi32( 0x0d090501, -1, -1, -1 );
-
-        r0 = _mm_shuffle_epi8( c0, mask );
-        r1 = _mm_shuffle_epi8( c1, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 3, 0, 3 ) ) );
-        r2 = _mm_shuffle_epi8( c2, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 3, 0, 3, 3 ) ) );
-        r3 = _mm_shuffle_epi8( c3, _mm_shuffle_epi32( mask, _MM_SHUFFLE( 0, 3, 3, 3 ) ) );
-
-        s0 = _mm_or_si128( r0, r1 );
-        s1 = _mm_or_si128( r2, r3 );
-        s2 = _mm_or_si128( s0, s1 );
-
-        _mm_store_si128( (__m128i*)&rg[16], s2 );
-        src += 4;
-#else
         auto ptrr = rg;
         auto ptrg = ptrr + 16;
         for( int x=0; x<4; x++ )
         {
-            auto v = *src;
-            *ptrr++ = (v & 0xff0000) >> 16;
-            *ptrg++ = (v & 0xff00) >> 8;
-            src += width;
-            v = *src;
-            *ptrr++ = (v & 0xff0000) >> 16;
-            *ptrg++ = (v & 0xff00) >> 8;
-            src += width;
-            v = *src;
-            *ptrr++ = (v & 0xff0000) >> 16;
-            *ptrg++ = (v & 0xff00) >> 8;
-            src += width;
-            v = *src;
-            *ptrr++ = (v & 0xff0000) >> 16;
-            *ptrg++ = (v & 0xff00) >> 8;
-            src -= width * 3 - 1;
+            for( int y=0; y<4; y++ )
+            {
+                const auto v = src[width * y];
+                *ptrr++ = uint16_t( v >> 32 );
+                *ptrg++ = uint16_t( v >> 16 );
+            }
+            src++;
         }
-#endif
         if( ++w == width/4 )
         {
             src += width * 3;
             w = 0;
         }
-        *dst++ = ProcessAlpha_ETC2<false>( rg );
-        *dst++ = ProcessAlpha_ETC2<false>( &rg[16] );
+        if( isSigned )
+        {
+            ProcessEac11<2, true>( rg, dst, highQuality );
+        }
+        else
+        {
+            ProcessEac11<2, false>( rg, dst, highQuality );
+        }
+        dst += 2;
     }
     while( --blocks );
 }
+
+uint64_t CompressEtc1RgbBlock( const uint32_t* px )
+{
+    return ProcessRGB( (const uint8_t*)px );
+}
+
+uint64_t CompressEtc2RgbBlock( const uint32_t* px, bool useHeuristics )
+{
+    return ProcessRGB_ETC2( (const uint8_t*)px, useHeuristics );
+}
+
+uint64_t CompressEtc2AlphaBlock( const uint8_t* alpha )
+{
+    return ProcessAlpha_ETC2<true>( alpha );
+}
@@ -7,8 +7,16 @@ void CompressEtc1Rgb( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_
 void CompressEtc1RgbDither( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
 void CompressEtc2Rgb( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool useHeuristics );
 void CompressEtc2Rgba( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool useHeuristics );
+void CompressEtc2Rgb8A1( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool useHeuristics );
 
-void CompressEacR( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
-void CompressEacRg( const uint32_t* src, uint64_t* dst, uint32_t blocks, size_t width );
+// High quality also tries the two multipliers above the fitted one, at half the speed
+void CompressEacR( const uint64_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool isSigned = false, bool highQuality = false );
+void CompressEacRg( const uint64_t* src, uint64_t* dst, uint32_t blocks, size_t width, bool isSigned = false, bool highQuality = false );
+
+// Single block kernels for benchmarking, without the loads from the source image. Pixels are in
+// column order, as the functions above transpose them.
+uint64_t CompressEtc1RgbBlock( const uint32_t* px );
+uint64_t CompressEtc2RgbBlock( const uint32_t* px, bool useHeuristics );
+uint64_t CompressEtc2AlphaBlock( const uint8_t* alpha );
 
 #endif
@@ -4,6 +4,8 @@
 #include <condition_variable>
 #include <mutex>
 
+#include <tracy/Tracy.hpp>
+
 class Semaphore
 {
 public:
@@ -11,21 +13,21 @@ public:
 
     void lock()
     {
-        std::unique_lock<std::mutex> lock( m_mutex );
+        std::unique_lock<LockableBase( std::mutex )> lock( m_mutex );
         m_cv.wait( lock, [this](){ return m_count != 0; } );
         m_count--;
     }
 
     void unlock()
     {
-        std::lock_guard<std::mutex> lock( m_mutex );
+        std::lock_guard<LockableBase( std::mutex )> lock( m_mutex );
         m_count++;
         m_cv.notify_one();
     }
 
     bool try_lock()
     {
-        std::lock_guard<std::mutex> lock( m_mutex );
+        std::lock_guard<LockableBase( std::mutex )> lock( m_mutex );
         if( m_count == 0 )
         {
             return false;
@@ -38,8 +40,12 @@ public:
     }
 
 private:
-    std::mutex m_mutex;
+    TracyLockable( std::mutex, m_mutex );
+#ifdef TRACY_ENABLE
+    std::condition_variable_any m_cv;   // waits on the tracy::Lockable wrapper
+#else
     std::condition_variable m_cv;
+#endif
     unsigned int m_count;
 };
 
@@ -0,0 +1,76 @@
+#include <memory>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef ETCPAK_ZSTD
+#  include <zstd.h>
+#endif
+
+#include "Supercompress.hpp"
+
+size_t CalcDeflateSize( const uint8_t* src, size_t size )
+{
+    auto bound = compressBound( size );
+    auto buf = std::make_unique<uint8_t[]>( bound );
+    if( compress2( buf.get(), &bound, src, size, Z_BEST_COMPRESSION ) != Z_OK ) return 0;
+    return bound;
+}
+
+std::vector<uint8_t> CompressGzip( const uint8_t* src, size_t size )
+{
+    z_stream strm = {};
+    if( deflateInit2( &strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) return {};
+    std::vector<uint8_t> out( deflateBound( &strm, size ) );
+    strm.next_in = (Bytef*)src;
+    strm.avail_in = size;
+    strm.next_out = out.data();
+    strm.avail_out = out.size();
+    const auto ret = deflate( &strm, Z_FINISH );
+    deflateEnd( &strm );
+    if( ret != Z_STREAM_END ) return {};
+    out.resize( strm.total_out );
+    return out;
+}
+
+#ifdef ETCPAK_ZSTD
+size_t CalcZstdSize( const uint8_t* src, size_t size )
+{
+    auto bound = ZSTD_compressBound( size );
+    auto buf = std::make_unique<uint8_t[]>( bound );
+    auto ret = ZSTD_compress( buf.get(), bound, src, size, 19 );
+    if( ZSTD_isError( ret ) ) return 0;
+    return ret;
+}
+
+std::vector<uint8_t> CompressZstd( const uint8_t* src, size_t size, int level )
+{
+    std::vector<uint8_t> ret( ZSTD_compressBound( size ) );
+    auto len = ZSTD_compress( ret.data(), ret.size(), src, size, level );
+    if( ZSTD_isError( len ) ) return {};
+    ret.resize( len );
+    return ret;
+}
+
+bool DecompressZstd( uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize )
+{
+    auto ret = ZSTD_decompress( dst, dstSize, src, srcSize );
+    return !ZSTD_isError( ret ) && ret == dstSize;
+}
+
+// zstd seekable format: a skippable frame listing all frames, ending with a footer
+std::vector<uint8_t> ZstdSeekTable( const std::vector<uint32_t>& sizes )
+{
+    const uint32_t frames = sizes.size() / 2;
+    std::vector<uint8_t> ret( 8 + sizes.size() * 4 + 9 );
+    auto dst = ret.data();
+    const uint32_t header[2] = { 0x184D2A5E, uint32_t( ret.size() - 8 ) };
+    memcpy( dst, header, 8 );
+    memcpy( dst + 8, sizes.data(), sizes.size() * 4 );
+    dst += 8 + sizes.size() * 4;
+    memcpy( dst, &frames, 4 );
+    dst[4] = 0;                                     // no checksums
+    const uint32_t magic = 0x8F92EAB1;
+    memcpy( dst + 5, &magic, 4 );
+    return ret;
+}
+#endif
@@ -0,0 +1,19 @@
+#ifndef __SUPERCOMPRESS_HPP__
+#define __SUPERCOMPRESS_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// The compress functions return an empty vector if compression fails
+size_t CalcDeflateSize( const uint8_t* src, size_t size );
+std::vector<uint8_t> CompressGzip( const uint8_t* src, size_t size );
+#ifdef ETCPAK_ZSTD
+size_t CalcZstdSize( const uint8_t* src, size_t size );
+std::vector<uint8_t> CompressZstd( const uint8_t* src, size_t size, int level );
+bool DecompressZstd( uint8_t* dst, size_t dstSize, const uint8_t* src, size_t srcSize );
+// sizes are pairs of compressed and decompressed frame sizes
+std::vector<uint8_t> ZstdSeekTable( const std::vector<uint32_t>& sizes );
+#endif
+
+#endif
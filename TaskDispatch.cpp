@@ -4,6 +4,7 @@
 #include "Debug.hpp"
 #include "System.hpp"
 #include "TaskDispatch.hpp"
+#include "Trace.hpp"
 
 static TaskDispatch* s_instance = nullptr;
 
@@ -55,9 +56,10 @@ TaskDispatch::~TaskDispatch()
 
 void TaskDispatch::Queue( const std::function<void(void)>& f )
 {
-    std::unique_lock<std::mutex> lock( s_instance->m_queueLock );
+    std::unique_lock<LockableBase( std::mutex )> lock( s_instance->m_queueLock );
     s_instance->m_queue.emplace_back( f );
     const auto size = s_instance->m_queue.size();
+    TracyPlot( "Task queue", int64_t( size ) );
     lock.unlock();
     if( size > 1 )
     {
@@ -67,9 +69,10 @@ void TaskDispatch::Queue( const std::function<void(void)>& f )
 
 void TaskDispatch::Queue( std::function<void(void)>&& f )
 {
-    std::unique_lock<std::mutex> lock( s_instance->m_queueLock );
+    std::unique_lock<LockableBase( std::mutex )> lock( s_instance->m_queueLock );
     s_instance->m_queue.emplace_back( std::move( f ) );
     const auto size = s_instance->m_queue.size();
+    TracyPlot( "Task queue", int64_t( size ) );
     lock.unlock();
     if( size > 1 )
     {
@@ -79,30 +82,42 @@ void TaskDispatch::Queue( std::function<void(void)>&& f )
 
 void TaskDispatch::Sync()
 {
-    std::unique_lock<std::mutex> lock( s_instance->m_queueLock );
+    std::unique_lock<LockableBase( std::mutex )> lock( s_instance->m_queueLock );
     while( !s_instance->m_queue.empty() )
     {
         auto f = s_instance->m_queue.back();
         s_instance->m_queue.pop_back();
+        TracyPlot( "Task queue", int64_t( s_instance->m_queue.size() ) );
         lock.unlock();
-        f();
+        {
+            TraceScope trace( "Task" );
+            f();
+        }
         lock.lock();
     }
+    ZoneScopedN( "Sync wait" );
+    TraceScope trace( "Sync wait" );
     s_instance->m_cvJobs.wait( lock, []{ return s_instance->m_jobs == 0; } );
 }
 
 void TaskDispatch::Worker()
 {
+    TraceThreadName( "Worker" );
     for(;;)
     {
-        std::unique_lock<std::mutex> lock( m_queueLock );
+        std::unique_lock<LockableBase( std::mutex )> lock( m_queueLock );
         m_cvWork.wait( lock, [this]{ return !m_queue.empty() || m_exit; } );
         if( m_exit ) return;
         auto f = m_queue.back();
         m_queue.pop_back();
+        TracyPlot( "Task queue", int64_t( m_queue.size() ) );
         m_jobs++;
         lock.unlock();
-        f();
+        {
+            ZoneScopedN( "Job" );
+            TraceScope trace( "Task" );
+            f();
+        }
         lock.lock();
         m_jobs--;
         bool notify = m_jobs == 0 && m_queue.empty();
@@ -8,6 +8,8 @@
 #include <thread>
 #include <vector>
 
+#include <tracy/Tracy.hpp>
+
 class TaskDispatch
 {
 public:
@@ -23,8 +25,12 @@ private:
     void Worker();
 
     std::vector<std::function<void(void)>> m_queue;
-    std::mutex m_queueLock;
+    TracyLockable( std::mutex, m_queueLock );
+#ifdef TRACY_ENABLE
+    std::condition_variable_any m_cvWork, m_cvJobs;     // wait on the tracy::Lockable wrapper
+#else
     std::condition_variable m_cvWork, m_cvJobs;
+#endif
     std::atomic<bool> m_exit;
     size_t m_jobs;
 
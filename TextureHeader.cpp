@@ -1,126 +1,368 @@
 #include "TextureHeader.hpp"
+#include <algorithm>
 #include <cassert>
+#include <string.h>
+
+static void NextLevel( int32_t& width, int32_t& height )
+{
+    width = std::max( 1, width / 2 );
+    height = std::max( 1, height / 2 );
+}
+
+static bool PvrType( uint32_t format, uint32_t channelType, CodecType& type )
+{
+    // signedness of EAC data is given by the channel type (signed byte or short normalized)
+    const bool isSigned = channelType == 1 || channelType == 5;
+    switch( format )
+    {
+    case 6: type = Etc1; break;
+    case 7: type = Bc1; break;
+    case 11: type = Bc3; break;
+    case 12: type = Bc4; break;
+    case 13: type = Bc5; break;
+    case 15: type = Bc7; break;
+    case 22: type = Etc2_RGB; break;
+    case 23: type = Etc2_RGBA; break;
+    case 24: type = Etc2_RGB8A1; break;
+    case 25: type = isSigned ? Etc2_R11_Signed : Etc2_R11; break;
+    case 26: type = isSigned ? Etc2_RG11_Signed : Etc2_RG11; break;
+    default: return false;
+    }
+    return true;
+}
+
+static bool KtxType( uint32_t internalFormat, CodecType& type )
+{
+    switch( internalFormat )
+    {
+    case 0x8D64: type = Etc1; break;
+    case 0x9274: type = Etc2_RGB; break;
+    case 0x9278: type = Etc2_RGBA; break;
+    case 0x9276: type = Etc2_RGB8A1; break;
+    case 0x9270: type = Etc2_R11; break;
+    case 0x9271: type = Etc2_R11_Signed; break;
+    case 0x9272: type = Etc2_RG11; break;
+    case 0x9273: type = Etc2_RG11_Signed; break;
+    case 0x83F1: type = Bc1; break;
+    case 0x83F3: type = Bc3; break;
+    case 0x8DBB: type = Bc4; break;
+    case 0x8DBD: type = Bc5; break;
+    case 0x8E8C: type = Bc7; break;
+    default: return false;
+    }
+    return true;
+}
+
+static bool Ktx2Type( uint32_t vkFormat, CodecType& type )
+{
+    switch( vkFormat )
+    {
+    case 131:
+    case 133: type = Bc1; break;
+    case 137: type = Bc3; break;
+    case 139: type = Bc4; break;
+    case 141: type = Bc5; break;
+    case 145: type = Bc7; break;
+    case 147: type = Etc2_RGB; break;
+    case 149: type = Etc2_RGB8A1; break;
+    case 151: type = Etc2_RGBA; break;
+    case 153: type = Etc2_R11; break;
+    case 154: type = Etc2_R11_Signed; break;
+    case 155: type = Etc2_RG11; break;
+    case 156: type = Etc2_RG11_Signed; break;
+    default: return false;
+    }
+    return true;
+}
+
+// fourCC, or DXGI_FORMAT_BCn of the DX10 extended header
+static bool DdsType( uint32_t fourCC, uint32_t dxgiFormat, CodecType& type, size_t& dataOffset )
+{
+    dataOffset = 128;
+    switch( fourCC )
+    {
+    case 0x31545844: type = Bc1; return true;
+    case 0x35545844: type = Bc3; return true;
+    case 0x30315844: break;
+    default: return false;
+    }
+    dataOffset = 148;
+    switch( dxgiFormat )
+    {
+    case 71:
+    case 72: type = Bc1; break;
+    case 77:
+    case 78: type = Bc3; break;
+    case 80: type = Bc4; break;
+    case 83: type = Bc5; break;
+    case 98:
+    case 99: type = Bc7; break;
+    default: return false;
+    }
+    return true;
+}
+
+static int MaxMipLevels( int32_t width, int32_t height )
+{
+    int levels = 1;
+    for( auto size = std::max( width, height ); size > 1; size /= 2 ) levels++;
+    return levels;
+}
+
+static TextureError SetLayout( TextureInfo& info, uint32_t depth, uint32_t layers, uint32_t faces )
+{
+    depth = std::max( 1u, depth );
+    layers = std::max( 1u, layers );
+    if( faces != 1 && faces != 6 ) return TextureError::Unsupported;
+    // cube map arrays and arrays of 3d textures are not handled
+    if( ( depth > 1 ) + ( layers > 1 ) + ( faces > 1 ) > 1 ) return TextureError::Unsupported;
+    if( depth > MaxTextureSize || layers > MaxTextureSize ) return TextureError::BadDimensions;
+
+    info.layout = depth > 1 ? Texture3D : ( layers > 1 ? TextureArray : ( faces > 1 ? TextureCube : Texture2D ) );
+    info.slices = depth * layers * faces;
+    return TextureError::Ok;
+}
+
+TextureError ParseHeader( const uint8_t* data, size_t size, TextureInfo& info )
+{
+    if( size < 4 ) return TextureError::TooSmall;
+    const auto data32 = (const uint32_t*)data;
+    auto fieldAt = [data] ( size_t offset ) { uint32_t v; memcpy( &v, data + offset, 4 ); return v; };
+
+    info.supercompression = Supercompression::None;
+    uint32_t width, height;
+    size_t pos;
+    bool prefixed = false;      // ktx stores the size of each level in front of it
+    bool indexed = false;       // ktx2 gives the position of each level in the index
 
-void ProcessHeader(uint8_t* data, CodecType& type, int32_t& width, int32_t& height, size_t& dataOffset){
-    auto data32 = (uint32_t*)data;
     if( *data32 == 0x03525650 )
     {
-        // PVR
-        switch( *(data32+2) )
+        if( size < 52 ) return TextureError::TooSmall;
+        if( data32[3] != 0 || !PvrType( data32[2], data32[5], info.type ) ) return TextureError::UnknownFormat;
+        const auto error = SetLayout( info, data32[8], data32[9], data32[10] );
+        if( error != TextureError::Ok ) return error;
+        height = data32[6];
+        width = data32[7];
+        info.levels = data32[11];
+        if( data32[12] > size - 52 ) return TextureError::Truncated;
+        pos = 52 + data32[12];
+    }
+    else if( *data32 == 0x58544BAB )
+    {
+        if( size < 64 ) return TextureError::TooSmall;
+        if( data32[1] == 0xBB313120 && data32[2] == 0x0A1A0A0D )
+        {
+            if( data32[3] != 0x04030201 ) return TextureError::Unsupported;   // big endian
+            if( !KtxType( data32[7], info.type ) ) return TextureError::UnknownFormat;
+            const auto error = SetLayout( info, data32[11], data32[12], data32[13] );
+            if( error != TextureError::Ok ) return error;
+            width = data32[9];
+            height = data32[10];
+            info.levels = std::max( 1u, data32[14] );
+            if( data32[15] > size - 64 ) return TextureError::Truncated;
+            pos = 64 + data32[15] + 4;
+            prefixed = true;
+        }
+        else if( data32[1] == 0xBB303220 && data32[2] == 0x0A1A0A0D )
+        {
+            if( size < 80 ) return TextureError::TooSmall;
+            if( !Ktx2Type( data32[3], info.type ) ) return TextureError::UnknownFormat;
+            const auto error = SetLayout( info, data32[7], data32[8], data32[9] );
+            if( error != TextureError::Ok ) return error;
+#ifdef ETCPAK_ZSTD
+            if( data32[11] != uint32_t( Supercompression::None ) && data32[11] != uint32_t( Supercompression::Zstd ) ) return TextureError::Unsupported;
+#else
+            if( data32[11] != uint32_t( Supercompression::None ) ) return TextureError::Unsupported;
+#endif
+            width = data32[5];
+            height = data32[6];
+            info.levels = std::max( 1u, data32[10] );
+            info.supercompression = Supercompression( data32[11] );
+            pos = 80;
+            indexed = true;
+        }
+        else
+        {
+            return TextureError::UnknownFormat;
+        }
+    }
+    else if( *data32 == 0x20534444 )
+    {
+        if( size < 128 ) return TextureError::TooSmall;
+        if( data32[21] == 0x30315844 && size < 148 ) return TextureError::TooSmall;
+        const bool dx10 = data32[21] == 0x30315844;
+        if( !DdsType( data32[21], dx10 ? data32[32] : 0, info.type, pos ) ) return TextureError::UnknownFormat;
+        // caps2 cube map flags must list all faces, the dx10 header counts cubes in the array size
+        const bool cube = ( data32[28] & 0x200 ) != 0 || ( dx10 && ( data32[34] & 0x4 ) != 0 );
+        if( ( data32[28] & 0x200 ) != 0 && ( data32[28] & 0xFE00 ) != 0xFE00 ) return TextureError::Unsupported;
+        const uint32_t depth = ( data32[28] & 0x200000 ) != 0 ? data32[6] : 1;
+        const uint32_t layers = dx10 ? data32[35] : 1;
+        if( cube && layers > 1 ) return TextureError::Unsupported;
+        const auto error = SetLayout( info, depth, cube ? 1 : layers, cube ? 6 : 1 );
+        if( error != TextureError::Ok ) return error;
+        height = data32[3];
+        width = data32[4];
+        info.levels = std::max( 1u, data32[7] );
+    }
+    else
+    {
+        return TextureError::UnknownFormat;
+    }
+
+    if( width == 0 || height == 0 || width > MaxTextureSize || height > MaxTextureSize ) return TextureError::BadDimensions;
+    info.width = width;
+    info.height = height;
+    if( info.levels < 1 || info.levels > MaxMipLevels( width, height ) ) return TextureError::BadLevels;
+    // mip levels of 3d textures would also halve the depth
+    if( info.layout == Texture3D && info.levels > 1 ) return TextureError::Unsupported;
+
+    if( indexed )
+    {
+        if( size - 80 < size_t( info.levels ) * 24 ) return TextureError::TooSmall;
+        int32_t w = width, h = height;
+        for( int i=0; i<info.levels; i++ )
         {
-        case 6:
-            type = Etc1;
-            break;
-        case 7:
-            type = Bc1;
-            break;
-        case 11:
-            type = Bc3;
-            break;
-        case 12:
-            type = Bc4;
-            break;
-        case 13:
-            type = Bc5;
-            break;
-        case 15:
-            type = Bc7;
-            break;
-        case 22:
-            type = Etc2_RGB;
-            break;
-        case 23:
-            type = Etc2_RGBA;
-            break;
-        case 25:
-            type = Etc2_R11;
-            break;
-        case 26:
-            type = Etc2_RG11;
-            break;
-        default:
-            assert( false );
-            break;
+            uint64_t index[3];
+            memcpy( index, data + 80 + i * 24, 24 );
+            if( index[0] > size || index[1] > size - index[0] ) return TextureError::Truncated;
+            if( index[2] != LevelDataSize( info.type, w, h ) * info.slices ) return TextureError::BadLevelSize;
+            if( info.supercompression == Supercompression::None && index[1] != index[2] ) return TextureError::BadLevelSize;
+            if( i == 0 ) info.dataOffset = index[0];
+            NextLevel( w, h );
         }
+        return TextureError::Ok;
+    }
 
+    // the mip chain follows the header, check it against the file size; dds stores all levels of a slice
+    // together instead of all slices of a level, which takes the same space
+    info.dataOffset = pos;
+    int32_t w = width, h = height;
+    for( int i=0; i<info.levels; i++ )
+    {
+        const auto levelSize = LevelDataSize( info.type, w, h ) * info.slices;
+        if( prefixed )
+        {
+            // except in cube map arrays, ktx gives the size of a single face
+            const auto imageSize = info.layout == TextureCube ? levelSize / 6 : levelSize;
+            if( pos > size ) return TextureError::Truncated;
+            if( fieldAt( pos - 4 ) != imageSize ) return TextureError::BadLevelSize;
+        }
+        if( pos > size || levelSize > size - pos ) return TextureError::Truncated;
+        pos += levelSize + ( prefixed ? 4 : 0 );
+        NextLevel( w, h );
+    }
+    return TextureError::Ok;
+}
+
+const char* TextureErrorString( TextureError error )
+{
+    switch( error )
+    {
+    case TextureError::Ok: return "ok";
+    case TextureError::CannotOpen: return "cannot open file";
+    case TextureError::TooSmall: return "file too small for header";
+    case TextureError::UnknownFormat: return "unknown file or pixel format";
+    case TextureError::Unsupported: return "unsupported texture layout or supercompression";
+    case TextureError::BadDimensions: return "invalid dimensions";
+    case TextureError::BadLevels: return "invalid number of mip levels";
+    case TextureError::Truncated: return "data extends past end of file";
+    case TextureError::BadLevelSize: return "level size does not match dimensions";
+    case TextureError::CorruptBlock: return "corrupt block data";
+    case TextureError::BadSupercompression: return "cannot decompress level data";
+    default: return "unknown error";
+    }
+}
+
+const char* CodecName( CodecType type )
+{
+    switch( type )
+    {
+    case Etc1: return "etc1";
+    case Etc2_RGB: return "etc2_rgb";
+    case Etc2_RGBA: return "etc2_rgba";
+    case Etc2_RGB8A1: return "etc2_rgb8a1";
+    case Etc2_R11: return "etc2_r";
+    case Etc2_RG11: return "etc2_rg";
+    case Etc2_R11_Signed: return "etc2_r_signed";
+    case Etc2_RG11_Signed: return "etc2_rg_signed";
+    case Bc1: return "bc1";
+    case Bc3: return "bc3";
+    case Bc4: return "bc4";
+    case Bc5: return "bc5";
+    case Bc7: return "bc7";
+    default: return "unknown";
+    }
+}
+
+void ProcessHeader(uint8_t* data, CodecType& type, int32_t& width, int32_t& height, size_t& dataOffset, int level, size_t* dataSize, Supercompression* supercompression){
+    auto data32 = (uint32_t*)data;
+    if( supercompression ) *supercompression = Supercompression::None;
+    if( *data32 == 0x03525650 )
+    {
+        // PVR
+        [[maybe_unused]] const bool ok = PvrType( *(data32+2), *(data32+5), type );
+        assert( ok );
+
+        // depth, surfaces and faces of each level are stored together
+        const size_t slices = std::max( 1u, *(data32+8) ) * std::max( 1u, *(data32+9) ) * std::max( 1u, *(data32+10) );
         height = *(data32+6);
         width = *(data32+7);
         dataOffset = 52 + *(data32+12);
+        for( int i=0; i<level; i++ )
+        {
+            dataOffset += LevelDataSize( type, width, height ) * slices;
+            NextLevel( width, height );
+        }
+        if( dataSize ) *dataSize = LevelDataSize( type, width, height );
     }
-    else if( *data32 == 0x58544BAB )
+    else if( *data32 == 0x58544BAB && *(data32+1) == 0xBB313120 )
     {
         // KTX
-        switch( *(data32+7) )
-        {
-        case 0x9274:
-            type = Etc2_RGB;
-            break;
-        case 0x9278:
-            type = Etc2_RGBA;
-            break;
-        case 0x9270:
-            type = Etc2_R11;
-            break;
-        case 0x9272:
-            type = Etc2_RG11;
-            break;
-        default:
-            assert( false );
-            break;
-        }
+        [[maybe_unused]] const bool ok = KtxType( *(data32+7), type );
+        assert( ok );
 
         width = *(data32+9);
         height = *(data32+10);
         dataOffset = sizeof( uint32_t ) * 17 + *(data32+15);
+        // each level is preceded by its imageSize, which is the size of one face in cube maps
+        const uint32_t faces = *(data32+12) == 0 ? *(data32+13) : 1;
+        for( int i=0; i<level; i++ )
+        {
+            dataOffset += *(uint32_t*)( data + dataOffset - 4 ) * faces + 4;
+            NextLevel( width, height );
+        }
+        if( dataSize ) *dataSize = *(uint32_t*)( data + dataOffset - 4 );
+    }
+    else if( *data32 == 0x58544BAB && *(data32+1) == 0xBB303220 )
+    {
+        // KTX2
+        [[maybe_unused]] const bool ok = Ktx2Type( *(data32+3), type );
+        assert( ok );
+
+        assert( uint32_t( level ) < std::max( 1u, *(data32+10) ) );
+        width = std::max( 1, int32_t( *(data32+5) ) >> level );
+        height = std::max( 1, int32_t( *(data32+6) ) >> level );
+
+        // level index: byteOffset, byteLength, uncompressedByteLength
+        auto index = (const uint64_t*)( data + 80 ) + level * 3;
+        dataOffset = index[0];
+        if( dataSize ) *dataSize = index[1];
+        if( supercompression ) *supercompression = Supercompression( *(data32+11) );
     }
     else if( *data32 == 0x20534444 )
     {
         // DDS
-        switch( *(data32+21) )
-        {
-        case 0x31545844:
-            type = Bc1;
-            dataOffset = 128;
-            break;
-        case 0x35545844:
-            type = Bc3;
-            dataOffset = 128;
-            break;
-        case 0x30315844:
-            dataOffset = 148;
-            // DXGI_FORMAT_BCn
-            switch( *(data32+32) )
-            {
-            case 71:
-            case 72:
-                type = Bc1;
-                break;
-            case 77:
-            case 78:
-                type = Bc3;
-                break;
-            case 80:
-                type = Bc4;
-                break;
-            case 83:
-                type = Bc5;
-                break;
-            case 98:
-            case 99:
-                type = Bc7;
-                break;
-            default:
-                assert( false );
-                break;
-            };
-            break;
-        default:
-            assert( false );
-            break;
-        };
+        [[maybe_unused]] const bool ok = DdsType( *(data32+21), *(data32+32), type, dataOffset );
+        assert( ok );
 
         width = *(data32+4);
         height = *(data32+3);
+        for( int i=0; i<level; i++ )
+        {
+            dataOffset += LevelDataSize( type, width, height );
+            NextLevel( width, height );
+        }
+        if( dataSize ) *dataSize = LevelDataSize( type, width, height );
     }
     else
     {
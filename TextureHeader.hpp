@@ -10,8 +10,11 @@ enum CodecType
     Etc1,
     Etc2_RGB,
     Etc2_RGBA,
+    Etc2_RGB8A1,
     Etc2_R11,
     Etc2_RG11,
+    Etc2_R11_Signed,
+    Etc2_RG11_Signed,
     Bc1,
     Bc3,
     Bc4,
@@ -19,6 +22,86 @@ enum CodecType
     Bc7
 };
 
+// Cube faces (+X, -X, +Y, -Y, +Z, -Z), array layers or depth slices stored in one file
+enum TextureLayout
+{
+    Texture2D,
+    TextureCube,
+    TextureArray,
+    Texture3D
+};
+
+// values match the ktx2 supercompressionScheme field
+enum class Supercompression : uint32_t
+{
+    None = 0,
+    Zstd = 2,
+    Deflate = 3     // zlib in ktx2, a gzip member when compressing whole files
+};
+
+static etcpak_force_inline size_t BytesPerBlock( CodecType type )
+{
+    return ( type == Etc2_RGBA || type == Etc2_RG11 || type == Etc2_RG11_Signed || type == Bc3 || type == Bc5 || type == Bc7 ) ? 16 : 8;
+}
+
+// Channels besides alpha, in R, G, B order
+static etcpak_force_inline int ColorChannels( CodecType type )
+{
+    if( type == Etc2_R11 || type == Etc2_R11_Signed || type == Bc4 ) return 1;
+    if( type == Etc2_RG11 || type == Etc2_RG11_Signed || type == Bc5 ) return 2;
+    return 3;
+}
+
+static etcpak_force_inline bool HasAlpha( CodecType type )
+{
+    return type == Etc2_RGBA || type == Etc2_RGB8A1 || type == Bc3 || type == Bc7;
+}
+
+static etcpak_force_inline size_t LevelDataSize( CodecType type, int32_t width, int32_t height )
+{
+    return size_t( ( width + 3 ) / 4 ) * size_t( ( height + 3 ) / 4 ) * BytesPerBlock( type );
+}
+
+enum class TextureError
+{
+    Ok,
+    CannotOpen,
+    TooSmall,
+    UnknownFormat,
+    Unsupported,
+    BadDimensions,
+    BadLevels,
+    Truncated,
+    BadLevelSize,
+    CorruptBlock,
+    BadSupercompression
+};
+
+struct TextureInfo
+{
+    CodecType type;
+    int32_t width;
+    int32_t height;
+    int levels;
+    TextureLayout layout;
+    int slices;         // faces, layers or depth slices of each level
+    size_t dataOffset;  // of level 0, first slice
+    Supercompression supercompression;
+};
+
+enum { MaxTextureSize = 65536 };
+
+// Validates the header and the mip chain layout against the file size, touching only the header and the ktx
+// level size fields. Does not allocate.
+TextureError ParseHeader( const uint8_t* data, size_t size, TextureInfo& info );
+const char* TextureErrorString( TextureError error );
+// Codec name as given on the command line
+const char* CodecName( CodecType type );
+
 // Public interface for processing header
-etcpak_no_inline void ProcessHeader(uint8_t* data, CodecType& type, int32_t& width, int32_t& height, size_t& dataOffset);
+// Locates the data of mipmap level, width and height are the dimensions of that level. Ktx2 files give the position of
+// each level directly, dataSize is the stored (possibly supercompressed) size of the level. Only the first face, layer or
+// depth slice is located in files holding more than one. The header is trusted, use
+// ParseHeader() first on files of unknown origin.
+etcpak_no_inline void ProcessHeader(uint8_t* data, CodecType& type, int32_t& width, int32_t& height, size_t& dataOffset, int level = 0, size_t* dataSize = nullptr, Supercompression* supercompression = nullptr);
 #endif
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Trace.hpp"
+
+struct TraceRecord
+{
+    const char* name;
+    int64_t arg;
+    uint64_t begin;
+    uint64_t end;
+};
+
+struct TraceBuffer
+{
+    enum { Size = 1 << 16 };
+
+    TraceRecord events[Size];
+    std::atomic<uint64_t> head { 0 };   // events ever recorded, only the owning thread writes it
+    const char* name = "Thread";
+};
+
+static bool s_enabled = false;
+static std::chrono::steady_clock::time_point s_start;
+static std::mutex s_lock;
+static std::vector<std::unique_ptr<TraceBuffer>> s_buffers;      // outlive the threads
+static std::vector<TraceBuffer*> s_free;                          // of exited threads, with their events
+
+// Short-lived threads, e.g. the loader and downsampler of each image and mip level, hand their buffer
+// over to the next thread of the same name instead of each keeping one for the process lifetime
+static TraceBuffer* AcquireBuffer( const char* name )
+{
+    std::lock_guard<std::mutex> lock( s_lock );
+    for( auto it = s_free.begin(); it != s_free.end(); ++it )
+    {
+        if( strcmp( (*it)->name, name ) == 0 )
+        {
+            auto buffer = *it;
+            s_free.erase( it );
+            return buffer;
+        }
+    }
+    // not value-initialized, the pages of the events are only touched once recorded
+    s_buffers.emplace_back( new TraceBuffer );
+    s_buffers.back()->name = name;
+    return s_buffers.back().get();
+}
+
+struct ThreadSlot
+{
+    ~ThreadSlot()
+    {
+        if( !buffer ) return;
+        std::lock_guard<std::mutex> lock( s_lock );
+        s_free.emplace_back( buffer );
+    }
+
+    TraceBuffer* buffer = nullptr;
+};
+
+static thread_local ThreadSlot s_thread;
+
+static TraceBuffer& ThreadBuffer()
+{
+    if( !s_thread.buffer ) s_thread.buffer = AcquireBuffer( "Thread" );
+    return *s_thread.buffer;
+}
+
+// Threads started later see the flag through the synchronization of their creation
+void TraceStart()
+{
+    s_start = std::chrono::steady_clock::now();
+    s_enabled = true;
+    TraceThreadName( "Main" );
+}
+
+bool TraceEnabled()
+{
+    return s_enabled;
+}
+
+uint64_t TraceTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - s_start ).count();
+}
+
+void TraceEvent( const char* name, uint64_t begin, uint64_t end, int64_t arg )
+{
+    auto& buffer = ThreadBuffer();
+    const auto head = buffer.head.load( std::memory_order_relaxed );
+    buffer.events[head % TraceBuffer::Size] = TraceRecord { name, arg, begin, end };
+    buffer.head.store( head + 1, std::memory_order_release );
+}
+
+void TraceThreadName( const char* name )
+{
+    if( !s_enabled ) return;
+    if( s_thread.buffer ) s_thread.buffer->name = name;
+    else s_thread.buffer = AcquireBuffer( name );
+}
+
+bool TraceWrite( const char* fn )
+{
+    FILE* f = fopen( fn, "w" );
+    if( !f ) return false;
+
+    std::lock_guard<std::mutex> lock( s_lock );
+    uint64_t dropped = 0;
+    fprintf( f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n" );
+    for( size_t i=0; i<s_buffers.size(); i++ )
+    {
+        const auto& buffer = *s_buffers[i];
+        fprintf( f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}", i == 0 ? "" : ",\n", i, buffer.name );
+        const auto head = buffer.head.load( std::memory_order_acquire );
+        const auto first = head > TraceBuffer::Size ? head - TraceBuffer::Size : 0;
+        dropped += first;
+        for( auto j=first; j<head; j++ )
+        {
+            const auto& ev = buffer.events[j % TraceBuffer::Size];
+            fprintf( f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f", ev.name, i, ev.begin / 1000., ( ev.end - ev.begin ) / 1000. );
+            if( ev.arg >= 0 ) fprintf( f, ", \"args\": {\"value\": %lld}", (long long)ev.arg );
+            fprintf( f, "}" );
+        }
+    }
+    fprintf( f, "\n]}\n" );
+    fclose( f );
+
+    if( dropped != 0 ) fprintf( stderr, "Trace: %llu oldest events did not fit in the buffers\n", (unsigned long long)dropped );
+    return true;
+}
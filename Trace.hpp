@@ -0,0 +1,44 @@
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+#include <stdint.h>
+
+// Timeline of the pipeline stages, written as Chrome trace JSON (chrome://tracing, Perfetto).
+// Nothing is recorded until TraceStart(). Each thread then writes its events to its own ring
+// buffer without locking; when a buffer wraps, the oldest events are dropped.
+
+void TraceStart();
+bool TraceEnabled();
+// Nanoseconds since TraceStart()
+uint64_t TraceTime();
+void TraceEvent( const char* name, uint64_t begin, uint64_t end, int64_t arg = -1 );
+void TraceThreadName( const char* name );
+// Only call it while no events are recorded, e.g. after TaskDispatch::Sync()
+bool TraceWrite( const char* fn );
+
+// Records the lifetime of the scope, with an optional value shown in the event arguments
+class TraceScope
+{
+public:
+    TraceScope( const char* name, int64_t arg = -1 )
+        : m_name( TraceEnabled() ? name : nullptr )
+        , m_arg( arg )
+        , m_begin( m_name ? TraceTime() : 0 )
+    {
+    }
+
+    ~TraceScope()
+    {
+        if( m_name ) TraceEvent( m_name, m_begin, TraceTime(), m_arg );
+    }
+
+    TraceScope( const TraceScope& ) = delete;
+    TraceScope& operator=( const TraceScope& ) = delete;
+
+private:
+    const char* m_name;
+    int64_t m_arg;
+    uint64_t m_begin;
+};
+
+#endif
@@ -0,0 +1,21 @@
+# Cross build for 64-bit ARM Linux, e.g. with the Debian/Ubuntu g++-aarch64-linux-gnu package and
+# libpng-dev:arm64, zlib1g-dev:arm64. Binaries run on x86 under qemu-user, see neon-check.sh.
+#
+#   cmake -S . -B build-aarch64 -DMARCH_NATIVE=OFF -DCMAKE_TOOLCHAIN_FILE=aarch64-linux-gnu.cmake
+
+set(CMAKE_SYSTEM_NAME Linux)
+set(CMAKE_SYSTEM_PROCESSOR aarch64)
+
+set(CMAKE_C_COMPILER aarch64-linux-gnu-gcc)
+set(CMAKE_CXX_COMPILER aarch64-linux-gnu-g++)
+
+# The multiarch packages install next to the host libraries, in the aarch64-linux-gnu subdirectories
+set(CMAKE_FIND_ROOT_PATH /usr/aarch64-linux-gnu)
+set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY BOTH)
+set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE BOTH)
+
+# pkg_check_modules must find the arm64 libpng and zlib, not the host ones
+set(ENV{PKG_CONFIG_LIBDIR} /usr/lib/aarch64-linux-gnu/pkgconfig:/usr/share/pkgconfig)
+
+set(CMAKE_CROSSCOMPILING_EMULATOR qemu-aarch64 -L /usr/aarch64-linux-gnu)
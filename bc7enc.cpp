@@ -1,6 +1,7 @@
 // File: bc7enc.c - Richard Geldreich, Jr. 3/31/2020 - MIT license or public domain (see end of file)
 // Currently supports modes 1, 6 for RGB blocks, and modes 5, 6, 7 for RGBA blocks.
 #include "bc7enc.h"
+#include "bcdec.h"
 #include <bit>
 #include <math.h>
 #include <memory.h>
@@ -4082,6 +4083,132 @@ struct bc7_block
 	}
 };
 
+static bool unpack_bc7_block(const void *pBlock, color_rgba *pPixels, void *pUser_data)
+{
+	(void)pUser_data;
+
+	// Mode 8 is reserved and decodes to zeros.
+	if (((const bc7_block *)pBlock)->get_mode() >= 8)
+		return false;
+
+	bcdec_bc7(pBlock, pPixels, 4 * sizeof(color_rgba));
+	return true;
+}
+
+static inline uint32_t compute_block_sse(const color_rgba *pA, const color_rgba *pB, uint32_t num_comps)
+{
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < 16; i++)
+		for (uint32_t c = 0; c < num_comps; c++)
+			total += squarei((int)pA[i].m_c[c] - (int)pB[i].m_c[c]);
+	return total;
+}
+
+uint32_t bc7enc_reduce_entropy(void *pBlocks, uint32_t num_blocks, uint32_t block_size, uint32_t num_comps, const color_rgba *pBlock_pixels, const bc7enc_reduce_entropy_params *pParams,
+	bc7enc_unpack_block_func pUnpack_block_func, void *pUser_data)
+{
+	assert((block_size == 8) || (block_size == 16));
+	assert((num_comps >= 1) && (num_comps <= 4));
+
+	if (pParams->m_lambda <= 0.0f)
+		return 0;
+
+	if (!pUnpack_block_func)
+		pUnpack_block_func = unpack_bc7_block;
+
+	// Runs shorter than this are never worth a match. For 16 byte blocks only every other run length is tried, which halves the number of trial decodes.
+	const uint32_t min_match_len = 3;
+	const uint32_t len_step = block_size / 8;
+	const float literal_bits = 8.0f;
+	const float inv_num_values = 1.0f / (16 * num_comps);
+
+	uint8_t *pBytes = (uint8_t *)pBlocks;
+	uint32_t total_modified = 0;
+
+	for (uint32_t block_index = 0; block_index < num_blocks; block_index++)
+	{
+		uint8_t *pCur = pBytes + block_index * block_size;
+		const color_rgba *pOrig_pixels = pBlock_pixels + block_index * 16;
+
+		color_rgba decoded[16];
+		if (!pUnpack_block_func(pCur, decoded, pUser_data))
+			continue;
+
+		const float cur_mse = compute_block_sse(pOrig_pixels, decoded, num_comps) * inv_num_values;
+
+		// Blocks which are already perfect are usually solid and compress well as is.
+		if (cur_mse == 0.0f)
+			continue;
+
+		const float max_std_dev = compute_block_max_std_dev(pOrig_pixels);
+		float mse_scale = 1.0f;
+		if (max_std_dev < pParams->m_max_smooth_block_std_dev)
+			mse_scale = pParams->m_smooth_block_max_mse_scale + (1.0f - pParams->m_smooth_block_max_mse_scale) * (max_std_dev / pParams->m_max_smooth_block_std_dev);
+
+		const float max_allowed_mse = cur_mse * squaref(pParams->m_max_allowed_rms_increase_ratio);
+
+		float best_t = cur_mse * mse_scale + pParams->m_lambda * (block_size * literal_bits);
+		uint8_t best_block[16];
+		bool improved = false;
+
+		const uint32_t window_size = minimumu(block_index, pParams->m_lookback_window_size);
+		for (uint32_t dist_in_blocks = 1; dist_in_blocks <= window_size; dist_in_blocks++)
+		{
+			const uint8_t *pPrev = pCur - dist_in_blocks * block_size;
+			const uint32_t dist = dist_in_blocks * block_size;
+
+			// Try the whole block first, then leading (endpoint) and trailing (selector) byte runs of it.
+			for (uint32_t len = block_size; len >= min_match_len; len -= len_step)
+			{
+				for (uint32_t side = 0; side < ((len == block_size) ? 1u : 2u); side++)
+				{
+					const uint32_t ofs = side ? (block_size - len) : 0;
+
+					const float match_bits = (float)compute_match_cost_estimate(dist, len) + (block_size - len) * literal_bits;
+					if (pParams->m_lambda * match_bits >= best_t)
+						continue;
+
+					if (memcmp(pCur + ofs, pPrev + ofs, len) == 0)
+						continue;
+
+					uint8_t trial_block[16];
+					memcpy(trial_block, pCur, block_size);
+					memcpy(trial_block + ofs, pPrev + ofs, len);
+
+					color_rgba trial_decoded[16];
+					if (!pUnpack_block_func(trial_block, trial_decoded, pUser_data))
+						continue;
+
+					const float trial_mse = compute_block_sse(pOrig_pixels, trial_decoded, num_comps) * inv_num_values;
+					if (trial_mse > max_allowed_mse)
+						continue;
+
+					const float trial_t = trial_mse * mse_scale + pParams->m_lambda * match_bits;
+					if (trial_t < best_t)
+					{
+						best_t = trial_t;
+						memcpy(best_block, trial_block, block_size);
+						improved = true;
+					}
+				}
+			}
+		}
+
+		if (improved)
+		{
+			memcpy(pCur, best_block, block_size);
+			total_modified++;
+		}
+	}
+
+	return total_modified;
+}
+
+uint32_t bc7enc_estimate_match_cost(uint32_t dist, uint32_t match_len_in_bytes)
+{
+	return compute_match_cost_estimate(dist, match_len_in_bytes);
+}
+
 /*
 ------------------------------------------------------------------------------
 This software is available under 2 licenses -- choose whichever you prefer.
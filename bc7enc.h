@@ -116,4 +116,47 @@ void bc7enc_compress_block_init();
 // Returns true if the block had any pixels with alpha < 255, otherwise it return false. (This is not an error code - a block is always encoded.)
 bool bc7enc_compress_block(void *pBlock, const void *pPixelsRGBA, const bc7enc_compress_block_params *pComp_params);
 
+struct bc7enc_reduce_entropy_params
+{
+	// m_lambda controls the rate-distortion tradeoff. The higher this value, the smaller the LZ compressed output, but the lower the quality. 0 disables the pass.
+	float m_lambda;
+
+	// Number of previously encoded blocks searched for byte matches. Deflate can't reach further back than 32KB anyway.
+	uint32_t m_lookback_window_size;
+
+	// Upper bound of the per-block RMS error increase, relative to the RMS error of the original encoding.
+	float m_max_allowed_rms_increase_ratio;
+
+	// Blocks with a max channel standard deviation below m_max_smooth_block_std_dev are treated as smooth. Artifacts are very visible there, so their
+	// MSE is scaled up to m_smooth_block_max_mse_scale as the standard deviation goes to 0.
+	float m_max_smooth_block_std_dev;
+	float m_smooth_block_max_mse_scale;
+
+	void clear()
+	{
+		memset(this, 0, sizeof(*this));
+	}
+};
+
+inline void bc7enc_reduce_entropy_params_init(bc7enc_reduce_entropy_params *p)
+{
+	p->m_lambda = 1.0f;
+	p->m_lookback_window_size = 64;
+	p->m_max_allowed_rms_increase_ratio = 10.0f;
+	p->m_max_smooth_block_std_dev = 18.0f;
+	p->m_smooth_block_max_mse_scale = 10.0f;
+}
+
+// Unpacks a single encoded block to 16 RGBA pixels. Returns false if the block is invalid.
+typedef bool (*bc7enc_unpack_block_func)(const void *pBlock, color_rgba *pPixels, void *pUser_data);
+
+// Rate-distortion post-pass over num_blocks already encoded, consecutive blocks of block_size bytes each. Each block is compared against the
+// blocks in the lookback window, and byte runs of it are replaced with the matching bytes of an earlier block, if the resulting error increase is
+// worth the estimated deflate bit savings at the given lambda. pBlock_pixels holds the 16 source pixels of each block, and num_comps (3 or 4) selects
+// whether alpha contributes to the error. If pUnpack_block_func is nullptr, the blocks are BC7.
+// Returns the number of modified blocks.
+uint32_t bc7enc_reduce_entropy(void *pBlocks, uint32_t num_blocks, uint32_t block_size, uint32_t num_comps, const color_rgba *pBlock_pixels, const bc7enc_reduce_entropy_params *pParams,
+	bc7enc_unpack_block_func pUnpack_block_func = nullptr, void *pUser_data = nullptr);
 
+// Estimated number of bits deflate needs to code a match of match_len_in_bytes bytes at distance dist. Used by the BC1-5 entropy reduction.
+uint32_t bc7enc_estimate_match_cost(uint32_t dist, uint32_t match_len_in_bytes);
@@ -19,6 +19,7 @@ void* mmap( void* addr, size_t length, int prot, int flags, int fd, off_t offset
         }
         break;
     case PROT_WRITE:
+    case PROT_READ | PROT_WRITE:
         if( hnd = CreateFileMapping( HANDLE( _get_osfhandle( fd ) ), nullptr, PAGE_READWRITE, 0, DWORD( length ), nullptr ) )
         {
             map = MapViewOfFile( hnd, FILE_MAP_WRITE, 0, 0, length );
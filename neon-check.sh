@@ -0,0 +1,57 @@
+#!/bin/sh
+# Checks that the aarch64 NEON kernels of the BC3, BC4 and BC5 encoders produce the same blocks as
+# the SSE4.1 ones. Both are built with CMake, the ARM one with aarch64-linux-gnu.cmake, and compress
+# examples/*.png; the ARM build runs under qemu-user.
+#
+# The NEON kernels follow the SSE4.1 arithmetic. The scalar ProcessAlpha fallback rounds differently
+# and is not compared. The BC3 color half comes from a different ProcessRGB on each architecture,
+# so only the alpha half of the BC3 blocks is compared.
+#
+# Usage: ./neon-check.sh [build directory]
+# Set X86 and ARM to the paths of existing etcpak binaries to skip the builds.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")" && pwd)
+OUT=${1:-$ROOT/build-neon-check}
+QEMU=${QEMU-qemu-aarch64 -L /usr/aarch64-linux-gnu}
+
+mkdir -p "$OUT"
+
+if [ -z "$X86" ]; then
+    cmake -S "$ROOT" -B "$OUT/sse41" -DCMAKE_BUILD_TYPE=Release -DMARCH_NATIVE=OFF -DCMAKE_C_FLAGS=-msse4.1 -DCMAKE_CXX_FLAGS=-msse4.1 > /dev/null
+    cmake --build "$OUT/sse41" --target etcpak -j"$(nproc)" > /dev/null
+    X86=$OUT/sse41/etcpak
+fi
+if [ -z "$ARM" ]; then
+    cmake -S "$ROOT" -B "$OUT/aarch64" -DCMAKE_BUILD_TYPE=Release -DMARCH_NATIVE=OFF -DCMAKE_TOOLCHAIN_FILE="$ROOT/aarch64-linux-gnu.cmake" > /dev/null
+    cmake --build "$OUT/aarch64" --target etcpak -j"$(nproc)" > /dev/null
+    ARM=$OUT/aarch64/etcpak
+fi
+
+# Block data after the 52 byte PVR header. BC3 blocks are 8 bytes of alpha followed by 8 bytes of color.
+blocks()
+{
+    python3 -c '
+import sys
+d = open( sys.argv[1], "rb" ).read()[52:]
+if sys.argv[2] == "bc3": d = b"".join( d[i:i+8] for i in range( 0, len( d ), 16 ) )
+sys.stdout.buffer.write( d )' "$1" "$2"
+}
+
+fail=0
+for img in "$ROOT"/examples/*.png; do
+    for codec in bc3 bc4 bc5; do
+        "$X86" -c $codec "$img" "$OUT/x86.pvr" > /dev/null
+        $QEMU "$ARM" -c $codec "$img" "$OUT/arm.pvr" > /dev/null
+        blocks "$OUT/x86.pvr" $codec > "$OUT/x86.bin"
+        blocks "$OUT/arm.pvr" $codec > "$OUT/arm.bin"
+        if cmp -s "$OUT/x86.bin" "$OUT/arm.bin"; then
+            echo "same     $codec $(basename "$img")"
+        else
+            echo "DIFFERS  $codec $(basename "$img")"
+            fail=1
+        fi
+    done
+done
+exit $fail